@@ -4,22 +4,20 @@
 #include <TImage.h>
 #include <TText.h>
 #include <cmath>
+#include <iostream>
 
 REGISTER_ANALYSIS_TYPE(DataSkip, "Textual analysis description here.")
 
 DataSkip::DataSkip() :
- TrackAnalysis(), _file(nullptr), _currentHist(nullptr)
+ TrackAnalysis(), _file(nullptr), _currentHist(nullptr), _singlePass(false)
 {
-	addProcess("analyze", CS_TRACK,
-		core::TrackAnalysis::init_callback_t{},
-		core::TrackAnalysis::run_init_callback_t{},
-		std::bind(&DataSkip::analyze, this, std::placeholders::_1, std::placeholders::_2),
-		core::TrackAnalysis::run_post_callback_t{},
-	        std::bind(&DataSkip::finish, this));
 	getOptionsDescription().add_options()
 		("range", po::value<int>()->default_value(10), "Generate correlation in data offset range -NUM to NUM")
 		("num,n", po::value<int>()->default_value(5000), "Number of events used for correlation histogram")
 		("bins,b", po::value<int>()->default_value(500), "Number of bins in the history")
+		("single-pass", "Fill the histograms of all offsets while reading the data only once")
+		("detect-desync", "Track the data offset within each run and write the per-run offset maps")
+		("window", po::value<int>()->default_value(2000), "Number of events used to decide the offset with --detect-desync")
 	;
 }
 
@@ -37,14 +35,40 @@ void DataSkip::init(const po::variables_map& vm)
 	_file = new TFile(getRootFilename().c_str(), "RECREATE");
 	_numBins = vm["bins"].as<int>();
 	_range = vm["range"].as<int>();
-	setDataOffset(-_range);
 	_eventsPerRun = vm["num"].as<int>();
+	_singlePass = vm.count("single-pass");
 
-	std::ostringstream name;
-	name << "xcorrelation_" << getDataOffset()+_range;
-	std::ostringstream title;
-	title << "data skip = " << getDataOffset();
-	_currentHist = new TH1D(name.str().c_str(), title.str().c_str(), _numBins, -10, -10);
+	// the process depends on the mode, so it is added here instead of the constructor
+	if(vm.count("detect-desync")) {
+		setDataOffset(0);
+		_detector.reset(new core::DesyncDetector(_range, vm["window"].as<int>()));
+		addProcess("detect_desync", CS_ALWAYS,
+			core::TrackAnalysis::init_callback_t{},
+			std::bind(&DataSkip::startRunDesync, this),
+			std::bind(&DataSkip::analyzeDesync, this, std::placeholders::_1, std::placeholders::_2),
+			std::bind(&DataSkip::finishRunDesync, this),
+			core::TrackAnalysis::post_callback_t{});
+	} else if(_singlePass) {
+		setDataOffset(0);
+		for(int offset = -_range; offset <= _range; ++offset) {
+			_hists.push_back(createHistogram(offset));
+		}
+		addProcess("analyze", CS_ALWAYS,
+			core::TrackAnalysis::init_callback_t{},
+			std::bind(&DataSkip::startRunSinglePass, this),
+			std::bind(&DataSkip::analyzeSinglePass, this, std::placeholders::_1, std::placeholders::_2),
+			core::TrackAnalysis::run_post_callback_t{},
+			std::bind(&DataSkip::finishSinglePass, this));
+	} else {
+		setDataOffset(-_range);
+		_currentHist = createHistogram(getDataOffset());
+		addProcess("analyze", CS_TRACK,
+			core::TrackAnalysis::init_callback_t{},
+			core::TrackAnalysis::run_init_callback_t{},
+			std::bind(&DataSkip::analyze, this, std::placeholders::_1, std::placeholders::_2),
+			core::TrackAnalysis::run_post_callback_t{},
+			std::bind(&DataSkip::finish, this));
+	}
 	int nx = core::max(1, static_cast<int>(std::sqrt(_range*2+2)));
 	int ny = core::max(1, (_range*2 + 2) / nx) + 1;
 	assert(nx*ny >= _range*2+2);
@@ -84,28 +108,147 @@ bool DataSkip::analyze(const core::TrackStreamReader::event_t& track_event,
 	return _currentHist->GetEntries() < _eventsPerRun;
 }
 
-void DataSkip::finish()
+bool DataSkip::analyzeSinglePass(const core::TrackStreamReader::event_t& track_event,
+                                 const core::BaseSensorStreamReader::event_t& mpa_event)
+{
+	// reuse the containers of the event dropping out of the window
+	std::vector<double> pixels;
+	std::vector<double> tracks;
+	if(_pixelWindow.size() > static_cast<size_t>(_range)) {
+		pixels.swap(_pixelWindow.front());
+		tracks.swap(_trackWindow.front());
+		_pixelWindow.pop_front();
+		_trackWindow.pop_front();
+	}
+	pixels.clear();
+	for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
+		if(!mpa_event.data[idx]) continue;
+		pixels.push_back(_mpaTransform.transform(idx)(0));
+	}
+	tracks.clear();
+	for(const auto& track: track_event.tracks) {
+		tracks.push_back(track.extrapolateOnPlane(0, 5, 840, 2)(0));
+	}
+	_pixelWindow.push_back(std::move(pixels));
+	_trackWindow.push_back(std::move(tracks));
+
+	// offset = track event number - pixel event number, window entry k is k events older
+	const size_t newest = _pixelWindow.size() - 1;
+	for(size_t k = 0; k <= newest; ++k) {
+		// new tracks with older pixel events
+		TH1D* hist = _hists[_range + k];
+		if(hist->GetEntries() < _eventsPerRun) {
+			for(auto b: _trackWindow[newest]) {
+				for(auto a: _pixelWindow[newest - k]) {
+					hist->Fill(b - a);
+				}
+			}
+		}
+		if(k == 0) continue;
+		// new pixel event with older tracks
+		hist = _hists[_range - k];
+		if(hist->GetEntries() < _eventsPerRun) {
+			for(auto b: _trackWindow[newest - k]) {
+				for(auto a: _pixelWindow[newest]) {
+					hist->Fill(b - a);
+				}
+			}
+		}
+	}
+	for(auto hist: _hists) {
+		if(hist->GetEntries() < _eventsPerRun) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void DataSkip::startRunSinglePass()
+{
+	// events of different runs are not correlated
+	_pixelWindow.clear();
+	_trackWindow.clear();
+}
+
+void DataSkip::finishSinglePass()
+{
+	for(int offset = -_range; offset <= _range; ++offset) {
+		drawHistogram(_hists[offset + _range], offset);
+	}
+	auto img = TImage::Create();
+	img->FromPad(_canvas);
+	img->WriteImage(getFilename(".png").c_str());
+	delete img;
+}
+
+bool DataSkip::analyzeDesync(const core::TrackStreamReader::event_t& track_event,
+                             const core::BaseSensorStreamReader::event_t& mpa_event)
+{
+	_pixelX.clear();
+	for(size_t idx = 0; idx < mpa_event.data.size(); ++idx) {
+		if(!mpa_event.data[idx]) continue;
+		_pixelX.push_back(_mpaTransform.transform(idx)(0));
+	}
+	_trackX.clear();
+	for(const auto& track: track_event.tracks) {
+		_trackX.push_back(track.extrapolateOnPlane(0, 5, 840, 2)(0));
+	}
+	_detector->addEvent(mpa_event.eventNumber, _pixelX, _trackX);
+	return true;
+}
+
+void DataSkip::startRunDesync()
+{
+	_detector->reset();
+}
+
+void DataSkip::finishRunDesync()
+{
+	_detector->finish();
+	const auto& map = _detector->getOffsetMap();
+	std::cout << "MPA run " << getCurrentRunId() << ": ";
+	if(map.empty()) {
+		std::cout << "no significant data offset found";
+	}
+	for(const auto& segment: map.getSegments()) {
+		std::cout << "offset " << segment.offset << " from event " << segment.firstEvent << "; ";
+	}
+	std::cout << std::endl;
+	// written for every run, an empty map keeps the offset of the runlist for data_offset_map
+	map.write(getFilename(getCurrentRunId(), "_offsets.txt"));
+}
+
+TH1D* DataSkip::createHistogram(int offset) const
+{
+	std::ostringstream name;
+	name << "xcorrelation_" << offset+_range;
+	std::ostringstream title;
+	title << "data skip = " << offset;
+	return new TH1D(name.str().c_str(), title.str().c_str(), _numBins, -10, -10);
+}
+
+void DataSkip::drawHistogram(TH1D* hist, int offset)
 {
 	const double binratio = 0.1;
-	if(_currentHist->GetEntries() * binratio * 2 < _currentHist->GetNbinsX()) {
+	if(hist->GetEntries() * binratio * 2 < hist->GetNbinsX()) {
 		/*std::cout << "REBIN!\n"
-		          << "Num entries: " << _currentHist->GetEntries() << "\n"
-		          << "Entry threshold: " << _currentHist->GetEntries() * binratio * 2 << "\n"
-			  << "Num X bins: " << _currentHist->GetNbinsX() << "\n";*/
-		_currentHist->Rebin(_currentHist->GetNbinsX() / (_currentHist->GetEntries() * binratio));
-//		std::cout << "New reduced bin number: " << _currentHist->GetNbinsX() << std::endl;
+		          << "Num entries: " << hist->GetEntries() << "\n"
+		          << "Entry threshold: " << hist->GetEntries() * binratio * 2 << "\n"
+			  << "Num X bins: " << hist->GetNbinsX() << "\n";*/
+		hist->Rebin(hist->GetNbinsX() / (hist->GetEntries() * binratio));
+//		std::cout << "New reduced bin number: " << hist->GetNbinsX() << std::endl;
 	}
-	_canvas->cd(getDataOffset()+_range+2);
-	_currentHist->Draw();
+	_canvas->cd(offset+_range+2);
+	hist->Draw();
+}
+
+void DataSkip::finish()
+{
+	drawHistogram(_currentHist, getDataOffset());
 	if(getDataOffset()+1 <= _range) {
 		setDataOffset(getDataOffset()+1);
 		rerun();
-		
-		std::ostringstream name;
-		name << "xcorrelation_" << getDataOffset()+_range;
-		std::ostringstream title;
-		title << "data skip = " << getDataOffset();
-		_currentHist = new TH1D(name.str().c_str(), title.str().c_str(), _numBins, -10, -10);
+		_currentHist = createHistogram(getDataOffset());
 	} else {
 		auto img = TImage::Create();
 		img->FromPad(_canvas);
@@ -3,9 +3,13 @@
 #define DATA_SKIP_H
 
 #include "trackanalysis.h"
+#include "desyncdetector.h"
 #include <TFile.h>
 #include <TH1D.h>
 #include <TCanvas.h>
+#include <vector>
+#include <deque>
+#include <memory>
 
 class DataSkip : public core::TrackAnalysis
 {
@@ -21,12 +25,38 @@ private:
         bool analyze(const core::TrackStreamReader::event_t& track_event,
 	             const core::BaseSensorStreamReader::event_t& mpa_event);
 	void finish();
+	/** \brief Fill the histograms of all offsets in one pass
+	 *
+	 * Called for every pixel event with the track event of the same number. The x positions of
+	 * the last range+1 events are kept, so each new event completes the pairs with all offsets.
+	 */
+	bool analyzeSinglePass(const core::TrackStreamReader::event_t& track_event,
+	                       const core::BaseSensorStreamReader::event_t& mpa_event);
+	void startRunSinglePass();
+	void finishSinglePass();
+	/// Feed the desync detector, hits and tracks are reduced to their x positions
+	bool analyzeDesync(const core::TrackStreamReader::event_t& track_event,
+	                   const core::BaseSensorStreamReader::event_t& mpa_event);
+	void startRunDesync();
+	/// Write the offset map of the run, empty if no offset was detected
+	void finishRunDesync();
+	TH1D* createHistogram(int offset) const;
+	void drawHistogram(TH1D* hist, int offset);
 	TFile* _file;
 	TH1D* _currentHist;
 	TCanvas* _canvas;
 	int _numBins;
 	int _eventsPerRun;
 	int _range;
+	bool _singlePass;
+	/// Histograms of all offsets in single-pass mode, index is offset + range
+	std::vector<TH1D*> _hists;
+	/// Hit and track x positions of the last events, newest last
+	std::deque<std::vector<double>> _pixelWindow;
+	std::deque<std::vector<double>> _trackWindow;
+	std::unique_ptr<core::DesyncDetector> _detector;
+	std::vector<double> _pixelX;
+	std::vector<double> _trackX;
 };
 
 #endif//DATA_SKIP_H
@@ -15,6 +15,8 @@ REGISTER_ANALYSIS_TYPE(GblAlign, "Uses pre-alignment data and GBL to generate al
 GblAlign::GblAlign() :
  core::MergedAnalysis(), _file(nullptr)
 {
+	// triplet tracks with ref and DUT hits, the DUT is mpa_2
+	setRequiredBranches({"telhits", "mpa_2"});
 }
 
 GblAlign::~GblAlign()
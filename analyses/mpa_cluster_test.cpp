@@ -2,6 +2,7 @@
 
 #include "mpa_cluster_test.h"
 #include "mpahitgenerator.h"
+#include "runsnapshot.h"
 #include <iostream>
 #include <TImage.h>
 #include <TCanvas.h>
@@ -17,6 +18,8 @@ REGISTER_ANALYSIS_TYPE(MpaClusterTest, "Calculate clustering properties of speci
 
 MpaClusterTest::MpaClusterTest()
 {
+	setRequiredBranches({"telhits", "mpa_2"});
+	setRequiredPlanes({"p3"});
 }
 
 MpaClusterTest::~MpaClusterTest()
@@ -43,8 +46,8 @@ void MpaClusterTest::run(const core::run_data_t& run)
 	transform.setRotation({0, 0, 3.1415 / 180 * 90});
 	std::ofstream fhits(getFilename("_hits.csv"));
 	std::ofstream fclusters(getFilename("_clusters.csv"));
-	for(size_t evt = 2; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+	for(size_t evt = 2; evt < core::getEntries(run); ++evt) {
+		core::getEntry(run, evt);
 		auto pixels = core::MpaHitGenerator::getCounterPixels(run, transform);
 		auto clusters = core::MpaHitGenerator::clusterize(pixels, &sizes, &areas);
 		for(auto pixel: pixels) {
@@ -22,6 +22,8 @@ MpaCmaesAlign::MpaCmaesAlign() :
 		("high-z", po::value<double>()->default_value(860), "Upper bound of Z align scan")
 		("num-steps,s", po::value<int>()->default_value(10), "Number of steps in the range (low,high)")
 		("sample-size,n", po::value<int>()->default_value(10000), "Number of data points to include in alignment histogram")
+		("sampling", po::value<std::string>()->default_value("first"), "Selection of the sample: first (events at the beginning of the runs), stride (every k-th event, needs event indices) or reservoir (uniform random)")
+		("seed", po::value<unsigned int>()->default_value(0), "Random seed of the sampling")
 		("multirun-paths,M", po::value<std::string>(), "Put results in directory specialized for multiple alignment execution. Useful for analyzing the alignment with further postprocessing.")
 		("write-cache,C", "If set, up to 1000 hits from the cache are written to disk. Useful for debugging.")
 		("write-function,F", "If set, each traversed phase space point is written to disk. Timeconsuming!")
@@ -85,6 +87,14 @@ void MpaCmaesAlign::init(const po::variables_map& vm)
 	_writeCache = vm.count("write-cache") > 0;
 	_modelEfficiency = vm.count("efficiency-model") > 0;
 	_writeFunction = vm.count("write-function") > 0;
+	// only single track events with at most one hit are cached, let the readers drop the others
+	core::EventFilter filter;
+	filter.minTracks = filter.maxTracks = 1;
+	filter.minHits = _modelEfficiency ? 0 : 1;
+	filter.maxHits = 1;
+	setEventFilter(filter);
+	// spread the sample over the whole runs instead of taking the first events
+	setSampling(parseSamplingMode(vm["sampling"].as<std::string>()), _sampleSize, vm["seed"].as<unsigned int>());
 	_eventCache.reserve(_sampleSize);
 	_cacheFull = false;
 	_forceStatus = _config.get<int>("cmaes_force_status") > 0;
@@ -18,6 +18,8 @@ MpaMinuitAlign::MpaMinuitAlign() :
 		("high-z", po::value<double>()->default_value(860), "Upper bound of Z align scan")
 		("num-steps,s", po::value<int>()->default_value(10), "Number of steps in the range (low,high)")
 		("sample-size,n", po::value<int>()->default_value(10000), "Number of data points to include in alignment histogram")
+		("sampling", po::value<std::string>()->default_value("first"), "Selection of the sample: first (events at the beginning of the runs), stride (every k-th event, needs event indices) or reservoir (uniform random)")
+		("seed", po::value<unsigned int>()->default_value(0), "Random seed of the sampling")
 	;
 	addProcess("load", /* CS_ALWAYS */ CS_TRACK,
 	           core::TrackAnalysis::init_callback_t {},
@@ -42,6 +44,13 @@ void MpaMinuitAlign::init(const po::variables_map& vm)
 	_aligner.initHistograms();
 	_sampleSize = vm["sample-size"].as<int>();
 	_eventCache.reserve(_sampleSize);
+	// only single track events with a single hit are used, let the readers drop the others
+	core::EventFilter filter;
+	filter.minTracks = filter.maxTracks = 1;
+	filter.minHits = filter.maxHits = 1;
+	setEventFilter(filter);
+	// spread the sample over the whole runs instead of taking the first events
+	setSampling(parseSamplingMode(vm["sampling"].as<std::string>()), _sampleSize, vm["seed"].as<unsigned int>());
 	/*int num_plots = _numSteps + 4;
 	int n_x = std::sqrt(num_plots);
 	int n_y = std::sqrt(num_plots);
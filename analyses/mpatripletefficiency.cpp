@@ -1,6 +1,7 @@
 
 #include "mpatripletefficiency.h"
 #include "mpahitgenerator.h"
+#include "runsnapshot.h"
 #include <iostream>
 #include <TImage.h>
 #include <TCanvas.h>
@@ -9,6 +10,7 @@
 #include "mpatransform.h"
 #include <TF1.h>
 #include <algorithm>
+#include <memory>
 #include <TGraph.h>
 #include <cmath>
 
@@ -18,6 +20,8 @@ MpaTripletEfficiency::MpaTripletEfficiency() :
  _currentDutResX(nullptr), _currentDutResY(nullptr),
  _trackHitCount(0), _realHitCount(0)
 {
+	// calcTrack() reads run.mpaData[0]
+	setRequiredBranches({"telhits", "mpa_1", "mpa_2"});
 }
 
 MpaTripletEfficiency::~MpaTripletEfficiency()
@@ -105,15 +109,22 @@ void MpaTripletEfficiency::run(const core::run_data_t& run)
 	_currentDutResZ = new TH1F("dut_res_z", "", 200, -10, -10);
 	std::cout << "Find tracks in datafile" << std::endl;
 	auto hists = core::TripletTrack::genDebugHistograms();
-	auto tracks = core::TripletTrack::getTracksWithRefDut(_trackConsts, run, hists, nullptr, nullptr, false);
+	// tracking and clustering both pass over the run, read the tree only once. Flat runs are in memory.
+	std::unique_ptr<core::RunSnapshot> snapshot;
+	core::run_data_t cached = run;
+	if(!run.snapshot) {
+		snapshot.reset(new core::RunSnapshot(run));
+		cached.snapshot = snapshot.get();
+	}
+	auto tracks = core::TripletTrack::getTracksWithRefDut(_trackConsts, cached, hists, nullptr, nullptr, false);
 	size_t trackIdx = 0;
 	transform.setOffset(_dutAlignOffset);
 	transform.setRotation(_trackConsts.dut_rotation);
 	std::cout << "Track particles to DUT" << std::endl;
 //	std::ofstream fout(getFilename("_hits.csv"));
-	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
-		auto pixelHits = core::MpaHitGenerator::getCounterPixels(run, transform);
+	for(size_t evt = 0; evt < core::getEntries(cached); ++evt) {
+		core::getEntry(cached, evt);
+		auto pixelHits = core::MpaHitGenerator::getCounterPixels(cached, transform);
 		std::vector<int> clusterSizes;
 		auto clusterHits = core::MpaHitGenerator::clusterize(pixelHits, &clusterSizes, nullptr);
 		_mpaActivationHist->Fill(_currentRunId, pixelHits.size());
@@ -146,7 +157,7 @@ void MpaTripletEfficiency::run(const core::run_data_t& run)
 				_currentDutResY->Fill(res(1));
 				_currentDutResZ->Fill(res(2));
 			}
-			calcTrack(track, clusterHits, transform, run);
+			calcTrack(track, clusterHits, transform, cached);
 //			for(auto hitpoint: core::MpaHitGenerator::getCounterHits(run, transform)) {
 //				fout << hitpoint(0) << " " << hitpoint(1) << " " << hitpoint(2)+0.2 << "\n";
 //			}
@@ -6,7 +6,9 @@
 #include <TFitResult.h>
 #include <fstream>
 #include "mpatransform.h"
+#include "runsnapshot.h"
 #include <TF1.h>
+#include <TDirectory.h>
 
 REGISTER_ANALYSIS_TYPE(RefPreAlign, "Prealign the reference plane")
 
@@ -15,6 +17,11 @@ RefPreAlign::RefPreAlign() :
  _refResX(nullptr), _refResY(nullptr),
  _dutResX(nullptr), _dutResY(nullptr)
 {
+	// run.mpaData[1] is mpa_2
+	setRequiredBranches({"telhits", "mpa_2"});
+	setRequiredPlanes({"p1", "ref"});
+	// the runs only contribute to the residual histograms
+	setParallelRuns(true);
 }
 
 RefPreAlign::~RefPreAlign()
@@ -29,23 +36,63 @@ void RefPreAlign::init()
 {
 	std::cout << "Init ref pre align: " << getRootFilename() << std::endl;
 	_file = new TFile(getRootFilename().c_str(), "recreate");
-	_refResX = new TH1F("ref_res_x", "Ref Residual X", 500, -10, 10);
-	_refResY = new TH1F("ref_res_y", "Ref Residual Y", 500, -10, 10);
-	_dutResX = new TH1F("dut_res_x", "DUT Residual X", 200, -10, 10);
-	_dutResY = new TH1F("dut_res_y", "DUT Residual Y", 200, -10, 10);
+	residuals_t residuals;
+	createResiduals(residuals);
+	_refResX = residuals.refResX.release();
+	_refResY = residuals.refResY.release();
+	_dutResX = residuals.dutResX.release();
+	_dutResY = residuals.dutResY.release();
+	for(TH1F* hist: {_refResX, _refResY, _dutResX, _dutResY}) {
+		hist->SetDirectory(_file);
+	}
 }
 
 void RefPreAlign::run(const core::run_data_t& run)
 {
 	std::cout << "Run " << run.runId << std::endl;
+	fillResiduals(run, _refResX, _refResY, _dutResX, _dutResY);
+}
+
+std::unique_ptr<core::MergedAnalysis::RunResult> RefPreAlign::processRun(const core::run_data_t& run)
+{
+	std::cout << "Run " << run.runId << std::endl;
+	std::unique_ptr<residuals_t> residuals(new residuals_t);
+	createResiduals(*residuals);
+	fillResiduals(run, residuals->refResX.get(), residuals->refResY.get(), residuals->dutResX.get(),
+	              residuals->dutResY.get());
+	return std::move(residuals);
+}
+
+void RefPreAlign::mergeRun(int runId, RunResult& result)
+{
+	auto& residuals = static_cast<residuals_t&>(result);
+	_refResX->Add(residuals.refResX.get());
+	_refResY->Add(residuals.refResY.get());
+	_dutResX->Add(residuals.dutResX.get());
+	_dutResY->Add(residuals.dutResY.get());
+}
+
+void RefPreAlign::createResiduals(residuals_t& residuals)
+{
+	// not added to the current directory, workers of several runs create histograms of the same names
+	TDirectory::TContext context(nullptr);
+	residuals.refResX.reset(new TH1F("ref_res_x", "Ref Residual X", 500, -10, 10));
+	residuals.refResY.reset(new TH1F("ref_res_y", "Ref Residual Y", 500, -10, 10));
+	residuals.dutResX.reset(new TH1F("dut_res_x", "DUT Residual X", 200, -10, 10));
+	residuals.dutResY.reset(new TH1F("dut_res_y", "DUT Residual Y", 200, -10, 10));
+}
+
+void RefPreAlign::fillResiduals(const core::run_data_t& run, TH1F* refResX, TH1F* refResY, TH1F* dutResX,
+                                TH1F* dutResY)
+{
 	auto telHits = *run.telescopeHits;
-	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEvent(evt);
+	for(size_t evt = 0; evt < core::getEntries(run); ++evt) {
+		core::getEntry(run, evt);
 		core::MpaTransform transform;
 		for(size_t it = 0; it < telHits->p1.x.GetNoElements(); ++it) {
 			for(size_t ir = 0; ir < telHits->ref.x.GetNoElements(); ++ir) {
-				_refResX->Fill(telHits->ref.x[ir] - telHits->p1.x[it]);
-				_refResY->Fill(telHits->ref.y[ir] - telHits->p1.y[it]);
+				refResX->Fill(telHits->ref.x[ir] - telHits->p1.x[it]);
+				refResY->Fill(telHits->ref.y[ir] - telHits->p1.y[it]);
 			}
 			for(size_t pixel = 0; pixel < 48; ++pixel) {
 				if((*run.mpaData[1].data)->counter.pixels[pixel] == 0) {
@@ -59,8 +106,8 @@ void RefPreAlign::run(const core::run_data_t& run)
 				// 	continue;
 				// }
 				auto hit = transform.transform(pixel);
-				_dutResX->Fill(telHits->p1.y[it] + hit(0));
-				_dutResY->Fill(telHits->p1.x[it] - hit(1));
+				dutResX->Fill(telHits->p1.y[it] + hit(0));
+				dutResY->Fill(telHits->p1.x[it] - hit(1));
 			}
 		}
 	}
@@ -13,9 +13,24 @@ public:
 
 	virtual void init();
 	virtual void run(const core::run_data_t& run);
+	virtual std::unique_ptr<RunResult> processRun(const core::run_data_t& run);
+	virtual void mergeRun(int runId, RunResult& result);
 	virtual void finalize();
 
 private:
+	/// Residual histograms of a run
+	struct residuals_t : public RunResult {
+		std::unique_ptr<TH1F> refResX;
+		std::unique_ptr<TH1F> refResY;
+		std::unique_ptr<TH1F> dutResX;
+		std::unique_ptr<TH1F> dutResY;
+	};
+
+	/// Create empty histograms, not attached to a directory
+	static void createResiduals(residuals_t& residuals);
+	static void fillResiduals(const core::run_data_t& run, TH1F* refResX, TH1F* refResY, TH1F* dutResX,
+	                          TH1F* dutResY);
+
 	TFile* _file;
 	TH1F* _refResX;
 	TH1F* _refResY;
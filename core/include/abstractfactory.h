@@ -3,9 +3,12 @@
 #define ABSTRACT_FACTORY_H
 
 #include <map>
+#include <vector>
+#include <string>
 #include <memory>
 #include <functional>
 #include <typeinfo>
+#include <stdexcept>
 #include <boost/preprocessor/stringize.hpp>
 #include <boost/preprocessor/cat.hpp>
 #include "util.h"
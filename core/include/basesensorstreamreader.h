@@ -3,7 +3,16 @@
 #define BASE_SENSOR_STREAM_READER_H
 
 #include "abstractfactory.h"
+#include "eventindex.h"
+#include "eventfilter.h"
+#include "runcatalog.h"
 #include <type_traits>
+#include <memory>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
 
 namespace core {
 
@@ -15,6 +24,18 @@ namespace core {
  * and const_iterator), satisfying the C++ iterator concepts.
  *
  * The actual work is performed by a subclassed BaseSensorStreamReader::reader class.
+ *
+ * Analyses processing many events can read blocks of events into a batch_t with iterator::readBatch(),
+ * which avoids the per-event virtual call and event_t copy.
+ *
+ * Readers supporting an EventIndex (see setUseIndex()) can start at any event in constant time, which is
+ * used to restrict the iteration to an event range (setEventRange()). Other readers skip the events before
+ * the range.
+ *
+ * An EventFilter (see setEventFilter()) removes events from the iteration inside the reader, so rejected
+ * events never reach the iterators.
+ *
+ * With a RunCatalog (see setCatalog()), iterators passing over the whole file record its statistics.
  */
 class BaseSensorStreamReader
 {
@@ -41,6 +62,92 @@ public:
 		std::vector<int> bunchCrossing;
 	};
 
+	/** \brief Block of events in struct-of-arrays layout
+	 *
+	 * The data and bunch crossing ids of all events are stored back to back, event i occupies
+	 * data[dataOffsets[i]] to data[dataOffsets[i+1]-1] (bunchCrossing likewise). If all events have the same
+	 * number of channels, as for MPA counter and memory data, data is a row-major matrix with getWidth()
+	 * columns. The containers keep their capacity when the batch is reused.
+	 *
+	 * \sa const_noconst_iterator::readBatch
+	 */
+	struct batch_t {
+		batch_t() : dataOffsets(1, 0), bunchCrossingOffsets(1, 0) {}
+
+		/// Event numbers
+		std::vector<int> eventNumbers;
+		/// Data of all events
+		std::vector<int> data;
+		/// Start of each event in data, size()+1 entries
+		std::vector<size_t> dataOffsets;
+		/// Bunch crossing ids of all events
+		std::vector<int> bunchCrossing;
+		/// Start of each event in bunchCrossing, size()+1 entries
+		std::vector<size_t> bunchCrossingOffsets;
+
+		size_t size() const { return eventNumbers.size(); }
+		bool empty() const { return eventNumbers.empty(); }
+
+		void clear()
+		{
+			eventNumbers.clear();
+			data.clear();
+			dataOffsets.assign(1, 0);
+			bunchCrossing.clear();
+			bunchCrossingOffsets.assign(1, 0);
+		}
+
+		/** \brief Finish an event
+		 *
+		 * Data and bunch crossing ids appended since the last event belong to this event.
+		 */
+		void endEvent(int eventNumber)
+		{
+			eventNumbers.push_back(eventNumber);
+			dataOffsets.push_back(data.size());
+			bunchCrossingOffsets.push_back(bunchCrossing.size());
+		}
+
+		/// Append a complete event
+		void push_back(const event_t& event)
+		{
+			data.insert(data.end(), event.data.begin(), event.data.end());
+			bunchCrossing.insert(bunchCrossing.end(), event.bunchCrossing.begin(), event.bunchCrossing.end());
+			endEvent(event.eventNumber);
+		}
+
+		/** \brief Number of channels per event
+		 *
+		 * \return 0 if the events have different numbers of channels or the batch is empty
+		 */
+		size_t getWidth() const
+		{
+			if(empty()) {
+				return 0;
+			}
+			const size_t width = dataOffsets[1];
+			for(size_t i = 1; i < dataOffsets.size(); ++i) {
+				if(dataOffsets[i] - dataOffsets[i-1] != width) {
+					return 0;
+				}
+			}
+			return width;
+		}
+
+		const int* getData(size_t i) const { return data.data() + dataOffsets[i]; }
+		size_t getDataSize(size_t i) const { return dataOffsets[i+1] - dataOffsets[i]; }
+		const int* getBunchCrossing(size_t i) const { return bunchCrossing.data() + bunchCrossingOffsets[i]; }
+		size_t getBunchCrossingSize(size_t i) const { return bunchCrossingOffsets[i+1] - bunchCrossingOffsets[i]; }
+
+		/// Copy event i
+		void getEvent(size_t i, event_t& event) const
+		{
+			event.eventNumber = eventNumbers[i];
+			event.data.assign(getData(i), getData(i) + getDataSize(i));
+			event.bunchCrossing.assign(getBunchCrossing(i), getBunchCrossing(i) + getBunchCrossingSize(i));
+		}
+	};
+
 	/** \brief Abstract data reader, the work horse
 	 *
 	 * An implementation of this class is used by the iterators to read data. When incrementing the
@@ -59,6 +166,69 @@ public:
 		/** \brief Create a new reader instance pointing to the same point in the datastream.
 		 */
 		virtual reader* clone() const = 0;
+		/** \brief Append the current event and up to maxEvents-1 following events to batch, then read the next
+		 * event
+		 *
+		 * The default implementation copies the events read by next(). Readers override this to decode
+		 * directly into the batch.
+		 * \return true if the end of the data was reached, like next()
+		 */
+		virtual bool nextBatch(batch_t& batch, size_t maxEvents)
+		{
+			for(size_t i = 0; i < maxEvents; ++i) {
+				batch.push_back(_currentEvent);
+				if(advance()) {
+					return true;
+				}
+			}
+			return false;
+		}
+		/** \brief Read the next event accepted by the event filter
+		 *
+		 * \return true if the end of the data (or of the filter's event range) was reached, like next()
+		 */
+		bool advance()
+		{
+			if(next()) {
+				return true;
+			}
+			return skipRejected();
+		}
+		/** \brief Skip events rejected by the event filter, starting with the current one
+		 *
+		 * \return true if the end of the data (or of the filter's event range) was reached
+		 */
+		bool skipRejected()
+		{
+			if(!_filter) {
+				return false;
+			}
+			while(!accepts(_currentEvent)) {
+				if(_filter->isPastRange(_currentEvent.eventNumber) || next()) {
+					return true;
+				}
+			}
+			return false;
+		}
+		/** \brief Jump to an event and read it
+		 *
+		 * Only supported by readers with an EventIndex, the default implementation throws.
+		 * \param eventIndex Index of the event in the file
+		 * \return false if there is no such event
+		 * \throw std::logic_error The reader cannot seek
+		 */
+		virtual bool seek(size_t eventIndex)
+		{
+			throw std::logic_error(_filename + ": Reader does not support seeking");
+		}
+		/** \brief Read the event with index eventIndex, see seek()
+		 *
+		 * \return false if there is no such event or it is rejected by the event filter
+		 */
+		bool readAt(size_t eventIndex)
+		{
+			return seek(eventIndex) && (!_filter || accepts(_currentEvent));
+		}
 		/** \brief Get current event number
 		 *
 		 */
@@ -71,10 +241,38 @@ public:
 		const event_t& get() const { return _currentEvent; }
 		const std::string& getFilename() const { return _filename; }
 
+		/// Events rejected by filter are skipped by advance(), nullptr to read all events
+		void setFilter(std::shared_ptr<const EventFilter> filter) { _filter = filter; }
+		std::shared_ptr<const EventFilter> getFilter() const { return _filter; }
+
 	protected:
+		/** \brief The event is before the filter's event range
+		 *
+		 * Implementations of next() may skip such events without decoding them. Events after the range are
+		 * returned, so advance() can stop.
+		 */
+		bool isBeforeRange(int eventNumber) const
+		{
+			return _filter && eventNumber < _filter->firstEvent;
+		}
+
 		event_t _currentEvent;
 	private:
+		bool accepts(const event_t& event) const
+		{
+			if(!_filter->acceptsEventNumber(event.eventNumber)) {
+				return false;
+			}
+			if(!_filter->filtersHits()) {
+				return true;
+			}
+			const size_t numHits = event.data.size() -
+				std::count(event.data.begin(), event.data.end(), 0);
+			return _filter->acceptsHits(numHits);
+		}
+
 		std::string _filename;
+		std::shared_ptr<const EventFilter> _filter;
 	};
 
 	template<bool is_const_iterator>
@@ -83,17 +281,53 @@ public:
 		typedef typename std::conditional<is_const_iterator, const event_t&, event_t&>::type event_ref_t;
 		typedef typename std::conditional<is_const_iterator, const event_t*, event_t*>::type event_ptr_t;
 
-		const_noconst_iterator(reader* read, bool end) :
-		 _reader(read), _end(end)
+		/** \param read Reader pointing to the first event
+		 * \param end Beyond-last-element iterator
+		 * \param remaining Number of further events to read before the iterator becomes an end iterator
+		 * \param collector Records the events of a full pass, nullptr if not recorded
+		 */
+		const_noconst_iterator(reader* read, bool end, size_t remaining=std::numeric_limits<size_t>::max(),
+		                       std::shared_ptr<RunCatalog::Collector> collector=nullptr) :
+		 _reader(read), _end(end), _remaining(remaining), _collector(collector)
 		{
 		}
 
-		const_noconst_iterator(const const_noconst_iterator<false>& other) :
-		 _reader(nullptr), _end(other._end)
+		/** \brief Copy an iterator
+		 *
+		 * The copy gets its own reader (see reader::clone()), which usually reopens the data file. Prefer
+		 * moving iterators. Only the original records its pass in the RunCatalog.
+		 */
+		const_noconst_iterator(const const_noconst_iterator& other) :
+		 _reader(cloneReader(other._reader)), _empty(other._empty), _end(other._end),
+		 _remaining(other._remaining)
 		{
-			if(other._reader) {
-				_reader = other._reader->clone();
-			}
+		}
+
+		/// Take over the reader of other, which becomes an end iterator
+		const_noconst_iterator(const_noconst_iterator&& other) noexcept :
+		 _reader(other._reader), _empty(std::move(other._empty)), _end(other._end), _remaining(other._remaining),
+		 _collector(std::move(other._collector))
+		{
+			other._reader = nullptr;
+			other._end = true;
+		}
+
+		/// Convert an iterator into a const_iterator, copying its reader
+		template<bool other_const, typename std::enable_if<is_const_iterator && !other_const, int>::type = 0>
+		const_noconst_iterator(const const_noconst_iterator<other_const>& other) :
+		 _reader(cloneReader(other._reader)), _empty(other._empty), _end(other._end),
+		 _remaining(other._remaining)
+		{
+		}
+
+		/// Convert an iterator into a const_iterator, taking over its reader
+		template<bool other_const, typename std::enable_if<is_const_iterator && !other_const, int>::type = 0>
+		const_noconst_iterator(const_noconst_iterator<other_const>&& other) noexcept :
+		 _reader(other._reader), _empty(std::move(other._empty)), _end(other._end), _remaining(other._remaining),
+		 _collector(std::move(other._collector))
+		{
+			other._reader = nullptr;
+			other._end = true;
 		}
 
 		~const_noconst_iterator()
@@ -103,12 +337,14 @@ public:
 			}
 		}
 
-		const_noconst_iterator& operator=(const const_noconst_iterator& other)
+		/// Copy (reopens the data file) or move assignment, depending on the argument
+		const_noconst_iterator& operator=(const_noconst_iterator other) noexcept
 		{
-			if(_reader)
-				delete _reader;
-			_reader = other._reader->clone();
-			_end = other._end;
+			std::swap(_reader, other._reader);
+			std::swap(_empty, other._empty);
+			std::swap(_end, other._end);
+			std::swap(_remaining, other._remaining);
+			std::swap(_collector, other._collector);
 			return *this;
 		}
 
@@ -119,6 +355,10 @@ public:
 			if(_end) {
 				return true;
 			}
+			// detached iterators returned by operator++(int)
+			if(!_reader || !other._reader) {
+				return current().eventNumber == other.current().eventNumber;
+			}
 			return (_reader->eventNumber() == other._reader->eventNumber()) || 
 			       (_reader->getFilename() == other._reader->getFilename());
 		}
@@ -143,15 +383,99 @@ public:
 
 		const_noconst_iterator& operator++()
 		{
-			if(_reader && !_end) {
-				_end = _reader->next();
+			if(!_end) {
+				if(!_reader || _remaining == 0) {
+					_end = true;
+				} else {
+					if(_remaining != std::numeric_limits<size_t>::max()) {
+						--_remaining;
+					}
+					if(_collector) {
+						const event_t& event = _reader->get();
+						_collector->addEvent(event.eventNumber, event.data.data(), event.data.size());
+					}
+					_end = _reader->advance();
+					finishCollector();
+				}
 			}
 			return *this;
 		}
 
+		/** \brief Read a block of events, starting with the current one
+		 *
+		 * The batch is cleared and filled with up to maxEvents events, the iterator is advanced past them.
+		 * Event ranges (setEventRange()) are respected.
+		 * \return Number of events read, 0 at the end
+		 *
+		 * \code{.cpp}
+auto it = read.begin();
+BaseSensorStreamReader::batch_t batch;
+while(it.readBatch(batch, 4096)) {
+	for(size_t i = 0; i < batch.size(); ++i) {
+	//	batch.getData(i)
+	}
+}
+\endcode
+		 */
+		size_t readBatch(batch_t& batch, size_t maxEvents)
+		{
+			batch.clear();
+			if(!_reader || _end || maxEvents == 0) {
+				return 0;
+			}
+			const bool limited = _remaining != std::numeric_limits<size_t>::max();
+			if(limited) {
+				maxEvents = std::min(maxEvents, _remaining + 1);
+			}
+			_end = _reader->nextBatch(batch, maxEvents);
+			if(limited) {
+				// the current event is not counted in _remaining
+				if(batch.size() > _remaining) {
+					_end = true;
+					_remaining = 0;
+				} else {
+					_remaining -= batch.size();
+				}
+			}
+			if(_collector) {
+				for(size_t i = 0; i < batch.size(); ++i) {
+					_collector->addEvent(batch.eventNumbers[i], batch.getData(i), batch.getDataSize(i));
+				}
+				finishCollector();
+			}
+			return batch.size();
+		}
+
+		/** \brief Jump to an event
+		 *
+		 * Requires a reader with EventIndex (see setUseIndex()), used for sampling events. Event ranges are
+		 * not respected.
+		 * \param eventIndex Index of the event in the file
+		 * \return false if the event does not exist or is rejected by the event filter, the iterator is an
+		 * end iterator until the next successful seek() in that case
+		 * \throw std::logic_error The reader type does not support seeking
+		 */
+		bool seek(size_t eventIndex)
+		{
+			if(!_reader) {
+				return false;
+			}
+			_remaining = std::numeric_limits<size_t>::max();
+			// not a pass over the whole file any more
+			_collector.reset();
+			_end = !_reader->readAt(eventIndex);
+			return !_end;
+		}
+
+		/** \brief Post-increment
+		 *
+		 * Returns a detached iterator, which only holds a copy of the current event and becomes an end
+		 * iterator when incremented, so the reader is not copied.
+		 */
 		const_noconst_iterator operator++(int)
 		{
-			const const_noconst_iterator old(*this);
+			const_noconst_iterator old(nullptr, _end, 0);
+			old._empty = current();
 			++(*this);
 			return old;
 		}
@@ -159,32 +483,126 @@ public:
 		friend class const_noconst_iterator<true>;
 
 	private:
+		static reader* cloneReader(const reader* read)
+		{
+			if(!read) {
+				return nullptr;
+			}
+			reader* copy = read->clone();
+			copy->setFilter(read->getFilter());
+			return copy;
+		}
+
+		const event_t& current() const
+		{
+			return _reader ? _reader->get() : _empty;
+		}
+
+		/// Record the pass in the catalog once the end is reached
+		void finishCollector()
+		{
+			if(_end && _collector) {
+				_collector->finish();
+				_collector.reset();
+			}
+		}
+
 		reader* _reader;
 		event_t _empty;
 		bool _end;
+		size_t _remaining;
+		std::shared_ptr<RunCatalog::Collector> _collector;
 	};
 
 	typedef const_noconst_iterator<false> iterator;
 	typedef const_noconst_iterator<true> const_iterator;
 	
-	BaseSensorStreamReader() : _filename("") {}
-	BaseSensorStreamReader(const std::string& filename) : _filename(filename) {}
+	BaseSensorStreamReader() : _filename(""), _useIndex(false), _firstEvent(0), _numEvents(npos), _filter() {}
+	BaseSensorStreamReader(const std::string& filename)
+	 : _filename(filename), _useIndex(false), _firstEvent(0), _numEvents(npos), _filter() {}
 	virtual ~BaseSensorStreamReader() {}
 
+	/// Read all events in setEventRange()
+	static const size_t npos = std::numeric_limits<size_t>::max();
+
 	void setFilename(const std::string& filename)
 	{
 		_filename = filename;
+		_index.reset();
 	}
 
 	std::string getFilename() const { return _filename; }
 
+	/** \brief Enable the sidecar event index
+	 *
+	 * If enabled and supported by the reader type, the EventIndex of the data file is loaded (or built on
+	 * first use) by begin() and used for seeking and copying iterators.
+	 */
+	virtual void setUseIndex(bool useIndex) { _useIndex = useIndex; }
+	bool getUseIndex() const { return _useIndex; }
+
+	/** \brief Restrict iteration to a range of events
+	 *
+	 * \param firstEvent Index of the first event (counted from the beginning of the file)
+	 * \param numEvents Maximum number of events, npos for all remaining events
+	 */
+	void setEventRange(size_t firstEvent, size_t numEvents=npos)
+	{
+		_firstEvent = firstEvent;
+		_numEvents = numEvents;
+	}
+
+	/** \brief Only iterate over the events accepted by filter
+	 *
+	 * Applies to the event number and hit cuts. The first event of setEventRange() is an index into the
+	 * file, the number of events counts accepted events only.
+	 */
+	virtual void setEventFilter(const EventFilter& filter)
+	{
+		_filter = filter.empty() ? nullptr : std::make_shared<EventFilter>(filter);
+	}
+
+	/** \brief Record the statistics of the data file in catalog
+	 *
+	 * Iterators of begin() which start at the first event without event range or filter record the events
+	 * they pass, the statistics are stored when the end of the file is reached. nullptr disables recording.
+	 */
+	virtual void setCatalog(std::shared_ptr<RunCatalog> catalog) { _catalog = catalog; }
+
+	/** \brief Get the event index of the data file
+	 *
+	 * The index is loaded or built on the first call, independent of setUseIndex().
+	 * \return nullptr if the reader type does not support an index
+	 */
+	std::shared_ptr<const EventIndex> getIndex() const
+	{
+		if(!_index) {
+			_index = buildIndex(_filename);
+		}
+		return _index;
+	}
+
+	/** \brief Check that the data file can be read
+	 *
+	 * Opens the file without reading any event. The default implementation only checks that the file can be
+	 * opened.
+	 * \throw std::ios_base::failure The file cannot be opened or is invalid
+	 */
+	virtual void probe() const
+	{
+		std::ifstream fin(_filename);
+		if(!fin.is_open()) {
+			throw std::ios_base::failure(_filename + ": Cannot open file");
+		}
+	}
+
 	/** \brief Create new iterator pointing to the first event
 	 *
 	 * \sa getReader
 	 */
 	iterator begin()
 	{
-		return iterator(getReader(_filename), false);
+		return makeBegin<iterator>();
 	}
 
 	/** \brief Create new iterator pointing to the first event
@@ -193,7 +611,7 @@ public:
 	 */
 	const_iterator begin() const
 	{
-		return const_iterator(getReader(_filename), false);
+		return makeBegin<const_iterator>();
 	}
 
 	/** \brief Create new beyond-last-element iterator
@@ -218,8 +636,72 @@ protected:
 	 */
 	virtual reader* getReader(const std::string& filename) const = 0;
 
+	/** \brief Create sub-type specific reader instance pointing to the event firstEvent
+	 *
+	 * The default implementation reads and discards all events before firstEvent.
+	 * \param filename Data file
+	 * \param index Event index if enabled, nullptr otherwise
+	 * \param firstEvent Index of the first event to read
+	 * \return nullptr if the file contains less events
+	 */
+	virtual reader* getReaderAt(const std::string& filename, std::shared_ptr<const EventIndex> index,
+	                            size_t firstEvent) const
+	{
+		reader* read = getReader(filename);
+		for(size_t i = 0; read && i < firstEvent; ++i) {
+			if(read->next()) {
+				delete read;
+				return nullptr;
+			}
+		}
+		return read;
+	}
+
+	/** \brief Build or load the event index of a data file
+	 *
+	 * \return nullptr if the reader type does not support an index (default)
+	 */
+	virtual std::shared_ptr<const EventIndex> buildIndex(const std::string& filename) const
+	{
+		return nullptr;
+	}
+
 private:
+	template<typename iterator_t>
+	iterator_t makeBegin() const
+	{
+		if(_numEvents == 0) {
+			return iterator_t(nullptr, true);
+		}
+		reader* read;
+		if(!_useIndex && _firstEvent == 0) {
+			read = getReader(_filename);
+		} else {
+			read = getReaderAt(_filename, _useIndex ? getIndex() : nullptr, _firstEvent);
+		}
+		bool end = read == nullptr;
+		if(read && _filter) {
+			read->setFilter(_filter);
+			end = read->skipRejected();
+		}
+		std::shared_ptr<RunCatalog::Collector> collector;
+		if(_catalog && _firstEvent == 0 && _numEvents == npos && !_filter) {
+			collector = std::make_shared<RunCatalog::Collector>(_catalog, _filename);
+			if(end) {
+				collector->finish();
+				collector.reset();
+			}
+		}
+		return iterator_t(read, end, _numEvents == npos ? npos : _numEvents - 1, collector);
+	}
+
 	std::string _filename;
+	bool _useIndex;
+	size_t _firstEvent;
+	size_t _numEvents;
+	std::shared_ptr<const EventFilter> _filter;
+	mutable std::shared_ptr<const EventIndex> _index;
+	std::shared_ptr<RunCatalog> _catalog;
 };
 
 
@@ -32,10 +32,15 @@ protected:
 		cbcreader(const std::string& filename, size_t eventNum=0);
 		virtual ~cbcreader();
 		virtual bool next();
+		virtual bool nextBatch(batch_t& batch, size_t maxEvents);
 		virtual BaseSensorStreamReader::reader* clone() const;
 
 	private:
                 void open();
+		/// Load the next good tree entry, returns true at the end of the tree
+		bool readEntry();
+		/// Append the hit channels of the loaded entry, det1 channels are shifted by 254
+		void appendChannels(std::vector<int>& data) const;
                 TFile _fin;
                 TTree* _analysisTree;
                 tbeam::dutEvent* _dutEvent;
@@ -0,0 +1,159 @@
+#ifndef CHUNK_PIPELINE_H
+#define CHUNK_PIPELINE_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <utility>
+
+namespace core {
+
+/** \brief Process chunks on several threads and consume the results in chunk order
+ *
+ * Worker threads call the work function for chunk 0, 1, ... in parallel. The results are handed out in
+ * chunk order by next(). A ring of two slots per thread bounds the number of results in memory, workers
+ * wait for a free slot when they are too far ahead of the consumer. Results are swapped out of the slots,
+ * so containers handed back by the consumer are reused.
+ *
+ * Exceptions thrown by the work function are rethrown by next() once the failed chunk is due.
+ */
+template<typename T>
+class ChunkPipeline
+{
+public:
+	/// Fill result with the result of chunk i, called on the worker threads
+	typedef std::function<void(size_t i, T& result)> work_t;
+
+	/** \brief Start the workers
+	 *
+	 * \param numChunks Number of chunks
+	 * \param numThreads Number of worker threads, 0 for the number of cores
+	 * \param work Work function, must be thread-safe
+	 */
+	ChunkPipeline(size_t numChunks, size_t numThreads, work_t work) :
+	 _numChunks(numChunks), _work(work), _nextChunk(0), _numDelivered(0), _stop(false)
+	{
+		if(numThreads == 0) {
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		numThreads = std::min(numThreads, std::max<size_t>(1, numChunks));
+		_slots.resize(2*numThreads);
+		for(size_t i = 0; i < numThreads; ++i) {
+			_threads.emplace_back(&ChunkPipeline::run, this);
+		}
+	}
+
+	ChunkPipeline(const ChunkPipeline&) = delete;
+	ChunkPipeline& operator=(const ChunkPipeline&) = delete;
+
+	~ChunkPipeline()
+	{
+		stop();
+	}
+
+	/** \brief Get the result of the next chunk
+	 *
+	 * Blocks until the chunk has been processed. The result is swapped with the slot.
+	 * \return false after the last chunk
+	 */
+	bool next(T& result)
+	{
+		if(_numDelivered >= _numChunks) {
+			return false;
+		}
+		slot_t& slot = _slots[_numDelivered % _slots.size()];
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_ready.wait(lock, [&]() { return slot.ready; });
+		}
+		if(slot.error) {
+			std::exception_ptr error = slot.error;
+			stop();
+			std::rethrow_exception(error);
+		}
+		std::swap(result, slot.result);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			slot.ready = false;
+			++_numDelivered;
+		}
+		_free.notify_all();
+		return true;
+	}
+
+	/// Index of the chunk returned by the next call of next()
+	size_t getNextChunk() const { return _numDelivered; }
+
+private:
+	struct slot_t {
+		slot_t() : result(), ready(false) {}
+		T result;
+		bool ready;
+		std::exception_ptr error;
+	};
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_free.notify_all();
+		for(auto& thread: _threads) {
+			if(thread.joinable()) {
+				thread.join();
+			}
+		}
+	}
+
+	void run()
+	{
+		for(;;) {
+			size_t i;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				if(_stop || _nextChunk >= _numChunks) {
+					return;
+				}
+				i = _nextChunk++;
+				// the slot is still used by chunk i - size until it has been delivered
+				_free.wait(lock, [&]() { return _stop || i < _numDelivered + _slots.size(); });
+				if(_stop) {
+					return;
+				}
+			}
+			// the slot belongs to this thread until it is marked ready
+			slot_t& slot = _slots[i % _slots.size()];
+			try {
+				slot.error = nullptr;
+				_work(i, slot.result);
+			} catch(...) {
+				slot.error = std::current_exception();
+			}
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				slot.ready = true;
+			}
+			_ready.notify_all();
+		}
+	}
+
+	size_t _numChunks;
+	work_t _work;
+	std::vector<slot_t> _slots;
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;
+	std::condition_variable _free;
+	std::condition_variable _ready;
+	size_t _nextChunk;
+	size_t _numDelivered;
+	bool _stop;
+};
+
+} // namespace core
+
+#endif//CHUNK_PIPELINE_H
@@ -0,0 +1,72 @@
+#ifndef DATA_OFFSET_MAP_H
+#define DATA_OFFSET_MAP_H
+
+#include <string>
+#include <vector>
+
+namespace core {
+
+/** \brief Piecewise constant data offset of a run
+ *
+ * Maps MPA event numbers to the offset of the telescope data (track event number = MPA event number +
+ * offset, see TrackAnalysis::setDataOffset). Runs that lose synchronisation partway through have several
+ * segments, each starting at an MPA event and valid until the next segment. Events before the first segment
+ * use the offset from the runlist.
+ *
+ * The text file format has one segment per line, the first MPA event and the offset separated by
+ * whitespace. Empty lines and lines starting with # are ignored.
+ * \code
+# first_event offset
+0	0
+18237	2
+\endcode
+ *
+ * \sa DesyncDetector
+ */
+class DataOffsetMap
+{
+public:
+	struct segment_t {
+		/// First MPA event number of the segment
+		int firstEvent;
+		/// Data offset
+		int offset;
+	};
+
+	/** \brief Append a segment
+	 *
+	 * Segments continuing the offset of the previous segment are merged into it.
+	 * \throw std::invalid_argument firstEvent does not follow the start of the previous segment
+	 */
+	void add(int firstEvent, int offset);
+
+	/** \brief Get the offset of an MPA event
+	 *
+	 * \param eventNumber MPA event number
+	 * \param defaultOffset Offset for events before the first segment
+	 */
+	int getOffset(int eventNumber, int defaultOffset) const;
+
+	const std::vector<segment_t>& getSegments() const { return _segments; }
+	bool empty() const { return _segments.empty(); }
+	void clear() { _segments.clear(); }
+
+	/** \brief Load segments from a text file, replacing the current ones
+	 *
+	 * \throw std::ios_base::failure The file cannot be opened or contains an invalid line
+	 */
+	void read(const std::string& filename);
+
+	/** \brief Write the segments to a text file
+	 *
+	 * \throw std::ios_base::failure The file cannot be written
+	 */
+	void write(const std::string& filename) const;
+
+private:
+	std::vector<segment_t> _segments;
+};
+
+} // namespace core
+
+#endif//DATA_OFFSET_MAP_H
@@ -113,6 +113,8 @@ public:
 
 namespace core {
 
+class RunSnapshot;
+
 struct mpa_data_t
 {
 	std::string name;
@@ -128,6 +130,8 @@ struct run_data_t
 	TelescopeData** telescopeData;
 	TelescopeHits** telescopeHits;
 	std::vector<mpa_data_t> mpaData;
+	/// Events in memory, read by getEntry() instead of the tree if set
+	const RunSnapshot* snapshot;
 };
 
 }
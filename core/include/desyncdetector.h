@@ -0,0 +1,123 @@
+#ifndef DESYNC_DETECTOR_H
+#define DESYNC_DETECTOR_H
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include "dataoffsetmap.h"
+
+namespace core {
+
+/** \brief Online detection of the data offset and its jumps within a run
+ *
+ * Fed with the hit positions of every MPA event and the track positions of the telescope event with the
+ * same number, the detector correlates each MPA event with the track events of all offsets in -range to
+ * range. For every offset, the residuals (track - hit) of the last window events are histogrammed. The
+ * correct offset shows a peak at the (unknown) misalignment, wrong offsets a flat distribution.
+ *
+ * The offset with the most significant peak is taken as soon as the significance exceeds a threshold. When
+ * another offset becomes twice as significant as the current one, the data lost synchronisation. The event
+ * where the offset changed is located by the peak hits of both offsets in the window and a new segment is
+ * added to the DataOffsetMap.
+ *
+ * Everything is done in a single pass over the data, memory is bounded by the window size.
+ *
+ * \code{.cpp}
+DesyncDetector detector(10);
+for(...) {
+	detector.addEvent(pixelEvent.eventNumber, hitX, trackX);
+}
+detector.finish();
+detector.getOffsetMap().write("run0028_offsets.txt");
+\endcode
+ */
+class DesyncDetector
+{
+public:
+	/** \param range Offsets from -range to range are considered
+	 * \param window Number of events in the rolling window
+	 * \param residualRange Residuals outside of -residualRange to residualRange are ignored
+	 * \param binWidth Bin width of the residual histograms
+	 * \param minSignificance Minimum peak significance (in standard deviations of the background)
+	 */
+	DesyncDetector(int range, size_t window=2000, double residualRange=10., double binWidth=0.1,
+	               double minSignificance=8.);
+
+	/** \brief Add the next event
+	 *
+	 * Events are expected in increasing, consecutive event number order.
+	 * \param eventNumber MPA event number
+	 * \param pixelX Positions of the hit pixels
+	 * \param trackX Positions of the tracks of the telescope event with the same number
+	 */
+	void addEvent(int eventNumber, const std::vector<double>& pixelX, const std::vector<double>& trackX);
+
+	/// Process the events still waiting for their correlation partners, call at the end of a run
+	void finish();
+
+	/// Start a new run, clears the offset map
+	void reset();
+
+	const DataOffsetMap& getOffsetMap() const { return _map; }
+
+	/// A significant offset was found
+	bool isSynchronised() const { return _synchronised; }
+	/// Current offset, only valid if isSynchronised()
+	int getOffset() const { return _offset; }
+
+	/** \brief Significance of the residual peak of an offset in the current window
+	 *
+	 * \param offset Offset in -range to range
+	 * \param peakBin If not null, set to the center bin of the peak
+	 */
+	double getSignificance(int offset, size_t* peakBin=nullptr) const;
+
+private:
+	/// Event still waiting for tracks of later events
+	struct pending_t {
+		int eventNumber;
+		std::vector<double> pixels;
+		std::vector<double> tracks;
+		/// Histogram entries, offset index * numBins + bin
+		std::vector<uint32_t> entries;
+	};
+	/// Event in the rolling window
+	struct final_t {
+		int eventNumber;
+		std::vector<uint32_t> entries;
+	};
+
+	void addPairs(const std::vector<double>& tracks, const std::vector<double>& pixels, int offset,
+	              std::vector<uint32_t>& entries) const;
+	void finalize(pending_t& event);
+	void decide();
+	/// Index of the first event in the window with the new offset
+	size_t findChangePoint(int oldOffset, size_t oldPeak, int newOffset, size_t newPeak) const;
+	/// Number of entries of an event within one bin of the peak
+	size_t countPeakEntries(const final_t& event, int offset, size_t peakBin) const;
+
+	int _range;
+	size_t _window;
+	double _residualRange;
+	double _binWidth;
+	double _minSignificance;
+	size_t _numBins;
+	size_t _decisionInterval;
+
+	std::deque<pending_t> _pending;
+	std::deque<final_t> _final;
+	/// Residual histograms of all offsets over the window
+	std::vector<uint32_t> _hist;
+	/// Number of entries of each histogram
+	std::vector<size_t> _total;
+	size_t _sinceDecision;
+	bool _haveFirstEvent;
+	int _firstEvent;
+	bool _synchronised;
+	int _offset;
+	DataOffsetMap _map;
+};
+
+} // namespace core
+
+#endif//DESYNC_DETECTOR_H
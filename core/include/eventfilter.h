@@ -0,0 +1,70 @@
+#ifndef EVENT_FILTER_H
+#define EVENT_FILTER_H
+
+#include <cstddef>
+#include <limits>
+
+namespace core {
+
+/** \brief Event selection evaluated by the readers
+ *
+ * Cuts on the event number, the number of hit channels of sensor events and the number of tracks of
+ * telescope events. The readers reject events as early as possible, e.g. MPAStreamReader does not parse
+ * counter lines outside of the event range and TrackStreamReader does not convert the coordinates of such
+ * events. Event numbers are expected to be increasing, readers stop at the first event after the range.
+ *
+ * \code{.cpp}
+EventFilter filter;
+filter.minTracks = filter.maxTracks = 1;
+filter.maxHits = 1;
+reader.setEventFilter(filter);
+\endcode
+ *
+ * \sa TrackAnalysis::setEventFilter
+ */
+struct EventFilter
+{
+	EventFilter()
+	 : minHits(0), maxHits(npos), minTracks(0), maxTracks(npos),
+	   firstEvent(std::numeric_limits<int>::min()), lastEvent(std::numeric_limits<int>::max())
+	{
+	}
+
+	/// No upper limit
+	static const size_t npos = std::numeric_limits<size_t>::max();
+
+	/// Minimum number of non-zero channels of sensor events
+	size_t minHits;
+	/// Maximum number of non-zero channels of sensor events
+	size_t maxHits;
+	/// Minimum number of tracks of telescope events
+	size_t minTracks;
+	/// Maximum number of tracks of telescope events
+	size_t maxTracks;
+	/// First accepted event number
+	int firstEvent;
+	/// Last accepted event number
+	int lastEvent;
+
+	bool acceptsEventNumber(int eventNumber) const
+	{
+		return eventNumber >= firstEvent && eventNumber <= lastEvent;
+	}
+	/// No further events can be accepted
+	bool isPastRange(int eventNumber) const { return eventNumber > lastEvent; }
+	bool acceptsHits(size_t numHits) const { return numHits >= minHits && numHits <= maxHits; }
+	bool acceptsTracks(size_t numTracks) const { return numTracks >= minTracks && numTracks <= maxTracks; }
+
+	bool filtersEventNumber() const
+	{
+		return firstEvent != std::numeric_limits<int>::min() || lastEvent != std::numeric_limits<int>::max();
+	}
+	bool filtersHits() const { return minHits > 0 || maxHits != npos; }
+	bool filtersTracks() const { return minTracks > 0 || maxTracks != npos; }
+	/// All events are accepted
+	bool empty() const { return !filtersEventNumber() && !filtersHits() && !filtersTracks(); }
+};
+
+} // namespace core
+
+#endif//EVENT_FILTER_H
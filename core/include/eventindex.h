@@ -0,0 +1,111 @@
+#ifndef EVENT_INDEX_H
+#define EVENT_INDEX_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+namespace core {
+
+/** \brief Byte offsets of all events in a text data file
+ *
+ * Text data files can only be read sequentially. An EventIndex stores the position of every event, so
+ * readers can jump to any event, copy iterators without asking the original stream for its position and
+ * split a run into event ranges.
+ *
+ * The index is kept in a sidecar file next to the data file (see getIndexFilename()). It is built by a
+ * format-specific scan of the (memory mapped or decompressed) data file the first time it is requested, and rebuilt whenever
+ * size or modification time of the data file do not match the values recorded in the sidecar.
+ *
+ * \sa BaseSensorStreamReader::setUseIndex, TrackStreamReader::setUseIndex
+ */
+class EventIndex
+{
+public:
+	/** \brief Format-specific index builder
+	 *
+	 * Called with the (uncompressed) content of the data file and an empty index, has to add() all events
+	 * in file order.
+	 */
+	typedef std::function<void(const char* data, size_t size, EventIndex&)> builder_t;
+
+	EventIndex() : _fileSize(0), _mtimeSec(0), _mtimeNsec(0) {}
+
+	/** \brief Append an event
+	 *
+	 * \param offset Byte offset of the first line of the event
+	 * \param linesBefore Number of lines in the file before offset
+	 * \param eventNumber Event number as stored in the file
+	 */
+	void add(uint64_t offset, uint64_t linesBefore, int eventNumber)
+	{
+		_offsets.push_back(offset);
+		_linesBefore.push_back(linesBefore);
+		_eventNumbers.push_back(eventNumber);
+	}
+
+	/** \brief Number of events in the data file */
+	size_t size() const noexcept { return _offsets.size(); }
+	uint64_t getOffset(size_t i) const { return _offsets.at(i); }
+	uint64_t getLinesBefore(size_t i) const { return _linesBefore.at(i); }
+	int getEventNumber(size_t i) const { return _eventNumbers.at(i); }
+
+	/** \brief Find the first event with an event number not less than eventNumber
+	 *
+	 * Event numbers are expected to be non-decreasing in the file.
+	 * \return Index of the event, size() if there is no such event
+	 */
+	size_t find(int eventNumber) const;
+
+	/** \brief Split the events into numParts consecutive ranges of (almost) equal size
+	 *
+	 * \return List of (first event, number of events) pairs
+	 */
+	std::vector<std::pair<size_t, size_t>> split(size_t numParts) const;
+
+	/** \brief Load the sidecar index of a data file
+	 *
+	 * \return false if there is no sidecar file or it does not match the data file
+	 */
+	bool load(const std::string& dataFilename);
+
+	/** \brief Write the sidecar index of a data file
+	 *
+	 * Size and modification time of the data file are recorded for later validation.
+	 * \throw std::ios_base::failure The sidecar cannot be written
+	 */
+	void save(const std::string& dataFilename);
+
+	/** \brief Load a valid sidecar index or build (and save) a new one
+	 *
+	 * Failing to write the sidecar (e.g. read-only data directory) is not an error, the index is just
+	 * rebuilt the next time. Compressed data files (see InputStream) are decompressed into memory for the
+	 * scan, offsets refer to the uncompressed data.
+	 * \throw std::ios_base::failure The data file cannot be opened
+	 */
+	static std::shared_ptr<const EventIndex> get(const std::string& dataFilename, const builder_t& build);
+
+	/** \brief Index builder for files with one event per non-empty line
+	 *
+	 * Used for the MPA counter and memory files. Lines containing only a carriage return are considered
+	 * empty, the event number is the index of the event.
+	 */
+	static void buildLineIndex(const char* data, size_t size, EventIndex& index);
+
+	static std::string getIndexFilename(const std::string& dataFilename) { return dataFilename + ".idx"; }
+
+private:
+	std::vector<uint64_t> _offsets;
+	std::vector<uint64_t> _linesBefore;
+	std::vector<int> _eventNumbers;
+	uint64_t _fileSize;
+	int64_t _mtimeSec;
+	int64_t _mtimeNsec;
+};
+
+} // namespace core
+
+#endif//EVENT_INDEX_H
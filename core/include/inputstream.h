@@ -0,0 +1,62 @@
+#ifndef INPUT_STREAM_H
+#define INPUT_STREAM_H
+
+#include <istream>
+#include <memory>
+#include <string>
+
+namespace core {
+
+/** \brief Input file stream with transparent decompression
+ *
+ * Drop-in replacement for std::ifstream in the text data readers. The compression format is detected by
+ * the magic bytes at the beginning of the file, gzip (zlib) and xz (liblzma) are supported if the
+ * libraries were found at build time. Uncompressed files are read by a plain std::filebuf.
+ *
+ * Compressed files are decompressed block-wise on a helper thread, so decompression overlaps with
+ * parsing. Stream positions (tellg(), seekg()) refer to the uncompressed data. Seeking forward decompresses
+ * and discards the data in between, seeking backwards restarts decompression at the beginning of the file.
+ *
+ * Corrupt or truncated compressed data set the badbit, with exceptions(std::ios_base::badbit) the
+ * std::ios_base::failure of the decoder is thrown instead, so the data is not mistaken for a shorter file.
+ */
+class InputStream : public std::istream
+{
+public:
+	enum compression_t {
+		COMPRESSION_NONE,
+		COMPRESSION_GZIP,
+		COMPRESSION_XZ,
+		COMPRESSION_ZSTD
+	};
+
+	InputStream();
+	InputStream(const std::string& filename);
+	InputStream(InputStream&& other);
+	InputStream& operator=(InputStream&& other);
+	~InputStream();
+
+	/** \brief Open a file
+	 *
+	 * Sets the failbit if the file cannot be opened or its compression format is not supported.
+	 */
+	void open(const std::string& filename);
+	bool is_open() const;
+	void close();
+
+	compression_t getCompression() const { return _compression; }
+
+	/** \brief Detect the compression format of a file by its magic bytes
+	 *
+	 * \return COMPRESSION_NONE for uncompressed or unreadable files
+	 */
+	static compression_t detectCompression(const std::string& filename);
+
+private:
+	std::unique_ptr<std::streambuf> _buf;
+	compression_t _compression;
+};
+
+} // namespace core
+
+#endif//INPUT_STREAM_H
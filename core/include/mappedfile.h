@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+
+namespace core {
+
+/** \brief Read-only memory mapping of a whole file
+ *
+ * The file is mapped on construction and unmapped on destruction. Mappings are not copyable, share them
+ * via std::shared_ptr if several readers need access to the same file.
+ */
+class MappedFile
+{
+public:
+	/** \brief Map a file into memory
+	 *
+	 * \param filename Path of the file
+	 * \throw std::ios_base::failure The file cannot be opened or mapped
+	 */
+	MappedFile(const std::string& filename);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	/** \brief Begin of the mapped data, nullptr for empty files */
+	const char* data() const noexcept { return _data; }
+	/** \brief Size of the file in bytes */
+	size_t size() const noexcept { return _size; }
+	const std::string& getFilename() const noexcept { return _filename; }
+
+	/** \brief Hint the kernel that the file will be read sequentially */
+	void adviseSequential() const noexcept;
+
+private:
+	std::string _filename;
+	const char* _data;
+	size_t _size;
+};
+
+} // namespace core
+
+#endif//MAPPED_FILE_H
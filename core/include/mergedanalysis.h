@@ -8,10 +8,40 @@
 #include <TTree.h>
 #include <string>
 #include <vector>
+#include <memory>
 #include "runlistreader.h"
 
 namespace core {
 
+/** \brief Analysis of the merged telescope and MPA data trees
+ *
+ * The runs are opened one after another when they are processed, init(vm) only checks that their local files
+ * are readable. While run(const run_data_t&) works on a run, a background thread opens the next run and reads
+ * its first entry, which fills the TTreeCache, so the latency of opening files on network storage is hidden.
+ * At most two runs are open at a time. With ROOT 5, whose gDirectory is shared by all threads, the next run
+ * is only opened when it is due.
+ *
+ * Analyses declare the branches they read with setRequiredBranches() and setRequiredPlanes(), all other
+ * branches are disabled and not decompressed by GetEntry(). The enabled branches are read through a
+ * TTreeCache.
+ *
+ * Analyses whose runs are independent until finalize() can process several runs at once, see
+ * setParallelRuns(). Each worker thread opens its run with openRun(), fills a RunResult in processRun() and
+ * closes the run again, so at most run_threads files are open. The results are merged with mergeRun() on the
+ * main thread in the order of the runs, which keeps the output reproducible.
+ *
+ * If testbeam_data names a flat file (.flat, see RunSnapshot), the run is memory mapped instead of being
+ * read through ROOT, run_data_t::file and run_data_t::tree are nullptr and the events are loaded with
+ * getEntry(). Flat files contain no telescope clusters, so only analyses which declare their branches
+ * without "telescope" can read them.
+ *
+ * Configuration variables:
+ *  - tree_cache_size: TTreeCache size per tree in MB (default 64, 0 disables the cache)
+ *  - root_threads: Threads for the parallel decompression of baskets (ROOT::EnableImplicitMT(), requires
+ *    ROOT 6.08), 0 for all cores. Disabled if not set.
+ *  - run_threads: Number of runs processed at once by analyses supporting it (default 1), 0 for all cores.
+ *    Requires ROOT 6, older versions process the runs one after another.
+ */
 class MergedAnalysis : public Analysis
 {
 public:
@@ -24,12 +54,96 @@ public:
 	virtual void run(const po::variables_map& vm);
 	virtual void run(const run_data_t& run) = 0;
 
+	/** \brief Result of a run processed on a worker thread
+	 *
+	 * Sub-classed by the analyses, must not refer to objects of the run, which is closed before the result
+	 * is merged.
+	 */
+	class RunResult {
+	public:
+		virtual ~RunResult() {}
+	};
+
+	/** \brief Process a run on a worker thread
+	 *
+	 * Called instead of run(const run_data_t&) if setParallelRuns() is enabled. Must be thread-safe, e.g. not
+	 * modify members or the configuration. ROOT objects created here should be detached from gDirectory.
+	 * \throw std::logic_error Not implemented by the analysis (default)
+	 */
+	virtual std::unique_ptr<RunResult> processRun(const run_data_t& run);
+
+	/** \brief Merge the result of processRun() into the analysis
+	 *
+	 * Called on the main thread in the order of the runs, after init() and before finalize().
+	 */
+	virtual void mergeRun(int runId, RunResult& result);
+
 	virtual void finalize() = 0;
 
 	virtual bool multirunConsistencyCheck(const std::string& argv0, const po::variables_map& vm);
 
+	/** \brief Open the data tree of a ROOT file with all branches and without cache
+	 *
+	 * \throw std::runtime_error The file or the tree cannot be opened
+	 */
+	static run_data_t openDataTree(int runId, const std::string& filename);
+	/// Close a run opened by openRun() or openDataTree()
+	static void closeRun(run_data_t& data);
+
+protected:
+	/** \brief Only read some branches of the data tree
+	 *
+	 * All other branches ("telescope", "telhits", "mpa_1" to "mpa_6") are disabled. Their objects in
+	 * run_data_t stay empty, so the positions in run_data_t::mpaData do not change. Call before init(vm),
+	 * e.g. in the constructor.
+	 * \param branches Names of the top-level branches. Empty for all branches.
+	 */
+	void setRequiredBranches(const std::vector<std::string>& branches) { _requiredBranches = branches; }
+
+	/** \brief Only read some planes of the telescope hits
+	 *
+	 * The branches of all other planes of the telhits branch are disabled and stay empty. Call
+	 * before init(vm), e.g. in the constructor.
+	 * \param planes Names of the TelescopeHits members, e.g. "p1" or "ref". Empty for all planes.
+	 */
+	void setRequiredPlanes(const std::vector<std::string>& planes) { _requiredPlanes = planes; }
+
+	/** \brief Process runs on several threads with processRun() and mergeRun()
+	 *
+	 * The number of threads is set by run_threads. Call before init(vm), e.g. in the constructor.
+	 */
+	void setParallelRuns(bool parallel) { _parallelRuns = parallel; }
+
+	/** \brief Open the data tree or the flat file of a run
+	 *
+	 * Thread-safe, the configuration is not used.
+	 * \throw std::runtime_error The file or the tree cannot be opened
+	 */
+	run_data_t openRun(int runId, const std::string& filename) const;
+
 private:
-	std::vector<run_data_t> _runData;
+	/// Map a flat file
+	run_data_t openFlatRun(int runId, const std::string& filename) const;
+	/// Process the runs one after another, opening the next run in the background
+	void runSequential();
+	/// Process the runs with a pool of _numRunThreads workers
+	void runParallel();
+	/// Disable the branches not in _requiredBranches
+	void disableUnusedBranches(TTree* tree) const;
+	/// Disable the telhits branches of planes not in _requiredPlanes
+	void disableUnusedPlanes(TTree* tree) const;
+	/// Read the enabled branches through a TTreeCache of _treeCacheSize MB
+	void setupCache(TTree* tree) const;
+	/// Enable ROOT's implicit multi-threading if root_threads is set
+	void enableImplicitMT();
+
+	std::vector<std::string> _requiredBranches;
+	std::vector<std::string> _requiredPlanes;
+	bool _parallelRuns;
+	size_t _numRunThreads;
+	size_t _treeCacheSize;
+	/// Data file of each run in _allRunIds
+	std::vector<std::string> _runFilenames;
 	RunlistReader _runlist;
 };
 
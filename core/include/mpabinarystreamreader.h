@@ -0,0 +1,110 @@
+#ifndef MPA_BINARY_STREAM_READER_H
+#define MPA_BINARY_STREAM_READER_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "basesensorstreamreader.h"
+#include "mappedfile.h"
+
+namespace core {
+
+/** \brief Memory mapped access to binary MPA counter data files
+ *
+ * Re-parsing the text counter files (see MPAStreamReader) for every analysis is expensive, so they can be
+ * converted once into a packed binary format. The file starts with a file_header_t, followed by one
+ * record_t per event. A record has the same layout as PlainRippleCounter in datastructures.h: a 32 bit
+ * header (0 for converted text data) and 48 16 bit counter values. All values are stored in host byte order.
+ * The event number is the index of the record in the file, like for MPAStreamReader.
+ *
+ * The file is mapped into memory, reading an event merely copies the counters of one record into
+ * event_t::data. Records have a fixed size, so iterators seek to any event in constant time. getIndex()
+ * is computed from the header without reading the records or writing a sidecar file. Use write() or the
+ * mpa2bin utility to convert existing data files. To use binary files in an analysis, set
+ * \verbatim
+pixel_reader_type = MpaBinaryStreamReader
+mapsa_data = @mapsa_dir@/run@MpaRun@_counter.bin
+\endverbatim
+ *
+ * \code{.cpp}
+MpaBinaryStreamReader read("run0028_counter.bin");
+for(auto event: read) {
+//	event.data; is hopefully nice
+}
+\endcode
+ */
+class MpaBinaryStreamReader : public BaseSensorStreamReader
+{
+public:
+	/// Number of counters per event
+	static const size_t numPixels = 48;
+
+	/// File header
+	struct file_header_t {
+		/// Always "MPACNT\0\0"
+		char magic[8];
+		/// Format version, currently 1
+		uint32_t version;
+		/// Size of a single record in bytes
+		uint32_t recordSize;
+		/// Number of records following the header
+		uint64_t numEvents;
+	};
+
+	/// Event record, same layout as PlainRippleCounter
+	struct record_t {
+		uint32_t header;
+		uint16_t pixels[numPixels];
+	};
+
+	MpaBinaryStreamReader() : BaseSensorStreamReader() {}
+	MpaBinaryStreamReader(const std::string& filename) : BaseSensorStreamReader(filename) {}
+
+	/** \brief Convert the events of another reader into a binary counter file
+	 *
+	 * \param source Reader providing the events, e.g. a MPAStreamReader
+	 * \param filename Path of the binary file to write
+	 * \return Number of events written
+	 * \throw std::ios_base::failure The file cannot be written
+	 * \throw std::out_of_range An event does not contain 48 counters or a counter does not fit into
+	 * 16 bits
+	 */
+	static size_t write(const BaseSensorStreamReader& source, const std::string& filename);
+
+	/** \brief Check that the file is a valid binary counter file
+	 *
+	 * \throw std::ios_base::failure The file cannot be mapped or has an invalid header
+	 */
+	virtual void probe() const;
+
+protected:
+	class mpareader : public BaseSensorStreamReader::reader {
+	public:
+		/** \throw std::ios_base::failure The file cannot be mapped or is not a valid counter file */
+		mpareader(const std::string& filename);
+		mpareader(const mpareader& other) = default;
+		virtual bool next();
+		/// Constant time, no EventIndex required
+		virtual bool seek(size_t eventIndex);
+		virtual BaseSensorStreamReader::reader* clone() const;
+
+		uint64_t getNumEvents() const { return _numEvents; }
+
+	private:
+		std::shared_ptr<const MappedFile> _file;
+		const char* _records;
+		uint64_t _numEvents;
+		uint64_t _numEventsRead;
+	};
+
+	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
+	virtual BaseSensorStreamReader::reader* getReaderAt(const std::string& filename,
+		std::shared_ptr<const EventIndex> index, size_t firstEvent) const;
+	/// Offsets of the records, the event numbers are their indices
+	virtual std::shared_ptr<const EventIndex> buildIndex(const std::string& filename) const;
+};
+
+} // namespace core
+
+#endif//MPA_BINARY_STREAM_READER_H
@@ -3,14 +3,17 @@
 
 #include <vector>
 #include <string>
-#include <fstream>
+#include "inputstream.h"
+#include <cstdint>
 #include "basesensorstreamreader.h"
 
 namespace core {
 
 /** \brief Streamed access to MPA memory data files
  *
- * \todo Describe file format
+ * Each line holds one event, encoded as a Python list of 96 memory slots. Every slot is a quoted string of
+ * 72 binary digits: an 8 bit header of ones, the 16 bit bunch crossing id and the 48 bit pixel hit map. A
+ * pixel is considered hit if it is set in any of the memory slots of the event.
  *
  * The MpaMemoryStreamReader is compatible with range-based for loops, as it implements an C++11 iterator interface
  * via BaseSensorStreamReader::iterator .
@@ -28,6 +31,18 @@ public:
 	MpaMemoryStreamReader() : BaseSensorStreamReader() {}
 	MpaMemoryStreamReader(const std::string& filename) : BaseSensorStreamReader(filename) {}
 
+	/** \brief Decode all memory slots of a single line of a memory data file
+	 *
+	 * Each 64 bit wide binary field is converted into an integer at once (using SSE2 compares where
+	 * available). The pixel maps of all slots are combined by bitwise OR, the reversed read-out order
+	 * of pixels 16 to 31 is corrected by a precomputed bit permutation.
+	 * \param line Line to decode
+	 * \param length Number of characters in line
+	 * \param bunchCrossing The bunch crossing ids of all slots are appended to this container
+	 * \return Hit map, pixel i is hit if bit i is set
+	 */
+	static uint64_t decodeLine(const char* line, size_t length, std::vector<int>& bunchCrossing);
+
 protected:
 	/** \brief Iterator for traversing separate events in the MPA data file
 	 *
@@ -37,18 +52,34 @@ protected:
 	 */
 	class mpareader : public BaseSensorStreamReader::reader {
 	public:
+		/// Open the file at byte offset seek, the first event is read by next()
 		mpareader(const std::string& filename, size_t seek=0);
+		/** \brief Construct reader positioned before event firstEvent
+		 *
+		 * The file is opened lazily by the first call to next(), so copies are cheap.
+		 */
+		mpareader(const std::string& filename, std::shared_ptr<const EventIndex> index, size_t firstEvent);
 		virtual ~mpareader();
 		virtual bool next();
+		virtual bool nextBatch(batch_t& batch, size_t maxEvents);
+		/// Requires the EventIndex
+		virtual bool seek(size_t eventIndex);
 		virtual BaseSensorStreamReader::reader* clone() const;
 
 	private:
 		void open(size_t seek);
-		mutable std::ifstream _fin;
+		/// Read the next non-empty line into _line, returns false at the end of the file
+		bool readLine();
+		mutable InputStream _fin;
+		std::string _line;
 		size_t _numEventsRead;
+		std::shared_ptr<const EventIndex> _index;
 	};
 	
 	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
+	virtual BaseSensorStreamReader::reader* getReaderAt(const std::string& filename,
+		std::shared_ptr<const EventIndex> index, size_t firstEvent) const;
+	virtual std::shared_ptr<const EventIndex> buildIndex(const std::string& filename) const;
 };
 
 } // namespace core
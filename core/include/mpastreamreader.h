@@ -3,7 +3,7 @@
 
 #include <vector>
 #include <string>
-#include <fstream>
+#include "inputstream.h"
 #include "basesensorstreamreader.h"
 
 namespace core {
@@ -15,9 +15,13 @@ namespace core {
  * what it is). A regex matching the line would be \verbatim \[([0-9]+, )+\] \endverbatim
  *
  * The MPAStremReader is more tollerant, it just interprets every number in a line seperated by non-digit
- * characters as counter values.
+ * characters as counter values. The lines are parsed by a simple hand-written scanner (see
+ * parseCounterLine()), a single line buffer and the event_t::data container are reused for all events.
  * \todo Maybe a check for line format consistency would be useful for debugging and robustness.
  *
+ * With an EventIndex (one entry per non-empty line), the reader can start at any event and copies of
+ * iterators open the file lazily at the next event.
+ *
  * The MPAStreamReader is compatible with range-based for loops, as it implements an C++11 iterator interface
  * via BaseSensorStreamReader::iterator .
  *
@@ -34,6 +38,26 @@ public:
 	MPAStreamReader() : BaseSensorStreamReader() {}
 	MPAStreamReader(const std::string& filename) : BaseSensorStreamReader(filename) {}
 
+	/** \brief Extract all counter values from a single line of an MPA counter file
+	 *
+	 * Every sequence of digits is interpreted as one counter value, everything else is treated as
+	 * separator. The values are written in place into counters, which is only resized if the number of
+	 * counters differs from its current size.
+	 * \param line Null-terminated line to parse
+	 * \param counters Output container
+	 * \param offset Position of the first counter in the container, previous elements are kept (used to
+	 *        append to a batch_t)
+	 * \return Number of counters found in the line
+	 */
+	static size_t parseCounterLine(const char* line, std::vector<int>& counters, size_t offset=0);
+	/** \brief Extract all counter values from the characters line to end
+	 *
+	 * Like parseCounterLine(const char*, std::vector<int>&, size_t), for lines which are not
+	 * null-terminated, e.g. in a memory mapped file.
+	 */
+	static size_t parseCounterLine(const char* line, const char* end, std::vector<int>& counters,
+	                               size_t offset=0);
+
 protected:
 	/** \brief Iterator for traversing separate events in the MPA data file
 	 *
@@ -43,18 +67,34 @@ protected:
 	 */
 	class mpareader : public BaseSensorStreamReader::reader {
 	public:
+		/// Open the file at byte offset seek, the first event is read by next()
 		mpareader(const std::string& filename, size_t seek=0);
+		/** \brief Construct reader positioned before event firstEvent
+		 *
+		 * The file is opened lazily by the first call to next(), so copies are cheap.
+		 */
+		mpareader(const std::string& filename, std::shared_ptr<const EventIndex> index, size_t firstEvent);
 		virtual ~mpareader();
 		virtual bool next();
+		virtual bool nextBatch(batch_t& batch, size_t maxEvents);
+		/// Requires the EventIndex
+		virtual bool seek(size_t eventIndex);
 		virtual BaseSensorStreamReader::reader* clone() const;
 
 	private:
 		void open(size_t seek);
-		mutable std::ifstream _fin;
+		/// Read the next non-empty line into _line, returns false at the end of the file
+		bool readLine();
+		mutable InputStream _fin;
+		std::string _line;
 		size_t _numEventsRead;
+		std::shared_ptr<const EventIndex> _index;
 	};
 	
 	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
+	virtual BaseSensorStreamReader::reader* getReaderAt(const std::string& filename,
+		std::shared_ptr<const EventIndex> index, size_t firstEvent) const;
+	virtual std::shared_ptr<const EventIndex> buildIndex(const std::string& filename) const;
 };
 
 } // namespace core
@@ -0,0 +1,136 @@
+#ifndef MULTI_PART_SENSOR_STREAM_READER_H
+#define MULTI_PART_SENSOR_STREAM_READER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "basesensorstreamreader.h"
+
+namespace core {
+
+/** \brief Read a run split into several data files as one stream
+ *
+ * Long MPA runs are written as run0028_counter.txt_0, run0028_counter.txt_1 and so on. Given the name of the
+ * first part, all following parts with consecutive numbers are found (see findParts()) and read one after
+ * another by readers of the wrapped type, as if the files had been concatenated: the event numbers of a part
+ * are shifted by the number of events in the previous parts.
+ *
+ * With setUseIndex(), the EventIndex of each part is used to build an offset index of the file set (see
+ * getParts()). Iterators then start at any event and seek across parts. getIndex() returns the combined
+ * index of all parts, so code sizing or sampling a run by its index treats a split run like a single file. The parts are natural units for
+ * parallel processing, e.g. pass the event range of each part to setEventRange() of a separate reader.
+ *
+ * \code{.cpp}
+MultiPartSensorStreamReader read([]() { return make_unique<MPAStreamReader>(); }, "run0028_counter.txt_0");
+for(auto event: read) {
+//	event.data; is hopefully nice
+}
+\endcode
+ */
+class MultiPartSensorStreamReader : public BaseSensorStreamReader
+{
+public:
+	/** \param create Creates a reader for a part, e.g. Factory::create() of a reader type
+	 * \param filename First part of the file set
+	 */
+	MultiPartSensorStreamReader(Factory::creator_t create, const std::string& filename="")
+	 : BaseSensorStreamReader(filename), _create(create) {}
+
+	/// Entry of the offset index
+	struct part_t {
+		std::string filename;
+		/// Index of the first event of the part in the file set
+		size_t firstEvent;
+		size_t numEvents;
+	};
+
+	/** \brief Find the parts of a file set
+	 *
+	 * A file name ending in _N, optionally followed by an extension like .gz, is the first part of a set with
+	 * the files _N+1, _N+2, ... as long as they exist.
+	 * \return The file names, only filename itself if it is not numbered or has no following parts
+	 */
+	static std::vector<std::string> findParts(const std::string& filename);
+
+	/** \brief Get the offset index of the file set
+	 *
+	 * The event indices of all parts are loaded or built on the first call. Call it before iterating on
+	 * several threads.
+	 * \throw std::logic_error The reader type does not support an event index
+	 */
+	std::vector<part_t> getParts() const;
+
+	/// Checks that all parts can be read
+	virtual void probe() const;
+
+	/// Enables the index of the parts as well
+	virtual void setUseIndex(bool useIndex);
+
+	/// Each part is recorded in the catalog under its own file name
+	virtual void setCatalog(std::shared_ptr<RunCatalog> catalog);
+
+protected:
+	/// Readers of the parts
+	typedef std::vector<std::shared_ptr<BaseSensorStreamReader>> readers_t;
+
+	class partreader : public BaseSensorStreamReader::reader {
+	public:
+		/** \brief Reader pointing to the first event of the file set
+		 *
+		 * \param index Offset index for seeking, nullptr if not used
+		 */
+		partreader(const std::string& filename, std::shared_ptr<const readers_t> parts,
+		           std::shared_ptr<const std::vector<part_t>> index);
+		virtual bool next();
+		virtual bool nextBatch(batch_t& batch, size_t maxEvents);
+		virtual bool seek(size_t eventIndex);
+		virtual BaseSensorStreamReader::reader* clone() const;
+
+		/// The file set contains no events
+		bool isEnd() const { return _part >= _parts->size(); }
+
+	private:
+		/// Continue with the next part which contains events, returns false after the last part
+		bool nextPart();
+		/// Copy the current event of the part
+		void load();
+
+		std::shared_ptr<const readers_t> _parts;
+		std::shared_ptr<const std::vector<part_t>> _index;
+		size_t _part;
+		/// Number of events in the previous parts
+		size_t _offset;
+		/// Index of the current event in the part
+		size_t _position;
+		BaseSensorStreamReader::const_iterator _it;
+		batch_t _batch;
+	};
+
+	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
+	virtual BaseSensorStreamReader::reader* getReaderAt(const std::string& filename,
+		std::shared_ptr<const EventIndex> index, size_t firstEvent) const;
+
+	/** \brief Combined index of the parts
+	 *
+	 * Entry i is event i of the file set. Offsets and line numbers refer to the part containing the event,
+	 * event numbers are shifted by the number of events in the previous parts like those of the events.
+	 * \return nullptr if the reader type of the parts does not support an index
+	 */
+	virtual std::shared_ptr<const EventIndex> buildIndex(const std::string& filename) const;
+
+private:
+	/// Create the readers of the parts, again after setFilename()
+	std::shared_ptr<const readers_t> getPartReaders() const;
+
+	Factory::creator_t _create;
+	mutable std::shared_ptr<const readers_t> _parts;
+	mutable std::shared_ptr<const std::vector<part_t>> _index;
+	/// File of _parts
+	mutable std::string _partsFilename;
+	/// Catalog of the parts
+	std::shared_ptr<RunCatalog> _catalog;
+};
+
+} // namespace core
+
+#endif//MULTI_PART_SENSOR_STREAM_READER_H
@@ -0,0 +1,138 @@
+#ifndef CORE_NUMBER_PARSE_H
+#define CORE_NUMBER_PARSE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+
+namespace core {
+
+/** \brief Check for whitespace as matched by \\s in POSIX regular expressions */
+inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/** \brief Parse a decimal floating point number
+ *
+ * Fast replacement for std::strtod() for the plain decimal numbers found in the text data files. The
+ * mantissa is accumulated as integer and scaled by an exact power of ten. If this cannot be done without
+ * rounding errors (more than 19 significant digits, large exponents), the number is passed to
+ * std::strtod(), so the result is always identical to strtod().
+ *
+ * \param str Begin of the number, must be terminated by a non-numeric character (e.g. \\0)
+ * \param value Parsed value
+ * \return Pointer to the first character after the number or nullptr if no number could be parsed.
+ */
+inline const char* parseDouble(const char* str, double& value)
+{
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const char* p = str;
+	bool negative = false;
+	if(*p == '-' || *p == '+') {
+		negative = *p == '-';
+		++p;
+	}
+	uint64_t mantissa = 0;
+	int numDigits = 0;
+	int exponent = 0;
+	bool exact = true;
+	const char* digitsBegin = p;
+	for(; *p >= '0' && *p <= '9'; ++p) {
+		if(numDigits < 19) {
+			mantissa = mantissa*10 + (*p - '0');
+			if(mantissa) ++numDigits;
+		} else {
+			++exponent;
+			exact = false;
+		}
+	}
+	bool hasDigits = p != digitsBegin;
+	if(*p == '.') {
+		++p;
+		const char* fractionBegin = p;
+		for(; *p >= '0' && *p <= '9'; ++p) {
+			if(numDigits < 19) {
+				mantissa = mantissa*10 + (*p - '0');
+				if(mantissa) ++numDigits;
+				--exponent;
+			} else {
+				exact = false;
+			}
+		}
+		hasDigits = hasDigits || p != fractionBegin;
+	}
+	if(!hasDigits) {
+		return nullptr;
+	}
+	if(*p == 'e' || *p == 'E') {
+		const char* e = p + 1;
+		bool negativeExp = false;
+		if(*e == '-' || *e == '+') {
+			negativeExp = *e == '-';
+			++e;
+		}
+		if(*e >= '0' && *e <= '9') {
+			int exp = 0;
+			for(; *e >= '0' && *e <= '9'; ++e) {
+				if(exp < 100000) {
+					exp = exp*10 + (*e - '0');
+				}
+			}
+			exponent += negativeExp ? -exp : exp;
+			p = e;
+		}
+	}
+	if(exact && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+		value = static_cast<double>(mantissa);
+		value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+		if(negative) {
+			value = -value;
+		}
+		return p;
+	}
+	char* end;
+	value = std::strtod(str, &end);
+	return end;
+}
+
+/** \brief Parse a decimal integer with optional minus sign
+ *
+ * \param str Begin of the number
+ * \param value Parsed value
+ * \return Pointer to the first character after the number or nullptr if no number could be parsed or
+ * the value does not fit into an int.
+ */
+inline const char* parseInt(const char* str, int& value)
+{
+	const char* p = str;
+	bool negative = *p == '-';
+	if(negative) {
+		++p;
+	}
+	if(*p < '0' || *p > '9') {
+		return nullptr;
+	}
+	long long v = 0;
+	for(; *p >= '0' && *p <= '9'; ++p) {
+		v = v*10 + (*p - '0');
+		if(v > static_cast<long long>(INT_MAX) + 1) {
+			return nullptr;
+		}
+	}
+	if(negative) {
+		v = -v;
+	}
+	if(v > INT_MAX || v < INT_MIN) {
+		return nullptr;
+	}
+	value = static_cast<int>(v);
+	return p;
+}
+
+} // namespace core
+
+#endif//CORE_NUMBER_PARSE_H
@@ -0,0 +1,114 @@
+#ifndef PARALLEL_MPA_LOADER_H
+#define PARALLEL_MPA_LOADER_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include "basesensorstreamreader.h"
+#include "chunkpipeline.h"
+
+namespace core {
+
+class MappedFile;
+
+/** \brief Parse MPA text data files on several threads
+ *
+ * The (memory mapped or decompressed) file is split into chunks of about chunkSize bytes, each ending
+ * after a newline. Worker threads parse the chunks into batch_t blocks, which are handed out in file order
+ * by next() (see ChunkPipeline), so parsing scales with the number of cores. At most two chunks per thread
+ * are held in memory while streaming. load() materialises a whole run.
+ *
+ * Events are numbered like MPAStreamReader and MpaMemoryStreamReader do, by the index of the non-empty line.
+ * An unterminated last line is ignored.
+ *
+ * \code{.cpp}
+ParallelMpaLoader loader("run0028_counter.txt_0");
+BaseSensorStreamReader::batch_t batch;
+while(loader.next(batch)) {
+//	batch.getData(i)
+}
+\endcode
+ *
+ * \sa ParallelMpaStreamReader
+ */
+class ParallelMpaLoader
+{
+public:
+	typedef BaseSensorStreamReader::batch_t batch_t;
+
+	enum format_t {
+		/// Detected by the first line, memory data lines contain quoted slots
+		FORMAT_AUTO,
+		/// Counter data, see MPAStreamReader
+		FORMAT_COUNTER,
+		/// Memory data, see MpaMemoryStreamReader
+		FORMAT_MEMORY
+	};
+
+	/** \brief Open a data file and start parsing
+	 *
+	 * \param numThreads Number of worker threads, 0 for the number of cores
+	 * \param chunkSize Approximate size of the chunks in bytes
+	 * \throw std::ios_base::failure The file cannot be opened
+	 */
+	ParallelMpaLoader(const std::string& filename, format_t format=FORMAT_AUTO, size_t numThreads=0,
+	                  size_t chunkSize=1 << 22);
+	ParallelMpaLoader(const ParallelMpaLoader&) = delete;
+	ParallelMpaLoader& operator=(const ParallelMpaLoader&) = delete;
+	~ParallelMpaLoader();
+
+	/** \brief Get the events of the next chunk
+	 *
+	 * Blocks until the chunk has been parsed. The batch is swapped with the chunk buffer, so its memory is
+	 * reused for a later chunk.
+	 * \return false after the last chunk
+	 * \throw std::exception Exceptions of the workers are rethrown
+	 */
+	bool next(batch_t& batch);
+
+	format_t getFormat() const { return _format; }
+	size_t getNumChunks() const { return _chunks.size(); }
+
+	/** \brief Parse a whole data file
+	 *
+	 * The events are kept in the batches of the chunks, so the run is not copied into a single batch by one
+	 * thread after parsing.
+	 * \param chunks Non-empty batches of the chunks in file order
+	 * \param numThreads Number of worker threads, 0 for the number of cores
+	 */
+	static void load(const std::string& filename, std::vector<batch_t>& chunks, format_t format=FORMAT_AUTO,
+	                 size_t numThreads=0);
+
+	/** \brief Split data into chunks of about chunkSize bytes ending after a newline
+	 *
+	 * Data after the last newline is not part of any chunk.
+	 * \return List of (offset, size) pairs
+	 */
+	static std::vector<std::pair<size_t, size_t>> splitLines(const char* data, size_t size, size_t chunkSize);
+
+	/** \brief Parse all non-empty lines of a chunk
+	 *
+	 * The events are appended to batch and numbered from 0.
+	 */
+	static void parseChunk(const char* data, size_t size, format_t format, batch_t& batch);
+
+	/// Format of a file starting with data
+	static format_t detectFormat(const char* data, size_t size);
+
+private:
+	std::unique_ptr<MappedFile> _file;
+	/// Content of compressed files
+	std::vector<char> _buffer;
+	const char* _data;
+	size_t _size;
+	format_t _format;
+	std::vector<std::pair<size_t, size_t>> _chunks;
+	/// Declared after the data, so the workers are stopped first
+	std::unique_ptr<ChunkPipeline<batch_t>> _pipeline;
+	size_t _numEventsDelivered;
+};
+
+} // namespace core
+
+#endif//PARALLEL_MPA_LOADER_H
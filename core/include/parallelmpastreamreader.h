@@ -0,0 +1,90 @@
+#ifndef PARALLEL_MPA_STREAM_READER_H
+#define PARALLEL_MPA_STREAM_READER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "basesensorstreamreader.h"
+#include "parallelmpaloader.h"
+
+namespace core {
+
+/** \brief In-memory access to MPA text data files loaded on several threads
+ *
+ * The first begin() parses the whole counter or memory data file with ParallelMpaLoader, the batches of
+ * the chunks are shared by all iterators. Iterators, copies of them and seeking (no EventIndex needed)
+ * are cheap afterwards, so analyses which pass over a run several times (alignment, sampling) only pay for
+ * parsing once and parsing scales with the number of cores. The whole run is kept in memory as long as the
+ * reader exists.
+ *
+ * The format is detected from the data, so the reader can replace MPAStreamReader and MpaMemoryStreamReader
+ * (config option pixel_reader_type).
+ *
+ * \code{.cpp}
+ParallelMpaStreamReader read("run0028_counter.txt_0");
+for(auto event: read) {
+//	event.data; is hopefully nice
+}
+\endcode
+ */
+class ParallelMpaStreamReader : public BaseSensorStreamReader
+{
+public:
+	ParallelMpaStreamReader() : BaseSensorStreamReader(), _numThreads(0) {}
+	ParallelMpaStreamReader(const std::string& filename) : BaseSensorStreamReader(filename), _numThreads(0) {}
+
+	/// Number of worker threads for loading, 0 (default) for the number of cores
+	void setNumThreads(size_t numThreads) { _numThreads = numThreads; }
+	size_t getNumThreads() const { return _numThreads; }
+
+	/// Events of a whole run, in the batches of the loaded chunks
+	struct run_t {
+		std::vector<batch_t> chunks;
+		/// Index of the first event of each chunk, followed by the number of events
+		std::vector<size_t> firstEvents;
+
+		size_t size() const { return firstEvents.back(); }
+	};
+
+	/** \brief Get the loaded run, loads it on the first call
+	 *
+	 * \throw std::ios_base::failure The file cannot be opened
+	 */
+	std::shared_ptr<const run_t> getRun() const;
+
+protected:
+	class memreader : public BaseSensorStreamReader::reader {
+	public:
+		/// Reader pointing to event i of run
+		memreader(const std::string& filename, std::shared_ptr<const run_t> run, size_t i);
+		virtual bool next();
+		virtual bool nextBatch(batch_t& batch, size_t maxEvents);
+		virtual bool seek(size_t eventIndex);
+		virtual BaseSensorStreamReader::reader* clone() const;
+
+	private:
+		/// Move to the next event, returns false at the end of the run
+		bool step();
+		const batch_t& chunk() const { return _run->chunks[_chunk]; }
+
+		std::shared_ptr<const run_t> _run;
+		size_t _chunk;
+		/// Event in the current chunk
+		size_t _pos;
+	};
+
+	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
+	virtual BaseSensorStreamReader::reader* getReaderAt(const std::string& filename,
+		std::shared_ptr<const EventIndex> index, size_t firstEvent) const;
+	virtual std::shared_ptr<const EventIndex> buildIndex(const std::string& filename) const;
+
+private:
+	size_t _numThreads;
+	mutable std::shared_ptr<const run_t> _run;
+	/// File of _run, reloaded after setFilename()
+	mutable std::string _runFilename;
+};
+
+} // namespace core
+
+#endif//PARALLEL_MPA_STREAM_READER_H
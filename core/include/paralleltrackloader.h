@@ -0,0 +1,126 @@
+#ifndef PARALLEL_TRACK_LOADER_H
+#define PARALLEL_TRACK_LOADER_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <utility>
+#include "trackstreamreader.h"
+#include "eventfilter.h"
+#include "chunkpipeline.h"
+
+namespace core {
+
+class MappedFile;
+
+/** \brief Parse text track files on several threads
+ *
+ * The (memory mapped or decompressed) file is split into chunks of about chunkSize bytes at block boundaries,
+ * i.e. after two consecutive empty lines, so a track never spans two chunks. Worker threads parse the chunks
+ * into events (see ChunkPipeline), next() hands them out in file order. The tracks of an event which is split
+ * between two chunks are merged by event number.
+ *
+ * The events are identical to the ones of the sequential TrackStreamReader, including the consistency checks:
+ * a run ID change between the last event of a chunk and the first event of the next one is reported like
+ * inside a chunk. Errors carry the line number of the whole file, chunks failing on a worker are parsed
+ * again with the correct line offset. As the last event of a chunk is only complete once the next chunk is
+ * known, an error may be thrown one event earlier than by the sequential reader.
+ *
+ * \code{.cpp}
+ParallelTrackLoader loader("run000021-reftracks.txt");
+TrackStreamReader::event_t event;
+while(loader.next(event)) {
+//	event.tracks
+}
+\endcode
+ *
+ * \sa TrackStreamReader::setNumThreads()
+ */
+class ParallelTrackLoader
+{
+public:
+	typedef TrackStreamReader::event_t event_t;
+
+	/** \brief Open a track file and start parsing
+	 *
+	 * \param numThreads Number of worker threads, 0 for the number of cores
+	 * \param chunkSize Approximate size of the chunks in bytes
+	 * \param sensors Sensor IDs of the points to store, empty for all
+	 * \param filter Events to skip, nullptr for none
+	 * \param firstEvent Number of leading events to skip regardless of the filter
+	 * \throw std::ios_base::failure The file cannot be opened
+	 */
+	ParallelTrackLoader(const std::string& filename, size_t numThreads=0, size_t chunkSize=1 << 22,
+	                    const std::vector<int>& sensors=std::vector<int>(),
+	                    std::shared_ptr<const EventFilter> filter=nullptr, size_t firstEvent=0);
+	ParallelTrackLoader(const ParallelTrackLoader&) = delete;
+	ParallelTrackLoader& operator=(const ParallelTrackLoader&) = delete;
+	~ParallelTrackLoader();
+
+	/** \brief Get the next event accepted by the filter
+	 *
+	 * Blocks until the chunk of the event has been parsed.
+	 * \return false after the last event
+	 * \throw TrackStreamReader::parse_error Malformed lines
+	 * \throw TrackStreamReader::consistency_error Run ID or event number change in a track block
+	 */
+	bool next(event_t& event);
+
+	size_t getNumChunks() const { return _chunks.size(); }
+
+	/** \brief Split data into chunks of about chunkSize bytes ending after two consecutive empty lines
+	 *
+	 * The last chunk ends at the end of the data.
+	 * \return List of (offset, size) pairs
+	 */
+	static std::vector<std::pair<size_t, size_t>> splitBlocks(const char* data, size_t size, size_t chunkSize);
+
+private:
+	/// Parsed events of a chunk
+	struct chunk_t {
+		chunk_t() : events(), firstPointLine(0), failed(false) {}
+		std::vector<event_t> events;
+		/// Line of the first point, relative to the chunk
+		size_t firstPointLine;
+		/// Parsing on the worker failed, the chunk is parsed again to report the error
+		bool failed;
+	};
+
+	/** \brief Parse a chunk into events
+	 *
+	 * \param linesBefore Number of lines before the chunk, for error messages
+	 * \param previousRunID Run ID of the previous chunk to check the first point against, nullptr for none
+	 */
+	void parseChunk(size_t i, size_t linesBefore, chunk_t& chunk, const int* previousRunID=nullptr) const;
+	size_t countLinesBefore(size_t chunk) const;
+	/// Get the next chunk from the pipeline and check it against the previous one
+	bool nextChunk();
+	/// Next event of the file, regardless of the filter
+	bool nextEvent(event_t& event);
+
+	std::string _filename;
+	std::unique_ptr<MappedFile> _file;
+	/// Content of compressed files
+	std::vector<char> _buffer;
+	const char* _data;
+	size_t _size;
+	std::vector<std::pair<size_t, size_t>> _chunks;
+	std::vector<int> _sensors;
+	std::shared_ptr<const EventFilter> _filter;
+	/// Declared after the data, so the workers are stopped first
+	std::unique_ptr<ChunkPipeline<chunk_t>> _pipeline;
+	chunk_t _chunk;
+	/// Next event in _chunk
+	size_t _pos;
+	/// Run ID of the last delivered chunk
+	int _runID;
+	bool _haveRunID;
+	/// Leading events left to skip
+	size_t _skip;
+	/// The event range of the filter has been passed
+	bool _pastRange;
+};
+
+} // namespace core
+
+#endif//PARALLEL_TRACK_LOADER_H
@@ -0,0 +1,131 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <utility>
+
+namespace core {
+
+/** \brief Produce elements on a background thread into a bounded ring buffer
+ *
+ * The producer function is called on a separate thread to fill the next free slot of the ring. It
+ * returns false when there are no more elements. The consumer swaps filled slots out with next(), so
+ * the consumer's previous element is handed back to the producer and its memory is reused. With
+ * containers as elements, no allocations happen once all slots have grown to their working size.
+ *
+ * Exceptions thrown by the producer are rethrown by next() after all elements produced before have
+ * been consumed.
+ */
+template<typename T>
+class Prefetcher
+{
+public:
+	/// Fill the given element, return false if there are no more elements
+	typedef std::function<bool(T&)> producer_t;
+
+	/** \brief Start the producer thread
+	 *
+	 * \param depth Number of slots in the ring
+	 * \param produce Producer function, called on the background thread only
+	 */
+	Prefetcher(size_t depth, producer_t produce) :
+	 _ring(depth > 0 ? depth : 1), _head(0), _tail(0), _count(0), _finished(false), _stop(false),
+	 _produce(produce)
+	{
+		_thread = std::thread(&Prefetcher::run, this);
+	}
+
+	Prefetcher(const Prefetcher&) = delete;
+	Prefetcher& operator=(const Prefetcher&) = delete;
+
+	~Prefetcher()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_notFull.notify_all();
+		_thread.join();
+	}
+
+	/** \brief Get the next element
+	 *
+	 * Blocks until the producer has filled the next slot. The element is swapped with the slot.
+	 * \return false if the producer has finished and all elements have been consumed
+	 */
+	bool next(T& element)
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_notEmpty.wait(lock, [this]() { return _count > 0 || _finished; });
+		if(_count == 0) {
+			if(_error) {
+				std::exception_ptr error = _error;
+				_error = nullptr;
+				std::rethrow_exception(error);
+			}
+			return false;
+		}
+		std::swap(element, _ring[_head]);
+		_head = (_head + 1) % _ring.size();
+		--_count;
+		lock.unlock();
+		_notFull.notify_one();
+		return true;
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while(true) {
+			_notFull.wait(lock, [this]() { return _count < _ring.size() || _stop; });
+			if(_stop) {
+				break;
+			}
+			// the slot at _tail is owned by the producer until _count is incremented
+			T& slot = _ring[_tail];
+			lock.unlock();
+			bool produced = false;
+			std::exception_ptr error;
+			try {
+				produced = _produce(slot);
+			} catch(...) {
+				error = std::current_exception();
+			}
+			lock.lock();
+			if(!produced) {
+				_error = error;
+				_finished = true;
+				break;
+			}
+			_tail = (_tail + 1) % _ring.size();
+			++_count;
+			_notEmpty.notify_one();
+		}
+		_finished = true;
+		lock.unlock();
+		_notEmpty.notify_all();
+	}
+
+	std::vector<T> _ring;
+	size_t _head;
+	size_t _tail;
+	size_t _count;
+	bool _finished;
+	bool _stop;
+	std::exception_ptr _error;
+	producer_t _produce;
+	std::mutex _mutex;
+	std::condition_variable _notEmpty;
+	std::condition_variable _notFull;
+	std::thread _thread;
+};
+
+} // namespace core
+
+#endif//PREFETCHER_H
@@ -0,0 +1,71 @@
+#ifndef PREFETCH_SENSOR_STREAM_READER_H
+#define PREFETCH_SENSOR_STREAM_READER_H
+
+#include <memory>
+#include "basesensorstreamreader.h"
+#include "prefetcher.h"
+
+namespace core {
+
+/** \brief Read events of another sensor reader on a background thread
+ *
+ * Wraps any BaseSensorStreamReader. Each iterator starts a thread that reads events from the wrapped
+ * reader into a bounded ring of recycled event_t objects (see Prefetcher), so parsing overlaps with the
+ * analysis of the previous events. The iterator interface is the same as for the wrapped reader.
+ *
+ * Copying an iterator starts a new thread that skips all events up to the position of the copy, so copies
+ * should be avoided.
+ *
+ * \code{.cpp}
+auto source = std::make_shared<MPAStreamReader>("run0028_counter.txt_0");
+PrefetchSensorStreamReader read(source);
+for(auto event: read) {
+//	event.data; is hopefully nice
+}
+\endcode
+ */
+class PrefetchSensorStreamReader : public BaseSensorStreamReader
+{
+public:
+	/** \param source Reader to prefetch from, must not be used elsewhere while iterating
+	 * \param depth Number of events read ahead
+	 */
+	PrefetchSensorStreamReader(std::shared_ptr<BaseSensorStreamReader> source, size_t depth=64)
+	 : BaseSensorStreamReader(source->getFilename()), _source(source), _depth(depth) {}
+
+	std::shared_ptr<BaseSensorStreamReader> getSource() const { return _source; }
+
+	virtual void probe() const { _source->probe(); }
+
+	/// The filter is evaluated by the source on the prefetch thread
+	virtual void setEventFilter(const EventFilter& filter) { _source->setEventFilter(filter); }
+
+	/// The source records its passes, the prefetch thread reads the whole file
+	virtual void setCatalog(std::shared_ptr<RunCatalog> catalog) { _source->setCatalog(catalog); }
+
+protected:
+	class prefetchreader : public BaseSensorStreamReader::reader {
+	public:
+		/** \param skip Number of events of the source to skip before prefetching */
+		prefetchreader(std::shared_ptr<BaseSensorStreamReader> source, size_t depth, size_t skip);
+		virtual bool next();
+		virtual BaseSensorStreamReader::reader* clone() const;
+
+	private:
+		std::shared_ptr<BaseSensorStreamReader> _source;
+		size_t _depth;
+		size_t _numEventsRead;
+		std::unique_ptr<Prefetcher<event_t>> _prefetcher;
+	};
+
+	virtual BaseSensorStreamReader::reader* getReader(const std::string& filename) const;
+	virtual std::shared_ptr<const EventIndex> buildIndex(const std::string& filename) const;
+
+private:
+	std::shared_ptr<BaseSensorStreamReader> _source;
+	size_t _depth;
+};
+
+} // namespace core
+
+#endif//PREFETCH_SENSOR_STREAM_READER_H
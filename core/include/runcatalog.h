@@ -0,0 +1,131 @@
+#ifndef RUN_CATALOG_H
+#define RUN_CATALOG_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+struct sqlite3;
+
+namespace core {
+
+/** \brief Catalog of per-run statistics collected while reading data files
+ *
+ * Readers with a catalog (see BaseSensorStreamReader::setCatalog(), TrackStreamReader::setCatalog()) record
+ * the basic facts about a data file whenever an iterator completes a full pass over it, i.e. it started at the
+ * first event without event range or event filter and was incremented until the end. Analyses can query them
+ * with get() instead of reading the whole run again: number of events, first and last event number, the
+ * number of tracks per event for track files and the occupancy of every pixel for sensor files.
+ *
+ * The catalog is a sqlite3 database with the tables
+ *  - runs (filename, file_size, mtime_sec, mtime_nsec, num_events, first_event, last_event)
+ *  - track_counts (filename, num_tracks, num_events)
+ *  - pixel_hits (filename, pixel, num_events)
+ *
+ * so it can also be queried by scripts. Data files are identified by their canonical path, entries are
+ * ignored by get() if size or modification time of the data file have changed. One catalog may be shared by
+ * readers on several threads and by several processes.
+ *
+ * \code{.cpp}
+auto catalog = std::make_shared<RunCatalog>("runs.sqlite");
+MPAStreamReader read("run0028_counter.txt_0");
+read.setCatalog(catalog);
+for(auto event: read) {
+}
+RunCatalog::stats_t stats;
+if(catalog->get("run0028_counter.txt_0", stats)) {
+//	stats.numEvents, stats.pixelHits
+}
+\endcode
+ */
+class RunCatalog
+{
+public:
+	/// Statistics of a data file
+	struct stats_t {
+		stats_t() : filename(), numEvents(0), firstEvent(0), lastEvent(0), trackCounts(), pixelHits() {}
+		/// Canonical path of the data file
+		std::string filename;
+		size_t numEvents;
+		/// Event numbers of the first and the last event
+		int firstEvent;
+		int lastEvent;
+		/// Number of events with i tracks, empty for sensor data
+		std::vector<uint64_t> trackCounts;
+		/// Number of events with a non-zero value of pixel i, empty for track data
+		std::vector<uint64_t> pixelHits;
+	};
+
+	/** \brief Accumulates the statistics of a pass over a data file
+	 *
+	 * Created by the readers for passes over the whole file. The statistics are only stored by finish(), an
+	 * abandoned pass leaves the catalog unchanged.
+	 */
+	class Collector
+	{
+	public:
+		Collector(std::shared_ptr<RunCatalog> catalog, const std::string& dataFilename);
+
+		/// Add an event of a track file
+		void addEvent(int eventNumber, size_t numTracks);
+		/// Add an event of a sensor data file
+		void addEvent(int eventNumber, const int* data, size_t size);
+
+		/** \brief Store the statistics in the catalog, the pass has reached the end of the file
+		 *
+		 * Errors of the catalog are printed, they do not abort reading.
+		 */
+		void finish();
+
+	private:
+		void addEventNumber(int eventNumber);
+
+		std::shared_ptr<RunCatalog> _catalog;
+		stats_t _stats;
+	};
+
+	/** \brief Open or create a catalog
+	 *
+	 * \throw std::runtime_error The catalog cannot be opened or this build does not support sqlite3
+	 */
+	explicit RunCatalog(const std::string& filename);
+	RunCatalog(const RunCatalog&) = delete;
+	RunCatalog& operator=(const RunCatalog&) = delete;
+	~RunCatalog();
+
+	/** \brief Get the statistics of a data file
+	 *
+	 * \return false if the data file is not in the catalog or has been modified since it was recorded
+	 * \throw std::runtime_error Database error
+	 */
+	bool get(const std::string& dataFilename, stats_t& stats) const;
+
+	/** \brief Insert or replace the statistics of a data file
+	 *
+	 * Size and modification time of stats.filename are recorded for the validity check of get().
+	 * \throw std::runtime_error Database error or the data file does not exist
+	 */
+	void put(const stats_t& stats);
+
+	/// Canonical path of a file, the name itself if the file does not exist
+	static std::string getCanonicalName(const std::string& filename);
+
+	/// This build supports the catalog
+	static bool isAvailable();
+
+	const std::string& getFilename() const { return _filename; }
+
+private:
+	/// Execute statements without results
+	void exec(const char* sql) const;
+
+	std::string _filename;
+	sqlite3* _db;
+	mutable std::mutex _mutex;
+};
+
+} // namespace core
+
+#endif//RUN_CATALOG_H
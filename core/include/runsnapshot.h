@@ -0,0 +1,155 @@
+#ifndef RUN_SNAPSHOT_H
+#define RUN_SNAPSHOT_H
+
+#include "datastructures.h"
+#include "mappedfile.h"
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+namespace core {
+
+/** \brief Hits and MPA counters of a run in contiguous memory
+ *
+ * Analyses passing several times over a run, e.g. to find tracks and then to cluster the DUT hits of the
+ * same events, read the tree once into a snapshot. The hits of each telescope plane (p1 to p6 and ref) are
+ * stored in one array per coordinate with the offsets of the events, the MPA counters as one array of
+ * 48 values per event and MPA branch. TelescopeData (the clusters) is not stored.
+ *
+ * Attach the snapshot to the run_data_t and use getEntry() instead of TTree::GetEntry(), which then loads
+ * the event from memory into the objects of the run. Code working on run_data_t does not need to know
+ * whether it reads from the tree or from a snapshot.
+ *
+ * Snapshots can be stored as flat files (.flat), which are memory mapped instead of being read through
+ * ROOT. MergedAnalysis opens .flat files given as testbeam_data directly, use write() or the root2flat
+ * utility for conversion. The file consists of a file_header_t followed by the arrays
+ *  - uint64 offsets[numPlanes][numEvents+1]: index of the first hit of each event, per plane
+ *  - float x[numHits[i]], y[numHits[i]], z[numHits[i]] for each plane i
+ *  - int32 mpaIndices[numMpa]: index of the MPA branch ("mpa_<index>") of the counters
+ *  - uint16 counters[numEvents][numMpa][numPixels]
+ *
+ * All values are stored in host byte order, the arrays are ordered by decreasing alignment.
+ *
+ * \code{.cpp}
+core::RunSnapshot snapshot(run);
+core::run_data_t cached = run;
+cached.snapshot = &snapshot;
+for(size_t evt = 0; evt < core::getEntries(cached); ++evt) {
+	core::getEntry(cached, evt);
+//	(*cached.telescopeHits)->p1.x
+}
+\endcode
+ */
+class RunSnapshot
+{
+public:
+	/// Planes of TelescopeHits in member order: p1 to p6, ref
+	static const size_t numPlanes = 7;
+	static const size_t numPixels = 48;
+
+	/// Header of flat files
+	struct file_header_t {
+		/// Always "MPAFLAT\0"
+		char magic[8];
+		/// Format version, currently 1
+		uint32_t version;
+		uint32_t numMpa;
+		uint64_t numEvents;
+		/// Number of hits of each plane in all events
+		uint64_t numHits[numPlanes];
+	};
+
+	/** \brief Read all events of run
+	 *
+	 * Disabled branches (see MergedAnalysis::setRequiredBranches()) are stored empty.
+	 */
+	explicit RunSnapshot(const run_data_t& run);
+
+	/** \brief Map a flat file
+	 *
+	 * \throw std::ios_base::failure The file cannot be mapped or is not a valid flat file
+	 */
+	explicit RunSnapshot(const std::string& filename);
+
+	RunSnapshot(const RunSnapshot&) = delete;
+	RunSnapshot& operator=(const RunSnapshot&) = delete;
+
+	/** \brief Check whether a testbeam data file is a flat file, judging by its extension */
+	static bool isFlatFile(const std::string& filename);
+
+	/** \brief Store the snapshot as flat file
+	 *
+	 * \throw std::ios_base::failure The file cannot be written
+	 */
+	void write(const std::string& filename) const;
+
+	size_t size() const { return _numEvents; }
+	size_t getNumMpa() const { return _mpaIndices.size(); }
+	/// Index of the branch "mpa_<index>" the counters of mpa were read from
+	int getMpaIndex(size_t mpa) const { return _mpaIndices[mpa]; }
+
+	/// Number of hits of plane in event evt
+	size_t getNumHits(size_t evt, size_t plane) const
+	{
+		return _planes[plane].offsets[evt+1] - _planes[plane].offsets[evt];
+	}
+	const float* getX(size_t evt, size_t plane) const { return _planes[plane].x + _planes[plane].offsets[evt]; }
+	const float* getY(size_t evt, size_t plane) const { return _planes[plane].y + _planes[plane].offsets[evt]; }
+	const float* getZ(size_t evt, size_t plane) const { return _planes[plane].z + _planes[plane].offsets[evt]; }
+
+	/// Ripple counters of run_data_t::mpaData[mpa] in event evt, numPixels values
+	const UShort_t* getCounter(size_t evt, size_t mpa) const
+	{
+		return _counters + (evt*_mpaIndices.size() + mpa) * numPixels;
+	}
+
+	/** \brief Copy event evt into the objects of run
+	 *
+	 * The TelescopeHits planes and the counters of the MPA branches are overwritten, run must have the
+	 * same MPA branches as the run of the snapshot.
+	 */
+	void load(size_t evt, const run_data_t& run) const;
+
+private:
+	/// Hits of a plane, in _storage or in _file
+	struct plane_t {
+		/// Start of each event in x, y and z, size()+1 entries
+		const uint64_t* offsets;
+		const float* x;
+		const float* y;
+		const float* z;
+	};
+	/// Hits of a plane read from a tree
+	struct storage_t {
+		storage_t() : offsets(1, 0) {}
+		std::vector<uint64_t> offsets;
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+	};
+
+	/// Planes of hits in the order of numPlanes
+	static std::array<PlaneHits*, numPlanes> getPlanes(TelescopeHits* hits);
+
+	size_t _numEvents;
+	std::vector<int32_t> _mpaIndices;
+	std::array<plane_t, numPlanes> _planes;
+	const UShort_t* _counters;
+	/// Data of snapshots read from a tree, empty for flat files
+	std::array<storage_t, numPlanes> _storage;
+	std::vector<UShort_t> _counterStorage;
+	/// Mapping of flat files
+	std::unique_ptr<MappedFile> _file;
+};
+
+/// Number of events of run, from the snapshot if attached
+size_t getEntries(const run_data_t& run);
+
+/// Load event evt into the objects of run, from the snapshot if attached or with TTree::GetEntry()
+void getEntry(const run_data_t& run, size_t evt);
+
+} // namespace core
+
+#endif//RUN_SNAPSHOT_H
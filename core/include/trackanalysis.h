@@ -7,6 +7,10 @@
 #include "basesensorstreamreader.h"
 #include "quickrunlistreader.h"
 #include "mpatransform.h"
+#include "dataoffsetmap.h"
+#include "eventfilter.h"
+#include <cstdint>
+#include <map>
 
 namespace po = boost::program_options;
 
@@ -114,12 +118,57 @@ protected:
 	}
 	void setDataOffset(int dataOffset);
 	int getDataOffset() const { return _dataOffset; }
+	/** \brief Only pass the events accepted by filter to the processes
+	 *
+	 * The event range (MPA event numbers) and hit cuts apply to the MPA events, the track cuts to the
+	 * telescope event joined with them. The cuts are evaluated by the readers where possible, so rejected
+	 * events are not parsed completely. Call in init().
+	 */
+	void setEventFilter(const EventFilter& filter) { _eventFilter = filter; }
+	const EventFilter& getEventFilter() const { return _eventFilter; }
+	/** \brief Only read the coordinates of the telescope planes used by the analysis
+	 *
+	 * The points of the other sensors are NaN, they keep their position in Track::points (see
+	 * TrackStreamReader::setRequiredSensors()). Call in the constructor or init(vm), before run().
+	 * \param sensorIDs Sensor plane IDs, empty for all sensors (default)
+	 */
+	void setRequiredSensors(const std::vector<int>& sensorIDs) { _requiredSensors = sensorIDs; }
+	/// Selection of the events passed to the processes, see setSampling()
+	enum sampling_mode_t {
+		/// All events in file order
+		SAMPLE_ALL,
+		/// Every k-th event of the whole run, starting at random phases
+		SAMPLE_STRIDE,
+		/// Uniform random subset of the whole run, replayed in file order
+		SAMPLE_RESERVOIR
+	};
+	/** \brief Pass a representative subset of the events to the processes
+	 *
+	 * Processes which only need a limited number of events, like the aligners, otherwise see the beginning
+	 * of the runs only. The numEvents samples are distributed over the runs proportional to their size if it
+	 * is known from the run catalog (run_catalog) or from the event indices, evenly otherwise.
+	 *
+	 * SAMPLE_STRIDE seeks to every k-th event, so only the sampled events are parsed. It requires event
+	 * indices (EventIndex) and falls back to SAMPLE_RESERVOIR for sensor readers without one.
+	 * SAMPLE_RESERVOIR reads the complete runs and keeps a uniform random subset in memory. Both are
+	 * reproducible for a given seed. Call in the constructor or loadConfig(), before run().
+	 */
+	void setSampling(sampling_mode_t mode, size_t numEvents, uint64_t seed=0);
+	sampling_mode_t getSamplingMode() const { return _samplingMode; }
+	/// "first" (or "all"), "stride" or "reservoir", throws std::invalid_argument for other names
+	static sampling_mode_t parseSamplingMode(const std::string& name);
 	void rerun();
 	size_t getRerunNumber() const { return _rerunNumber; }
 
 	QuickRunlistReader _runlist;
 	MpaTransform _mpaTransform;
 
+	/** \brief Catalog of the data files configured by run_catalog, nullptr without one
+	 *
+	 * Set by run(), the readers of all runs record their passes in it.
+	 */
+	std::shared_ptr<RunCatalog> getRunCatalog() const { return _catalog; }
+
 	const std::vector<int>& getAllRunIds() const { return _allRunIds; }
 	int getCurrentRunId() const { return _currentRunId; }
 
@@ -129,13 +178,46 @@ private:
 		int runId;
 		std::shared_ptr<core::BaseSensorStreamReader> pixelreader;
 		core::TrackStreamReader trackreader;
+		/// Per-event data offsets of runs with synchronisation losses, null uses the runlist offset
+		std::shared_ptr<const core::DataOffsetMap> offsetMap;
+		/// Number of events sampled from this run
+		size_t sampleSize;
+		/// Number of MPA events in the run catalog, 0 if unknown
+		size_t numEvents;
 	};
 
+	/// Pass the event filter down to the readers of a run
+	void applyEventFilter(run_read_pair_t& read) const;
+	/// Data offset of an MPA event, taken from the offset map of the run if there is one
+	int getDataOffset(const run_read_pair_t& read, int eventNumber) const;
+	/// Total number of events of the data files in the catalog, 0 if one of them is not recorded
+	size_t getCatalogEvents(const std::vector<std::string>& files) const;
+	/// Split the sample size over the runs
+	void distributeSamples(std::vector<run_read_pair_t>& readers) const;
 	void executeProcess(const std::vector<run_read_pair_t>& reader,
                             const process_t& proc);
+	/// Pass the joined events of a run in file order to run
+	void join(const run_read_pair_t& read, const process_t& process, const run_callback_t& run);
+	void joinStride(const run_read_pair_t& read, const process_t& process);
+	/// The reservoir of each run is only filled in the first pass of a process, reruns replay it
+	void joinReservoir(const run_read_pair_t& read, const process_t& process);
+
+	/// Event of a reservoir sample
+	struct sample_t {
+		TrackStreamReader::event_t track;
+		BaseSensorStreamReader::event_t pixel;
+	};
 
 	std::vector<process_t> _processes;
 	int _dataOffset;
+	EventFilter _eventFilter;
+	std::vector<int> _requiredSensors;
+	sampling_mode_t _samplingMode;
+	size_t _numSamples;
+	uint64_t _samplingSeed;
+	std::shared_ptr<RunCatalog> _catalog;
+	/// Reservoir samples of the current process by MPA run ID
+	std::map<int, std::vector<sample_t>> _reservoirs;
 	bool _analysisRunning;
 	bool _rerunProcess;
 	size_t _rerunNumber;
@@ -0,0 +1,97 @@
+#ifndef TRACK_BINARY_FILE_H
+#define TRACK_BINARY_FILE_H
+
+#include <string>
+#include <cstdint>
+#include "trackstreamreader.h"
+#include "mappedfile.h"
+
+namespace core {
+
+/** \brief Columnar binary storage of telescope tracks (.trk files)
+ *
+ * Parsing the gnuplot-style text track files is the dominant cost when many alignment jobs run against
+ * the same telescope run. The .trk format stores the same data column by column, so that it can be memory
+ * mapped and read without any conversion. The file consists of a file_header_t followed by the arrays
+ *  - uint64 eventTrackOffsets[numEvents+1]: index of the first track of each event
+ *  - uint64 trackPointOffsets[numTracks+1]: index of the first point of each track
+ *  - double x[numPoints], y[numPoints], z[numPoints]
+ *  - int32 eventNumbers[numEvents]
+ *  - int32 runIDs[numEvents]
+ *  - int32 sensorIDs[numPoints]
+ *
+ * All values are stored in host byte order. The arrays are ordered by decreasing alignment, so every array
+ * is naturally aligned within the mapping.
+ *
+ * TrackStreamReader reads .trk files transparently, use write() or the csv2trk utility for conversion.
+ */
+class TrackBinaryFile
+{
+public:
+	/// File header
+	struct file_header_t {
+		/// Always "MPATRK\0\0"
+		char magic[8];
+		/// Format version, currently 1
+		uint32_t version;
+		/// Unused, always 0
+		uint32_t reserved;
+		uint64_t numEvents;
+		uint64_t numTracks;
+		uint64_t numPoints;
+	};
+
+	/** \brief Map a .trk file
+	 *
+	 * \throw std::ios_base::failure The file cannot be mapped or is not a valid track file
+	 */
+	TrackBinaryFile(const std::string& filename);
+
+	/** \brief Check whether a track data file is a .trk file, judging by its extension */
+	static bool isBinaryFile(const std::string& filename);
+
+	/** \brief Convert all events of a TrackStreamReader into a .trk file
+	 *
+	 * \return Number of events written
+	 * \throw std::ios_base::failure The file cannot be written
+	 */
+	static size_t write(const TrackStreamReader& source, const std::string& filename);
+
+	size_t getNumEvents() const noexcept { return _header.numEvents; }
+	/// Event number of an event, without reading it
+	int getEventNumber(size_t index) const { return _eventNumbers[index]; }
+	/// Number of tracks of an event, without reading it
+	size_t getNumTracks(size_t index) const { return _eventTrackOffsets[index+1] - _eventTrackOffsets[index]; }
+
+	/** \brief Copy a single event into event
+	 *
+	 * The track and point containers of event are reused.
+	 * \param index Index of the event in the file, must be smaller than getNumEvents()
+	 * \param event Target event
+	 */
+	void readEvent(size_t index, TrackStreamReader::event_t& event) const;
+
+	/** \brief Copy a single event, only with the coordinates of some sensors
+	 *
+	 * The other points are TrackStreamReader::getSkippedPosition().
+	 * \param sensors Sensor IDs of the points to copy, empty for all
+	 * \sa TrackStreamReader::setRequiredSensors()
+	 */
+	void readEvent(size_t index, TrackStreamReader::event_t& event, const std::vector<int>& sensors) const;
+
+private:
+	MappedFile _file;
+	file_header_t _header;
+	const uint64_t* _eventTrackOffsets;
+	const uint64_t* _trackPointOffsets;
+	const double* _x;
+	const double* _y;
+	const double* _z;
+	const int32_t* _eventNumbers;
+	const int32_t* _runIDs;
+	const int32_t* _sensorIDs;
+};
+
+} // namespace core
+
+#endif//TRACK_BINARY_FILE_H
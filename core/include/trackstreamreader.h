@@ -3,12 +3,21 @@
 
 #include <vector>
 #include <string>
-#include <fstream>
+#include "inputstream.h"
+#include <memory>
 #include <regex.h>
+#include <limits>
+#include <algorithm>
 #include "track.h"
+#include "eventindex.h"
+#include "prefetcher.h"
+#include "eventfilter.h"
+#include "runcatalog.h"
 
 namespace core {
 
+class TrackBinaryFile;
+
 /** \brief Streamed access to aligned and cut telescope tracks.
  *
  * This class provides access to data files containing information about tracks potentially hitting a DUT. The
@@ -50,6 +59,30 @@ event number is used to group tracks into events. It is expected that all tracks
 consecutive in the data file and that the event number is not decreasing. The run ID is read and stored,
 but not used by the TrackStreamReader.
 
+Lines are split with a hand-written tokenizer by default. The original POSIX regular expression parser is
+still available via TrackStreamReader::PARSE_REGEX and can be used to validate the tokenizer on new data,
+both accept the same files and produce identical values.
+
+Files with the extension .trk are read as columnar binary track files instead, see TrackBinaryFile. They
+are memory mapped and yield exactly the same events as the text file they were converted from.
+
+For text files, an EventIndex can be used (see setUseIndex()) to start at any event in constant time and
+to copy iterators without reopening the file at the current position. setEventRange() restricts the
+iteration to a range of events, e.g. to split a run.
+
+With setPrefetch(), events are read on a background thread while the previous events are processed.
+setNumThreads() additionally parses text files in blocks on several threads, see ParallelTrackLoader.
+
+Most analyses only need a few telescope planes. With setRequiredSensors(), only the coordinates of the
+given sensor IDs are converted, the points of all other planes are NaN (see getSkippedPosition()). All
+points keep their position in Track::points, so point indices (e.g. for Track::extrapolateOnPlane()) do not
+depend on the required sensors.
+
+setEventFilter() removes events from the iteration by event number and number of tracks. The coordinates of
+events outside of the event range are not converted.
+
+With setCatalog(), iterators passing over the whole file record the number of tracks per event in a RunCatalog.
+
 The TrackStreamReader is compatible with range-based for loops, as it implements an C++11 iterator interface
 via TrackStreamReader::EventIterator.
 
@@ -73,6 +106,25 @@ public:
 		std::vector<Track> tracks;
 	};
 
+	/// Single data line
+	struct point_t {
+		double x, y, z;
+		int sensorID;
+		int eventNumber;
+		int runID;
+	};
+
+	/// Read all events in setEventRange()
+	static const size_t npos = std::numeric_limits<size_t>::max();
+
+	/// Line parser implementation
+	enum parse_mode_t {
+		/// Fast in-place tokenizer (default)
+		PARSE_TOKENIZER,
+		/// POSIX regular expressions, slow but kept for validation
+		PARSE_REGEX
+	};
+
 	/** Exception class indicating a consistency error in the data file.
 	 *
 	 * A consistency error is thrown when the runID or eventID changes inside
@@ -121,6 +173,9 @@ public:
 	 * The work horse of the TrackStreamReader. A C++11 compliant copyable and movable iterator
 	 * implementation. The first event is read during iterator construction, any subsequent read is
 	 * performed when incrementing the iterator.
+	 *
+	 * Moving an iterator is cheap. Copies of text file iterators reopen the file (or open it lazily
+	 * with an EventIndex), index and mapped binary files are shared between copies.
 	 */
 	class EventIterator {
 	public:
@@ -128,8 +183,18 @@ public:
 		 * \param filename The filename of the file to be opened.
 		 * \param end If set to true, the iterator will be a beyond-last-element iterator. The file
 		 * will not be opened in that case.
+		 * \param mode Line parser to use.
+		 * \param index Event index of the text file, enables seeking and cheap copies.
+		 * \param firstEvent Index of the first event to read.
+		 * \param numEvents Maximum number of events to read.
+		 * \param sensors Sensor IDs of the points to store, empty for all.
+		 * \param filter Events to skip, nullptr for none. firstEvent counts all events of the file,
+		 * numEvents only the accepted ones.
 		 */
-		EventIterator(const std::string& filename, bool end);
+		EventIterator(const std::string& filename, bool end, parse_mode_t mode = PARSE_TOKENIZER,
+			std::shared_ptr<const EventIndex> index = nullptr, size_t firstEvent = 0,
+			size_t numEvents = npos, const std::vector<int>& sensors = std::vector<int>(),
+			std::shared_ptr<const EventFilter> filter = nullptr);
 		EventIterator(const EventIterator& other);
 		EventIterator(EventIterator&& other) noexcept;
 		~EventIterator();
@@ -153,9 +218,24 @@ public:
 		 * \throw consistency_error Prevents changing of runID and eventID in a track block.
 		 */
 		EventIterator& operator++();
-		/// \sa operator++()
+		/** \brief Post-increment
+		 *
+		 * Returns a detached iterator holding only a copy of the current event, which becomes an end
+		 * iterator when incremented. The file is not reopened.
+		 * \sa operator++()
+		 */
 		EventIterator operator++(int);
 
+		/** \brief Jump to the first event with an event number not less than eventNumber
+		 *
+		 * Requires an EventIndex (see setUseIndex()) or a binary file, used for sampling events. Event
+		 * ranges are not respected, prefetching iterators cannot seek.
+		 * \return false if there is no such event or it is rejected by the event filter, the iterator is
+		 * an end iterator until the next successful seekEvent() in that case
+		 * \throw std::logic_error The iterator cannot seek
+		 */
+		bool seekEvent(int eventNumber);
+
 		/** \brief Get current event the iterator is pointing to. */
 		const event_t& operator*() const noexcept { return _currentEvent; }
 
@@ -175,18 +255,57 @@ public:
 		bool isEnd() const noexcept { return _end; }
 
 	private:
+		friend class TrackStreamReader;
+		/** \brief Continue reading on a background thread
+		 *
+		 * The iterator keeps its current event, all following events are read by a Prefetcher.
+		 */
+		void startPrefetch(size_t depth);
+		/** \brief Read an end iterator with a ParallelTrackLoader on a background thread
+		 *
+		 * The sensors and the filter of the iterator are used.
+		 */
+		void startParallel(size_t numThreads, size_t depth, size_t firstEvent, size_t numEvents);
+		/// Read the next accepted event, operator++() without recording
+		void increment();
 		void open();
 		void compileRegex();
-		mutable std::ifstream _fin;
+		/// Read the next event of the file, regardless of the filter
+		void readEvent();
+		/// Check the current event against the filter, ends the iteration after the event range
+		bool acceptsEvent();
+		/** Parse a data line with the selected parser.
+		 * \return false for comment lines
+		 * \throw parse_error Malformed line
+		 */
+		bool parseLine(const std::string& line, point_t& point) const;
+		bool parseLineRegex(const std::string& line, point_t& point) const;
+		bool parseLineTokenizer(const std::string& line, point_t& point) const;
+		mutable InputStream _fin;
 		std::string _filename;
 		bool _end;
 		event_t _currentEvent;
 		event_t _nextEvent;
+		parse_mode_t _parseMode;
+		/// Mapped .trk file, shared between copies of the iterator
+		std::shared_ptr<const TrackBinaryFile> _binary;
+		std::shared_ptr<const EventIndex> _index;
+		/// Sensor IDs of the stored points, empty for all
+		std::vector<int> _sensors;
+		std::shared_ptr<const EventFilter> _filter;
+		/// Number of events left in the event range
+		size_t _remaining;
+		/// The stream is positioned at the first line of the next event
+		bool _restart;
+		/// Background reader, not shared between copies
+		std::shared_ptr<Prefetcher<event_t>> _prefetch;
 		bool _regexCompiled;
 		regex_t _regexLine;
 		regex_t _regexComment;
 		size_t _eventsRead;
 		size_t _currentLineNo;
+		/// Records a pass over the whole file, not shared between copies
+		std::shared_ptr<RunCatalog::Collector> _collector;
 	};
 
 	/** \brief Construct a new TrackStreamReader instance.
@@ -194,8 +313,9 @@ public:
 	 * This will not perform any checks or filesystem operations! The first access to the data file will
 	 * be when calling begin() to create a new iterator.
 	 * \param filename Path of the file to open.
+	 * \param mode Line parser to use.
 	 */
-	TrackStreamReader(const std::string& filename);
+	TrackStreamReader(const std::string& filename, parse_mode_t mode = PARSE_TOKENIZER);
 
 	/** Get the iterator pointing to the first event.
 	 *
@@ -206,9 +326,128 @@ public:
 	/** Get beyond-last-element iterator */
 	EventIterator end() const;
 
+	/** \brief Check that the data file can be read
+	 *
+	 * Opens the file (and validates the header of binary files) without parsing any event.
+	 * \throw std::ios_base::failure The file cannot be opened or is invalid
+	 */
+	void probe() const;
+
 	std::string getFilename() const { return _filename; }
+	parse_mode_t getParseMode() const { return _parseMode; }
+
+	/** \brief Enable the sidecar event index for text files
+	 *
+	 * The EventIndex is loaded (or built on first use) by begin().
+	 */
+	void setUseIndex(bool useIndex) { _useIndex = useIndex; }
+
+	/** \brief Restrict iteration to a range of events
+	 *
+	 * \param firstEvent Index of the first event (counted from the beginning of the file)
+	 * \param numEvents Maximum number of events, npos for all remaining events
+	 */
+	void setEventRange(size_t firstEvent, size_t numEvents=npos)
+	{
+		_firstEvent = firstEvent;
+		_numEvents = numEvents;
+	}
+
+	/** \brief Read events on a background thread
+	 *
+	 * Iterators created by begin() read up to depth events ahead. Copies of such iterators read
+	 * synchronously.
+	 * \param depth Number of events read ahead, 0 disables prefetching
+	 */
+	void setPrefetch(size_t depth) { _prefetchDepth = depth; }
+
+	/** \brief Parse text files on several threads
+	 *
+	 * Iterators created by begin() read the file with a ParallelTrackLoader, which parses blocks of tracks
+	 * in parallel, on a background thread (see setPrefetch()). Only the tokenizer (PARSE_TOKENIZER) is
+	 * available in parallel, the index is not used and the iterators cannot seek. Binary files are read as
+	 * usual.
+	 * \param numThreads Number of worker threads, 0 or 1 (default) for sequential parsing
+	 */
+	void setNumThreads(size_t numThreads) { _numThreads = numThreads; }
+	size_t getNumThreads() const { return _numThreads; }
+
+	/** \brief Only read the coordinates of some sensors
+	 *
+	 * The coordinates of points of other sensors are not converted while parsing, their position is
+	 * getSkippedPosition(). Track::points and Track::sensorIDs still contain all points of the track.
+	 * \param sensorIDs Sensor plane IDs, empty for all sensors (default)
+	 */
+	void setRequiredSensors(const std::vector<int>& sensorIDs) { _sensors = sensorIDs; }
+	const std::vector<int>& getRequiredSensors() const { return _sensors; }
+
+	/** \brief Only iterate over the events accepted by filter
+	 *
+	 * The event number and track cuts apply, hit cuts are ignored. The first event of setEventRange() is an
+	 * index into the file, the number of events counts accepted events only.
+	 */
+	void setEventFilter(const EventFilter& filter)
+	{
+		_filter = filter.empty() ? nullptr : std::make_shared<EventFilter>(filter);
+	}
+
+	/** \brief Record the statistics of the data file in catalog
+	 *
+	 * Iterators of begin() without event range or filter record the number of tracks of every event, the
+	 * statistics are stored when the end of the file is reached. nullptr disables recording.
+	 */
+	void setCatalog(std::shared_ptr<RunCatalog> catalog) { _catalog = catalog; }
+
+	/** \brief Split a data line with the hand-written tokenizer
+	 *
+	 * Coordinates of points that are not required (see isPointRequired()) are not converted.
+	 * \param line Null-terminated line
+	 * \param filename File name and line number for error messages
+	 * \return false for comment lines
+	 * \throw parse_error Malformed line
+	 */
+	static bool tokenizeLine(const char* line, point_t& point, const std::vector<int>& sensors,
+	                         const EventFilter* filter, const std::string& filename, size_t lineNo);
+
+	/// Position of the points of sensors that are not required, see setRequiredSensors()
+	static Eigen::Vector3d getSkippedPosition()
+	{
+		return Eigen::Vector3d::Constant(std::numeric_limits<double>::quiet_NaN());
+	}
+
+	/// The coordinates are read, the point belongs to one of sensors (empty for all) and passes filter
+	static bool isPointRequired(const point_t& point, const std::vector<int>& sensors, const EventFilter* filter)
+	{
+		if(filter && !filter->acceptsEventNumber(point.eventNumber)) {
+			return false;
+		}
+		return sensors.empty() || std::find(sensors.begin(), sensors.end(), point.sensorID) != sensors.end();
+	}
+
+	/** \brief Get the event index of a text file
+	 *
+	 * The index is loaded or built on the first call, independent of setUseIndex().
+	 * \return nullptr for binary files
+	 */
+	std::shared_ptr<const EventIndex> getIndex() const;
+
 private:
+	/// Let iterators of a pass over the whole file record it in the catalog
+	void startCollector(EventIterator& it) const;
+	/// Index builder for text track files
+	static void buildIndex(const char* data, size_t size, EventIndex& index);
+
 	std::string _filename;
+	parse_mode_t _parseMode;
+	bool _useIndex;
+	size_t _firstEvent;
+	size_t _numEvents;
+	size_t _prefetchDepth;
+	size_t _numThreads;
+	std::vector<int> _sensors;
+	std::shared_ptr<const EventFilter> _filter;
+	mutable std::shared_ptr<const EventIndex> _index;
+	std::shared_ptr<RunCatalog> _catalog;
 };
 
 } // namespace core
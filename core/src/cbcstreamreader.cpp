@@ -43,13 +43,43 @@ CBCStreamReader::cbcreader::~cbcreader()
 }
 
 bool CBCStreamReader::cbcreader::next()
+{
+	_currentEvent.data.clear();
+	if(readEntry()) {
+		return true;
+	}
+	appendChannels(_currentEvent.data);
+	return false;
+}
+
+bool CBCStreamReader::cbcreader::nextBatch(batch_t& batch, size_t maxEvents)
+{
+	// filtered events are only known after decoding
+	if(getFilter()) {
+		return reader::nextBatch(batch, maxEvents);
+	}
+	if(maxEvents == 0) {
+		return false;
+	}
+	batch.push_back(_currentEvent);
+	// fill the following events directly into the batch
+	for(size_t i = 1; i < maxEvents; ++i) {
+		if(readEntry()) {
+			return true;
+		}
+		appendChannels(batch.data);
+		batch.endEvent(_currentEvent.eventNumber);
+	}
+	return next();
+}
+
+bool CBCStreamReader::cbcreader::readEntry()
 {
 	bool good = true;
 	do {
 //		if(!good) {
 //			std::cout << "Skipped not-good event " << _currentEvent.eventNumber << std::endl;
 //		}
-		_currentEvent.data.clear();
 		if(_numEventsRead == _analysisTree->GetEntries()) {
 			return true;
 		}
@@ -68,15 +98,19 @@ bool CBCStreamReader::cbcreader::next()
 		}
 		_currentEvent.eventNumber++;
 	} while(!good);
+	return false;
+}
+
+void CBCStreamReader::cbcreader::appendChannels(std::vector<int>& data) const
+{
 	for(const auto &n: _dutEvent->dut_channel.at("det0"))
 	{
-	    _currentEvent.data.push_back(n);
+	    data.push_back(n);
 	}
 	for(const auto &n: _dutEvent->dut_channel.at("det1"))
 	{
-	    _currentEvent.data.push_back(n + 254);
+	    data.push_back(n + 254);
 	}
-	return false;
 }
 
 
@@ -3,6 +3,8 @@
 #include "coreconfig.h"
 #include "mpastreamreader.h"
 #include "mpamemorystreamreader.h"
+#include "mpabinarystreamreader.h"
+#include "parallelmpastreamreader.h"
 #include "cbcstreamreader.h"
 
 namespace core {
@@ -11,6 +13,8 @@ void initClasses()
 {
 	REGISTER_PIXEL_STREAM_READER_TYPE(MPAStreamReader);
 	REGISTER_PIXEL_STREAM_READER_TYPE(MpaMemoryStreamReader);
+	REGISTER_PIXEL_STREAM_READER_TYPE(MpaBinaryStreamReader);
+	REGISTER_PIXEL_STREAM_READER_TYPE(ParallelMpaStreamReader);
 #ifdef ENABLE_CBC_ANALYIS
 	REGISTER_PIXEL_STREAM_READER_TYPE(CBCStreamReader);
 #endif//ENABLE_CBC_ANALYIS
@@ -0,0 +1,74 @@
+#include "dataoffsetmap.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace core;
+
+void DataOffsetMap::add(int firstEvent, int offset)
+{
+	if(!_segments.empty()) {
+		if(firstEvent <= _segments.back().firstEvent) {
+			throw std::invalid_argument("Offset map segments must be in increasing event order");
+		}
+		if(offset == _segments.back().offset) {
+			return;
+		}
+	}
+	_segments.push_back({firstEvent, offset});
+}
+
+int DataOffsetMap::getOffset(int eventNumber, int defaultOffset) const
+{
+	// first segment starting after eventNumber
+	auto it = std::upper_bound(_segments.begin(), _segments.end(), eventNumber,
+		[](int evt, const segment_t& segment) { return evt < segment.firstEvent; });
+	if(it == _segments.begin()) {
+		return defaultOffset;
+	}
+	return (it - 1)->offset;
+}
+
+void DataOffsetMap::read(const std::string& filename)
+{
+	std::ifstream fin(filename);
+	if(!fin.is_open()) {
+		throw std::ios_base::failure(filename + ": Cannot open offset map");
+	}
+	_segments.clear();
+	std::string line;
+	int lineNo = 0;
+	while(std::getline(fin, line)) {
+		++lineNo;
+		std::istringstream sstr(line);
+		std::string first;
+		if(!(sstr >> first) || first[0] == '#') {
+			continue;
+		}
+		int offset;
+		try {
+			int firstEvent = std::stoi(first);
+			if(!(sstr >> offset)) {
+				throw std::invalid_argument("missing offset");
+			}
+			add(firstEvent, offset);
+		} catch(std::exception& e) {
+			std::ostringstream msg;
+			msg << filename << ":" << lineNo << ": Invalid offset map line";
+			throw std::ios_base::failure(msg.str());
+		}
+	}
+}
+
+void DataOffsetMap::write(const std::string& filename) const
+{
+	std::ofstream fout;
+	fout.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+	fout.open(filename, std::ios_base::trunc);
+	fout << "# first_event offset\n";
+	for(const auto& segment: _segments) {
+		fout << segment.firstEvent << "\t" << segment.offset << "\n";
+	}
+	fout.close();
+}
@@ -0,0 +1,209 @@
+#include "desyncdetector.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace core;
+
+DesyncDetector::DesyncDetector(int range, size_t window, double residualRange, double binWidth,
+	double minSignificance)
+ : _range(range), _window(window > 0 ? window : 1), _residualRange(residualRange), _binWidth(binWidth),
+   _minSignificance(minSignificance), _numBins(static_cast<size_t>(std::ceil(2*residualRange/binWidth))),
+   _decisionInterval(std::max<size_t>(1, _window/20))
+{
+	reset();
+}
+
+void DesyncDetector::reset()
+{
+	_pending.clear();
+	_final.clear();
+	_hist.assign((2*_range + 1)*_numBins, 0);
+	_total.assign(2*_range + 1, 0);
+	_sinceDecision = 0;
+	_haveFirstEvent = false;
+	_firstEvent = 0;
+	_synchronised = false;
+	_offset = 0;
+	_map.clear();
+}
+
+void DesyncDetector::addEvent(int eventNumber, const std::vector<double>& pixelX,
+	const std::vector<double>& trackX)
+{
+	if(!_haveFirstEvent) {
+		_firstEvent = eventNumber;
+		_haveFirstEvent = true;
+	}
+	// the oldest event has been correlated with all offsets
+	pending_t event;
+	if(_pending.size() > static_cast<size_t>(_range)) {
+		finalize(_pending.front());
+		// reuse its containers
+		event = std::move(_pending.front());
+		_pending.pop_front();
+	}
+	event.eventNumber = eventNumber;
+	event.pixels.assign(pixelX.begin(), pixelX.end());
+	event.tracks.assign(trackX.begin(), trackX.end());
+	event.entries.clear();
+	_pending.push_back(std::move(event));
+
+	// offset = track event - pixel event, _pending[newest - k] is k events older
+	pending_t& newest = _pending.back();
+	const size_t newestIdx = _pending.size() - 1;
+	for(size_t k = 0; k <= newestIdx; ++k) {
+		pending_t& older = _pending[newestIdx - k];
+		// new tracks with older hits
+		addPairs(newest.tracks, older.pixels, k, older.entries);
+		// new hits with older tracks
+		if(k > 0) {
+			addPairs(older.tracks, newest.pixels, -static_cast<int>(k), newest.entries);
+		}
+	}
+}
+
+void DesyncDetector::addPairs(const std::vector<double>& tracks, const std::vector<double>& pixels, int offset,
+	std::vector<uint32_t>& entries) const
+{
+	const uint32_t histOffset = (offset + _range)*_numBins;
+	for(auto b: tracks) {
+		for(auto a: pixels) {
+			const double bin = std::floor((b - a + _residualRange) / _binWidth);
+			if(bin >= 0 && bin < _numBins) {
+				entries.push_back(histOffset + static_cast<uint32_t>(bin));
+			}
+		}
+	}
+}
+
+void DesyncDetector::finalize(pending_t& event)
+{
+	final_t done;
+	if(_final.size() >= _window) {
+		final_t& old = _final.front();
+		for(auto entry: old.entries) {
+			--_hist[entry];
+			--_total[entry / _numBins];
+		}
+		done = std::move(old);
+		_final.pop_front();
+	}
+	done.eventNumber = event.eventNumber;
+	done.entries.swap(event.entries);
+	for(auto entry: done.entries) {
+		++_hist[entry];
+		++_total[entry / _numBins];
+	}
+	_final.push_back(std::move(done));
+	if(++_sinceDecision >= _decisionInterval) {
+		decide();
+	}
+}
+
+void DesyncDetector::finish()
+{
+	while(!_pending.empty()) {
+		finalize(_pending.front());
+		_pending.pop_front();
+	}
+	decide();
+}
+
+double DesyncDetector::getSignificance(int offset, size_t* peakBin) const
+{
+	const uint32_t* hist = _hist.data() + (offset + _range)*_numBins;
+	// sum of three bins, so peaks on bin edges are not split
+	uint32_t peak = 0;
+	size_t peakCenter = 0;
+	for(size_t bin = 0; bin < _numBins; ++bin) {
+		uint32_t sum = hist[bin];
+		if(bin > 0) sum += hist[bin-1];
+		if(bin + 1 < _numBins) sum += hist[bin+1];
+		if(sum > peak) {
+			peak = sum;
+			peakCenter = bin;
+		}
+	}
+	if(peakBin) {
+		*peakBin = peakCenter;
+	}
+	const double background = 3. * _total[offset + _range] / _numBins;
+	return (peak - background) / std::sqrt(background + 1.);
+}
+
+void DesyncDetector::decide()
+{
+	_sinceDecision = 0;
+	int best = 0;
+	double bestSignificance = -1;
+	size_t bestPeak = 0;
+	for(int offset = -_range; offset <= _range; ++offset) {
+		size_t peak;
+		double significance = getSignificance(offset, &peak);
+		if(significance > bestSignificance) {
+			best = offset;
+			bestSignificance = significance;
+			bestPeak = peak;
+		}
+	}
+	if(bestSignificance < _minSignificance || (_synchronised && best == _offset)) {
+		return;
+	}
+	if(!_synchronised) {
+		_map.add(_firstEvent, best);
+		_synchronised = true;
+		_offset = best;
+		return;
+	}
+	size_t currentPeak;
+	double currentSignificance = getSignificance(_offset, &currentPeak);
+	if(bestSignificance < 2*currentSignificance) {
+		return;
+	}
+	size_t changePoint = findChangePoint(_offset, currentPeak, best, bestPeak);
+	int firstEvent = _final[changePoint].eventNumber;
+	// the change may be located before the start of the current segment if it happened earlier
+	firstEvent = std::max(firstEvent, _map.getSegments().back().firstEvent + 1);
+	_map.add(firstEvent, best);
+	_offset = best;
+}
+
+size_t DesyncDetector::countPeakEntries(const final_t& event, int offset, size_t peakBin) const
+{
+	const uint32_t first = (offset + _range)*_numBins + (peakBin > 0 ? peakBin - 1 : 0);
+	const uint32_t last = (offset + _range)*_numBins + std::min(peakBin + 1, _numBins - 1);
+	size_t count = 0;
+	for(auto entry: event.entries) {
+		if(entry >= first && entry <= last) {
+			++count;
+		}
+	}
+	return count;
+}
+
+size_t DesyncDetector::findChangePoint(int oldOffset, size_t oldPeak, int newOffset, size_t newPeak) const
+{
+	// maximise the number of old peak entries before and new peak entries after the change point
+	long newTotal = 0;
+	std::vector<long> oldCounts(_final.size());
+	std::vector<long> newCounts(_final.size());
+	for(size_t i = 0; i < _final.size(); ++i) {
+		oldCounts[i] = countPeakEntries(_final[i], oldOffset, oldPeak);
+		newCounts[i] = countPeakEntries(_final[i], newOffset, newPeak);
+		newTotal += newCounts[i];
+	}
+	long bestScore = newTotal;
+	size_t best = 0;
+	long oldBefore = 0;
+	long newBefore = 0;
+	for(size_t i = 1; i <= _final.size(); ++i) {
+		oldBefore += oldCounts[i-1];
+		newBefore += newCounts[i-1];
+		long score = oldBefore + newTotal - newBefore;
+		if(score > bestScore) {
+			bestScore = score;
+			best = i;
+		}
+	}
+	return std::min(best, _final.size() - 1);
+}
@@ -0,0 +1,177 @@
+#include "eventindex.h"
+#include "mappedfile.h"
+#include "inputstream.h"
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+
+using namespace core;
+
+namespace {
+const char fileMagic[8] = {'M', 'P', 'A', 'I', 'D', 'X', 0, 0};
+const uint32_t fileVersion = 1;
+
+struct file_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t fileSize;
+	int64_t mtimeSec;
+	int64_t mtimeNsec;
+	uint64_t numEvents;
+};
+static_assert(sizeof(file_header_t) == 48, "Unexpected padding in index file header");
+
+bool statDataFile(const std::string& dataFilename, uint64_t& size, int64_t& sec, int64_t& nsec)
+{
+	struct stat st;
+	if(stat(dataFilename.c_str(), &st) != 0) {
+		return false;
+	}
+	size = st.st_size;
+	sec = st.st_mtim.tv_sec;
+	nsec = st.st_mtim.tv_nsec;
+	return true;
+}
+
+template<typename T>
+bool readArray(std::ifstream& fin, std::vector<T>& data, size_t size)
+{
+	data.resize(size);
+	fin.read(reinterpret_cast<char*>(data.data()), size*sizeof(T));
+	return fin.good();
+}
+
+template<typename T>
+void writeArray(std::ofstream& fout, const std::vector<T>& data)
+{
+	fout.write(reinterpret_cast<const char*>(data.data()), data.size()*sizeof(T));
+}
+}
+
+size_t EventIndex::find(int eventNumber) const
+{
+	return std::lower_bound(_eventNumbers.begin(), _eventNumbers.end(), eventNumber) - _eventNumbers.begin();
+}
+
+std::vector<std::pair<size_t, size_t>> EventIndex::split(size_t numParts) const
+{
+	std::vector<std::pair<size_t, size_t>> ranges;
+	if(numParts == 0) {
+		return ranges;
+	}
+	size_t first = 0;
+	for(size_t i = 0; i < numParts; ++i) {
+		size_t last = size() * (i + 1) / numParts;
+		ranges.push_back(std::make_pair(first, last - first));
+		first = last;
+	}
+	return ranges;
+}
+
+bool EventIndex::load(const std::string& dataFilename)
+{
+	uint64_t size;
+	int64_t sec, nsec;
+	if(!statDataFile(dataFilename, size, sec, nsec)) {
+		return false;
+	}
+	std::ifstream fin(getIndexFilename(dataFilename), std::ios_base::binary);
+	if(!fin.is_open()) {
+		return false;
+	}
+	file_header_t header;
+	fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if(!fin.good() || std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 ||
+	   header.version != fileVersion) {
+		return false;
+	}
+	// data file was modified after the index had been built
+	if(header.fileSize != size || header.mtimeSec != sec || header.mtimeNsec != nsec) {
+		return false;
+	}
+	if(!readArray(fin, _offsets, header.numEvents) ||
+	   !readArray(fin, _linesBefore, header.numEvents) ||
+	   !readArray(fin, _eventNumbers, header.numEvents)) {
+		_offsets.clear();
+		_linesBefore.clear();
+		_eventNumbers.clear();
+		return false;
+	}
+	_fileSize = size;
+	_mtimeSec = sec;
+	_mtimeNsec = nsec;
+	return true;
+}
+
+void EventIndex::save(const std::string& dataFilename)
+{
+	if(!statDataFile(dataFilename, _fileSize, _mtimeSec, _mtimeNsec)) {
+		throw std::ios_base::failure(dataFilename + ": Cannot stat data file");
+	}
+	file_header_t header;
+	std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.reserved = 0;
+	header.fileSize = _fileSize;
+	header.mtimeSec = _mtimeSec;
+	header.mtimeNsec = _mtimeNsec;
+	header.numEvents = size();
+	std::ofstream fout;
+	fout.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+	fout.open(getIndexFilename(dataFilename), std::ios_base::binary | std::ios_base::trunc);
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writeArray(fout, _offsets);
+	writeArray(fout, _linesBefore);
+	writeArray(fout, _eventNumbers);
+	fout.close();
+}
+
+std::shared_ptr<const EventIndex> EventIndex::get(const std::string& dataFilename, const builder_t& build)
+{
+	std::shared_ptr<EventIndex> index(new EventIndex);
+	if(index->load(dataFilename)) {
+		return index;
+	}
+	if(InputStream::detectCompression(dataFilename) == InputStream::COMPRESSION_NONE) {
+		MappedFile file(dataFilename);
+		build(file.data(), file.size(), *index);
+	} else {
+		InputStream fin;
+		fin.exceptions(std::ios_base::failbit);
+		fin.open(dataFilename);
+		fin.exceptions(std::ios_base::badbit);
+		std::vector<char> data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+		build(data.data(), data.size(), *index);
+	}
+	try {
+		index->save(dataFilename);
+	} catch(std::ios_base::failure& e) {
+		// index is rebuilt next time
+	}
+	return index;
+}
+
+void EventIndex::buildLineIndex(const char* data, size_t size, EventIndex& index)
+{
+	const char* begin = data;
+	const char* end = begin + size;
+	const char* line = begin;
+	uint64_t lineNo = 0;
+	while(line < end) {
+		const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+		// like the readers, ignore an unterminated last line
+		if(!eol) {
+			break;
+		}
+		// the readers skip lines which are empty or contain only \r
+		const size_t length = eol - line;
+		if(length > 1 || (length == 1 && line[0] != '\r')) {
+			index.add(line - begin, lineNo, index.size());
+		}
+		line = eol + 1;
+		++lineNo;
+	}
+}
@@ -0,0 +1,344 @@
+#include "inputstream.h"
+#include "coreconfig.h"
+#include "prefetcher.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+using namespace core;
+
+namespace {
+
+/// Size of decompressed blocks handed from the helper thread to the reader
+const size_t blockSize = 256*1024;
+/// Number of decompressed blocks buffered ahead
+const size_t numBlocks = 4;
+/// Size of compressed input chunks
+const size_t chunkSize = 64*1024;
+
+/// Streaming decompressor, fills one block per call
+class Decoder {
+public:
+	Decoder(const std::string& filename) : _in(filename, std::ios_base::binary), _chunk(chunkSize)
+	{
+		if(!_in.is_open()) {
+			throw std::ios_base::failure(filename + ": Cannot open file");
+		}
+	}
+	virtual ~Decoder() {}
+	/// Decompress the next block, return false at the end of the data
+	virtual bool decode(std::vector<char>& block) = 0;
+
+protected:
+	/// Read the next compressed chunk, returns the number of bytes read
+	size_t readChunk()
+	{
+		_in.read(_chunk.data(), _chunk.size());
+		return _in.gcount();
+	}
+
+	std::ifstream _in;
+	std::vector<char> _chunk;
+};
+
+#ifdef HAVE_ZLIB
+class GzipDecoder : public Decoder {
+public:
+	GzipDecoder(const std::string& filename) : Decoder(filename), _filename(filename), _memberEnd(false)
+	{
+		std::memset(&_zs, 0, sizeof(_zs));
+		// 16 + MAX_WBITS: expect gzip header
+		if(inflateInit2(&_zs, 16 + MAX_WBITS) != Z_OK) {
+			throw std::ios_base::failure(filename + ": Cannot initialise zlib");
+		}
+	}
+
+	virtual ~GzipDecoder()
+	{
+		inflateEnd(&_zs);
+	}
+
+	virtual bool decode(std::vector<char>& block)
+	{
+		block.resize(blockSize);
+		_zs.next_out = reinterpret_cast<Bytef*>(block.data());
+		_zs.avail_out = block.size();
+		while(_zs.avail_out > 0) {
+			if(_zs.avail_in == 0) {
+				size_t numRead = readChunk();
+				if(numRead == 0) {
+					if(!_memberEnd) {
+						throw std::ios_base::failure(_filename + ": Truncated gzip data");
+					}
+					break;
+				}
+				_zs.next_in = reinterpret_cast<Bytef*>(_chunk.data());
+				_zs.avail_in = numRead;
+			}
+			int ret = inflate(&_zs, Z_NO_FLUSH);
+			if(ret == Z_STREAM_END) {
+				// files may consist of several concatenated gzip members
+				_memberEnd = true;
+				inflateReset(&_zs);
+			} else if(ret == Z_OK) {
+				_memberEnd = false;
+			} else {
+				throw std::ios_base::failure(_filename + ": Corrupt gzip data");
+			}
+		}
+		block.resize(block.size() - _zs.avail_out);
+		return !block.empty();
+	}
+
+private:
+	std::string _filename;
+	z_stream _zs;
+	bool _memberEnd;
+};
+#endif//HAVE_ZLIB
+
+#ifdef HAVE_LZMA
+class XzDecoder : public Decoder {
+public:
+	XzDecoder(const std::string& filename) : Decoder(filename), _filename(filename), _strm(LZMA_STREAM_INIT),
+	 _inputEnd(false), _streamEnd(false)
+	{
+		if(lzma_stream_decoder(&_strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+			throw std::ios_base::failure(filename + ": Cannot initialise liblzma");
+		}
+	}
+
+	virtual ~XzDecoder()
+	{
+		lzma_end(&_strm);
+	}
+
+	virtual bool decode(std::vector<char>& block)
+	{
+		block.resize(blockSize);
+		_strm.next_out = reinterpret_cast<uint8_t*>(block.data());
+		_strm.avail_out = block.size();
+		while(_strm.avail_out > 0 && !_streamEnd) {
+			if(_strm.avail_in == 0 && !_inputEnd) {
+				size_t numRead = readChunk();
+				_inputEnd = numRead == 0;
+				_strm.next_in = reinterpret_cast<const uint8_t*>(_chunk.data());
+				_strm.avail_in = numRead;
+			}
+			lzma_ret ret = lzma_code(&_strm, _inputEnd ? LZMA_FINISH : LZMA_RUN);
+			if(ret == LZMA_STREAM_END) {
+				_streamEnd = true;
+			} else if(ret != LZMA_OK) {
+				throw std::ios_base::failure(_filename + ": Corrupt or truncated xz data");
+			}
+		}
+		block.resize(block.size() - _strm.avail_out);
+		return !block.empty();
+	}
+
+private:
+	std::string _filename;
+	lzma_stream _strm;
+	bool _inputEnd;
+	bool _streamEnd;
+};
+#endif//HAVE_LZMA
+
+/** \brief Read-only streambuf serving decompressed blocks from a Prefetcher */
+class DecompressingStreambuf : public std::streambuf {
+public:
+	DecompressingStreambuf(const std::string& filename, InputStream::compression_t compression)
+	 : _filename(filename), _compression(compression), _blockStart(0)
+	{
+		restart();
+	}
+
+protected:
+	virtual int_type underflow()
+	{
+		if(gptr() < egptr()) {
+			return traits_type::to_int_type(*gptr());
+		}
+		_blockStart += _block.size();
+		// decoding errors set the badbit of the istream, they are rethrown if badbit exceptions are enabled
+		if(!_prefetcher->next(_block)) {
+			_block.clear();
+			setg(nullptr, nullptr, nullptr);
+			return traits_type::eof();
+		}
+		setg(_block.data(), _block.data(), _block.data() + _block.size());
+		return traits_type::to_int_type(*gptr());
+	}
+
+	virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		if(dir == std::ios_base::cur) {
+			return seekpos(position() + off, which);
+		}
+		if(dir == std::ios_base::beg) {
+			return seekpos(off, which);
+		}
+		// size of the uncompressed data is unknown
+		return pos_type(off_type(-1));
+	}
+
+	virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+	{
+		const off_type target = pos;
+		if(target < 0 || !(which & std::ios_base::in)) {
+			return pos_type(off_type(-1));
+		}
+		if(target == position()) {
+			return pos;
+		}
+		if(target < _blockStart) {
+			restart();
+		}
+		// decompress and drop blocks until target is in the current block
+		while(target >= _blockStart + static_cast<off_type>(_block.size())) {
+			setg(nullptr, nullptr, nullptr);
+			if(underflow() == traits_type::eof()) {
+				return target == _blockStart ? pos : pos_type(off_type(-1));
+			}
+		}
+		setg(_block.data(), _block.data() + (target - _blockStart), _block.data() + _block.size());
+		return pos;
+	}
+
+private:
+	off_type position() const
+	{
+		return _blockStart + (gptr() - eback());
+	}
+
+	void restart()
+	{
+		std::shared_ptr<Decoder> decoder;
+		switch(_compression) {
+#ifdef HAVE_ZLIB
+		case InputStream::COMPRESSION_GZIP:
+			decoder.reset(new GzipDecoder(_filename));
+			break;
+#endif
+#ifdef HAVE_LZMA
+		case InputStream::COMPRESSION_XZ:
+			decoder.reset(new XzDecoder(_filename));
+			break;
+#endif
+		default:
+			throw std::ios_base::failure(_filename + ": Compression format is not supported by this build");
+		}
+		_prefetcher.reset();
+		_block.clear();
+		_blockStart = 0;
+		setg(nullptr, nullptr, nullptr);
+		_prefetcher.reset(new Prefetcher<std::vector<char>>(numBlocks, [decoder](std::vector<char>& block) {
+			return decoder->decode(block);
+		}));
+	}
+
+	std::string _filename;
+	InputStream::compression_t _compression;
+	std::unique_ptr<Prefetcher<std::vector<char>>> _prefetcher;
+	std::vector<char> _block;
+	/// Uncompressed position of the current block
+	off_type _blockStart;
+};
+
+} // namespace
+
+InputStream::InputStream()
+ : std::istream(nullptr), _buf(), _compression(COMPRESSION_NONE)
+{
+}
+
+InputStream::InputStream(const std::string& filename)
+ : std::istream(nullptr), _buf(), _compression(COMPRESSION_NONE)
+{
+	open(filename);
+}
+
+InputStream::InputStream(InputStream&& other)
+ : std::istream(std::move(other)), _buf(std::move(other._buf)), _compression(other._compression)
+{
+	set_rdbuf(_buf.get());
+	other.set_rdbuf(nullptr);
+}
+
+InputStream& InputStream::operator=(InputStream&& other)
+{
+	std::istream::operator=(std::move(other));
+	std::swap(_buf, other._buf);
+	std::swap(_compression, other._compression);
+	set_rdbuf(_buf.get());
+	other.set_rdbuf(other._buf.get());
+	return *this;
+}
+
+InputStream::~InputStream()
+{
+	// the streambuf is destroyed before std::istream, which does not touch it in its destructor
+}
+
+InputStream::compression_t InputStream::detectCompression(const std::string& filename)
+{
+	std::ifstream fin(filename, std::ios_base::binary);
+	unsigned char magic[6] = {0};
+	fin.read(reinterpret_cast<char*>(magic), sizeof(magic));
+	const size_t numRead = fin.gcount();
+	if(numRead >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		return COMPRESSION_GZIP;
+	}
+	const unsigned char xzMagic[6] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+	if(numRead >= 6 && std::memcmp(magic, xzMagic, 6) == 0) {
+		return COMPRESSION_XZ;
+	}
+	const unsigned char zstdMagic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+	if(numRead >= 4 && std::memcmp(magic, zstdMagic, 4) == 0) {
+		return COMPRESSION_ZSTD;
+	}
+	return COMPRESSION_NONE;
+}
+
+void InputStream::open(const std::string& filename)
+{
+	close();
+	_compression = detectCompression(filename);
+	if(_compression == COMPRESSION_NONE) {
+		std::unique_ptr<std::filebuf> buf(new std::filebuf);
+		if(!buf->open(filename, std::ios_base::in | std::ios_base::binary)) {
+			setstate(std::ios_base::failbit);
+			return;
+		}
+		_buf = std::move(buf);
+	} else {
+		try {
+			_buf.reset(new DecompressingStreambuf(filename, _compression));
+		} catch(std::ios_base::failure& e) {
+			std::cerr << e.what() << std::endl;
+			setstate(std::ios_base::failbit);
+			return;
+		}
+	}
+	set_rdbuf(_buf.get());
+	clear();
+}
+
+bool InputStream::is_open() const
+{
+	return _buf != nullptr;
+}
+
+void InputStream::close()
+{
+	set_rdbuf(nullptr);
+	_buf.reset();
+	_compression = COMPRESSION_NONE;
+}
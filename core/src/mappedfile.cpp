@@ -0,0 +1,52 @@
+#include "mappedfile.h"
+#include <ios>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace core;
+
+MappedFile::MappedFile(const std::string& filename)
+ : _filename(filename), _data(nullptr), _size(0)
+{
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		throw std::ios_base::failure(filename + ": " + strerror(errno));
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		int err = errno;
+		::close(fd);
+		throw std::ios_base::failure(filename + ": " + strerror(err));
+	}
+	_size = st.st_size;
+	// mmap() of zero bytes fails, empty files simply have no data
+	if(_size > 0) {
+		void* addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(addr == MAP_FAILED) {
+			int err = errno;
+			::close(fd);
+			throw std::ios_base::failure(filename + ": " + strerror(err));
+		}
+		_data = static_cast<const char*>(addr);
+	}
+	// the mapping stays valid after closing the descriptor
+	::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if(_data) {
+		munmap(const_cast<char*>(_data), _size);
+	}
+}
+
+void MappedFile::adviseSequential() const noexcept
+{
+	if(_data) {
+		madvise(const_cast<char*>(_data), _size, MADV_SEQUENTIAL);
+	}
+}
@@ -2,11 +2,22 @@
 #include "mergedanalysis.h"
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <thread>
+#include <future>
+#include <stdexcept>
+#include <TBranch.h>
+#include <TDirectory.h>
+#include <TROOT.h>
+#include <TSystem.h>
+#include <RVersion.h>
+#include "chunkpipeline.h"
+#include "runsnapshot.h"
 
 using namespace core;
 
 MergedAnalysis::MergedAnalysis() :
- Analysis(), _runlist(_config)
+ Analysis(), _parallelRuns(false), _numRunThreads(1), _treeCacheSize(64), _runlist(_config)
 {
 	getOptionsDescription().add_options()
 		("runlist,l", po::value<std::string>(), "Per-run information table")
@@ -15,9 +26,6 @@ MergedAnalysis::MergedAnalysis() :
 
 MergedAnalysis::~MergedAnalysis()
 {
-	for(const auto& data: _runData) {
-		data.file->Close();
-	}
 }
 
 void MergedAnalysis::init(const po::variables_map& vm)
@@ -25,45 +33,40 @@ void MergedAnalysis::init(const po::variables_map& vm)
 	auto runs = vm["run"].as<std::vector<int>>();
 	_allRunIds = runs;
 	std::cout << "Init system" << std::endl;
+	enableImplicitMT();
+	try {
+		_treeCacheSize = _config.get<size_t>("tree_cache_size");
+	} catch(CfgParse::no_variable_error& e) {
+	}
+	try {
+		_numRunThreads = _config.get<size_t>("run_threads");
+	} catch(CfgParse::no_variable_error& e) {
+	}
+	if(_numRunThreads == 0) {
+		_numRunThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+#if ROOT_VERSION_CODE < ROOT_VERSION(6,0,0)
+	// gDirectory is shared by all threads in ROOT 5, workers opening files would race on it
+	if(_parallelRuns && _numRunThreads > 1) {
+		std::cerr << "Ignoring run_threads = " << _numRunThreads << ", processing runs in parallel requires ROOT 6"
+		          << std::endl;
+		_numRunThreads = 1;
+	}
+#endif
 	for(auto runId: runs) {
-		run_data_t data { runId, nullptr, nullptr, nullptr };
 		_currentRunId = runId;
 		_config.setVariable("MpaRun", getMpaIdPadded(runId));
-		auto filename = _config.getVariable("testbeam_data");
-		data.file = new TFile(filename.c_str(), "readonly");
-		if(!data.file || data.file->IsZombie()) {
-			std::ostringstream sstr;
-			sstr << "Cannot open ROOT file '" << filename << "' for run " << runId;
-			throw std::runtime_error(sstr.str().c_str());
-		}
-		data.file->GetObject("data", data.tree);
-		if(!data.tree) {
+		_runFilenames.push_back(_config.getVariable("testbeam_data"));
+	}
+	// the runs are opened when they are due, report missing local files before processing the first one,
+	// remote files (root://, http:// etc.) are left to openRun()
+	for(size_t i = 0; i < runs.size(); ++i) {
+		if(_runFilenames[i].find("://") == std::string::npos &&
+		   gSystem->AccessPathName(_runFilenames[i].c_str(), kReadPermission)) {
 			std::ostringstream sstr;
-			sstr << "Cannot find data tree in ROOT file '" << filename << "' for run " << runId;
+			sstr << "Cannot read data file '" << _runFilenames[i] << "' for run " << runs[i];
 			throw std::runtime_error(sstr.str().c_str());
 		}
-		data.telescopeData = new TelescopeData*;
-		*data.telescopeData = nullptr;
-		data.telescopeHits = new TelescopeHits*;
-		*data.telescopeHits = nullptr;
-		data.tree->SetBranchAddress("telescope", data.telescopeData);
-		data.tree->SetBranchAddress("telhits", data.telescopeHits);
-		assert(*data.telescopeData != nullptr);
-		assert(*data.telescopeHits != nullptr);
-		for(int mpa = 1; mpa <= 6; ++mpa) {
-			std::ostringstream name;
-			name << "mpa_" << mpa;
-			if(data.tree->FindBranch(name.str().c_str())) {
-				mpa_data_t mpaData { name.str(), mpa, new MpaData* };
-				*(mpaData.data) = nullptr;
-				data.mpaData.push_back(mpaData);
-			}
-		}
-		for(const auto& mpaData: data.mpaData) {
-			data.tree->SetBranchAddress(mpaData.name.c_str(), mpaData.data);
-			assert(mpaData.data != nullptr);
-		}
-		_runData.push_back(data);
 	}
 	if(vm.count("runlist")) {
 		try {
@@ -75,19 +78,296 @@ void MergedAnalysis::init(const po::variables_map& vm)
 	}
 }
 
+run_data_t MergedAnalysis::openRun(int runId, const std::string& filename) const
+{
+	if(RunSnapshot::isFlatFile(filename)) {
+		return openFlatRun(runId, filename);
+	}
+	// opening a file changes gDirectory, which the analyses expect to be their output file
+	TDirectory* directory = gDirectory;
+	run_data_t data;
+	try {
+		data = openDataTree(runId, filename);
+	} catch(...) {
+		directory->cd();
+		throw;
+	}
+	directory->cd();
+	disableUnusedBranches(data.tree);
+	disableUnusedPlanes(data.tree);
+	setupCache(data.tree);
+	return data;
+}
+
+run_data_t MergedAnalysis::openDataTree(int runId, const std::string& filename)
+{
+	run_data_t data { runId, nullptr, nullptr, nullptr, nullptr };
+	data.file = new TFile(filename.c_str(), "readonly");
+	if(!data.file || data.file->IsZombie()) {
+		delete data.file;
+		std::ostringstream sstr;
+		sstr << "Cannot open ROOT file '" << filename << "' for run " << runId;
+		throw std::runtime_error(sstr.str().c_str());
+	}
+	data.file->GetObject("data", data.tree);
+	if(!data.tree) {
+		delete data.file;
+		std::ostringstream sstr;
+		sstr << "Cannot find data tree in ROOT file '" << filename << "' for run " << runId;
+		throw std::runtime_error(sstr.str().c_str());
+	}
+	data.telescopeData = new TelescopeData*;
+	*data.telescopeData = nullptr;
+	data.telescopeHits = new TelescopeHits*;
+	*data.telescopeHits = nullptr;
+	data.tree->SetBranchAddress("telescope", data.telescopeData);
+	data.tree->SetBranchAddress("telhits", data.telescopeHits);
+	assert(*data.telescopeData != nullptr);
+	assert(*data.telescopeHits != nullptr);
+	for(int mpa = 1; mpa <= 6; ++mpa) {
+		std::ostringstream name;
+		name << "mpa_" << mpa;
+		if(data.tree->FindBranch(name.str().c_str())) {
+			mpa_data_t mpaData { name.str(), mpa, new MpaData* };
+			*(mpaData.data) = nullptr;
+			data.mpaData.push_back(mpaData);
+		}
+	}
+	for(const auto& mpaData: data.mpaData) {
+		data.tree->SetBranchAddress(mpaData.name.c_str(), mpaData.data);
+		assert(mpaData.data != nullptr);
+	}
+	return data;
+}
+
+run_data_t MergedAnalysis::openFlatRun(int runId, const std::string& filename) const
+{
+	if(_requiredBranches.empty() ||
+	   std::find(_requiredBranches.begin(), _requiredBranches.end(), "telescope") != _requiredBranches.end()) {
+		std::ostringstream sstr;
+		sstr << "Cannot read flat file '" << filename << "' for run " << runId
+		     << ", the analysis requires the telescope clusters";
+		throw std::runtime_error(sstr.str().c_str());
+	}
+	run_data_t data { runId, nullptr, nullptr, nullptr, nullptr };
+	std::unique_ptr<RunSnapshot> snapshot(new RunSnapshot(filename));
+	// the objects are filled by getEntry(), there is no tree owning them
+	data.telescopeData = new TelescopeData*(new TelescopeData);
+	data.telescopeHits = new TelescopeHits*(new TelescopeHits);
+	for(size_t i = 0; i < snapshot->getNumMpa(); ++i) {
+		std::ostringstream name;
+		name << "mpa_" << snapshot->getMpaIndex(i);
+		mpa_data_t mpaData { name.str(), snapshot->getMpaIndex(i), new MpaData*(new MpaData) };
+		data.mpaData.push_back(mpaData);
+	}
+	data.snapshot = snapshot.release();
+	return data;
+}
+
+void MergedAnalysis::closeRun(run_data_t& data)
+{
+	if(data.file) {
+		// the tree and the objects allocated for the branch addresses are deleted with the file
+		data.file->Close();
+		delete data.file;
+		data.file = nullptr;
+		data.tree = nullptr;
+	} else if(data.snapshot) {
+		// flat run, see openFlatRun()
+		delete *data.telescopeData;
+		delete *data.telescopeHits;
+		for(auto& mpaData: data.mpaData) {
+			delete *mpaData.data;
+		}
+		delete data.snapshot;
+		data.snapshot = nullptr;
+	} else {
+		return;
+	}
+	delete data.telescopeData;
+	delete data.telescopeHits;
+	data.telescopeData = nullptr;
+	data.telescopeHits = nullptr;
+	for(auto& mpaData: data.mpaData) {
+		delete mpaData.data;
+	}
+	data.mpaData.clear();
+}
+
 void MergedAnalysis::run(const po::variables_map& vm)
 {
 	init(vm);
-	_currentRunId = _runData[0].runId;
+	_currentRunId = _allRunIds[0];
 	_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
 	_runlist.loadRun();
 	init();
-	for(const auto& data: _runData) {
+	if(_parallelRuns && _numRunThreads > 1) {
+		runParallel();
+	} else {
+		runSequential();
+	}
+	finalize();
+}
+
+void MergedAnalysis::runSequential()
+{
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+	ROOT::EnableThreadSafety();
+	const std::launch policy = std::launch::async;
+#else
+	// histograms created by the analysis could end up in a file opened by another thread
+	const std::launch policy = std::launch::deferred;
+#endif
+	const bool background = policy == std::launch::async;
+	auto prefetch = [this](size_t i) {
+		run_data_t data = openRun(_allRunIds[i], _runFilenames[i]);
+		// the first entry fills the cache with the first cluster of baskets
+		if(data.tree) {
+			data.tree->GetEntry(0);
+		}
+		return data;
+	};
+	std::future<run_data_t> next;
+	if(!_allRunIds.empty()) {
+		next = std::async(policy, prefetch, 0);
+	}
+	for(size_t i = 0; i < _allRunIds.size(); ++i) {
+		run_data_t data = next.get();
+		if(i + 1 < _allRunIds.size()) {
+			next = std::async(policy, prefetch, i + 1);
+		}
 		_currentRunId = data.runId;
 		_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
-		run(data);
+		try {
+			run(data);
+		} catch(...) {
+			closeRun(data);
+			// the next run is still being opened, a deferred open has not started yet
+			if(background && next.valid()) {
+				try {
+					run_data_t pending = next.get();
+					closeRun(pending);
+				} catch(...) {
+				}
+			}
+			throw;
+		}
+		closeRun(data);
 	}
-	finalize();
+}
+
+void MergedAnalysis::runParallel()
+{
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+	ROOT::EnableThreadSafety();
+#endif
+	// each worker keeps one run open while processing it
+	ChunkPipeline<std::unique_ptr<RunResult>> pipeline(_allRunIds.size(), _numRunThreads,
+		[this](size_t i, std::unique_ptr<RunResult>& result) {
+			run_data_t data = openRun(_allRunIds[i], _runFilenames[i]);
+			try {
+				result = processRun(data);
+			} catch(...) {
+				closeRun(data);
+				throw;
+			}
+			closeRun(data);
+		});
+	std::unique_ptr<RunResult> result;
+	for(size_t i = 0; pipeline.next(result); ++i) {
+		_currentRunId = _allRunIds[i];
+		_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
+		std::cout << "Merge run " << _currentRunId << std::endl;
+		if(result) {
+			mergeRun(_currentRunId, *result);
+		}
+	}
+}
+
+std::unique_ptr<MergedAnalysis::RunResult> MergedAnalysis::processRun(const run_data_t& run)
+{
+	throw std::logic_error("The analysis does not support processing runs in parallel");
+}
+
+void MergedAnalysis::mergeRun(int runId, RunResult& result)
+{
+}
+
+void MergedAnalysis::disableUnusedBranches(TTree* tree) const
+{
+	if(_requiredBranches.empty()) {
+		return;
+	}
+	tree->SetBranchStatus("*", 0);
+	for(const auto& name: _requiredBranches) {
+		TBranch* branch = tree->GetBranch(name.c_str());
+		if(!branch) {
+			continue;
+		}
+		tree->SetBranchStatus((name + "*").c_str(), 1);
+		// sub-branches of split branches may be named without the prefix
+		TIter next(branch->GetListOfBranches());
+		while(TObject* obj = next()) {
+			tree->SetBranchStatus((std::string(obj->GetName()) + "*").c_str(), 1);
+		}
+	}
+}
+
+void MergedAnalysis::disableUnusedPlanes(TTree* tree) const
+{
+	TBranch* telhits = tree->GetBranch("telhits");
+	if(_requiredPlanes.empty() || !telhits) {
+		return;
+	}
+	// sub-branches are named "telhits.p1" or "p1", depending on how the tree was split
+	TIter next(telhits->GetListOfBranches());
+	while(TObject* obj = next()) {
+		std::string name(obj->GetName());
+		std::string plane = name;
+		if(plane.compare(0, 8, "telhits.") == 0) {
+			plane = plane.substr(8);
+		}
+		plane = plane.substr(0, plane.find('.'));
+		if(std::find(_requiredPlanes.begin(), _requiredPlanes.end(), plane) == _requiredPlanes.end()) {
+			tree->SetBranchStatus((name + "*").c_str(), 0);
+		}
+	}
+}
+
+void MergedAnalysis::setupCache(TTree* tree) const
+{
+	tree->SetCacheSize(_treeCacheSize * 1024 * 1024);
+	if(_treeCacheSize == 0) {
+		return;
+	}
+	// only the baskets of the enabled branches are prefetched, no learning phase needed
+	if(_requiredBranches.empty()) {
+		tree->AddBranchToCache("*", true);
+	}
+	for(const auto& name: _requiredBranches) {
+		if(tree->GetBranch(name.c_str())) {
+			tree->AddBranchToCache(name.c_str(), true);
+		}
+	}
+	tree->StopCacheLearningPhase();
+}
+
+void MergedAnalysis::enableImplicitMT()
+{
+	size_t numThreads;
+	try {
+		numThreads = _config.get<size_t>("root_threads");
+	} catch(CfgParse::no_variable_error& e) {
+		return;
+	}
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+	if(!ROOT::IsImplicitMTEnabled()) {
+		ROOT::EnableImplicitMT(numThreads);
+	}
+#else
+	std::cerr << "Ignoring root_threads = " << numThreads << ", implicit multi-threading requires ROOT 6.08"
+	          << std::endl;
+#endif
 }
 
 bool MergedAnalysis::multirunConsistencyCheck(const std::string& argv0, const po::variables_map& vm)
@@ -0,0 +1,145 @@
+#include "mpabinarystreamreader.h"
+#include <fstream>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace core;
+
+static_assert(sizeof(MpaBinaryStreamReader::record_t) == 100, "Record must match PlainRippleCounter layout");
+static_assert(sizeof(MpaBinaryStreamReader::file_header_t) == 24, "Unexpected padding in file header");
+
+namespace {
+const char fileMagic[8] = {'M', 'P', 'A', 'C', 'N', 'T', 0, 0};
+const uint32_t fileVersion = 1;
+}
+
+const size_t MpaBinaryStreamReader::numPixels;
+
+MpaBinaryStreamReader::mpareader::mpareader(const std::string& filename)
+ : reader(filename), _file(new MappedFile(filename)), _records(nullptr), _numEvents(0), _numEventsRead(0)
+{
+	file_header_t header;
+	if(_file->size() < sizeof(header)) {
+		throw std::ios_base::failure(filename + ": File too short for binary counter header");
+	}
+	std::memcpy(&header, _file->data(), sizeof(header));
+	if(std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0) {
+		throw std::ios_base::failure(filename + ": Not a binary counter file");
+	}
+	if(header.version != fileVersion || header.recordSize != sizeof(record_t)) {
+		throw std::ios_base::failure(filename + ": Unsupported binary counter file version");
+	}
+	if((_file->size() - sizeof(header)) / sizeof(record_t) < header.numEvents) {
+		throw std::ios_base::failure(filename + ": Binary counter file is truncated");
+	}
+	_records = _file->data() + sizeof(header);
+	_numEvents = header.numEvents;
+	_file->adviseSequential();
+	_currentEvent.bunchCrossing.assign(1, 0);
+	_currentEvent.data.resize(numPixels);
+}
+
+bool MpaBinaryStreamReader::mpareader::next()
+{
+	if(_numEventsRead >= _numEvents) {
+		return true;
+	}
+	// records are not necessarily aligned, copy before accessing the values
+	record_t record;
+	std::memcpy(&record, _records + _numEventsRead*sizeof(record_t), sizeof(record));
+	for(size_t i = 0; i < numPixels; ++i) {
+		_currentEvent.data[i] = record.pixels[i];
+	}
+	_currentEvent.eventNumber = _numEventsRead++;
+	return false;
+}
+
+bool MpaBinaryStreamReader::mpareader::seek(size_t eventIndex)
+{
+	// next() would skip to the start of the filter range
+	if(eventIndex >= _numEvents || isBeforeRange(eventIndex)) {
+		return false;
+	}
+	_numEventsRead = eventIndex;
+	return !next();
+}
+
+BaseSensorStreamReader::reader* MpaBinaryStreamReader::mpareader::clone() const
+{
+	// shares the mapping
+	return new mpareader(*this);
+}
+
+BaseSensorStreamReader::reader* MpaBinaryStreamReader::getReader(const std::string& filename) const
+{
+	auto read = new mpareader(filename);
+	// empty file, e.g. converted from an empty part of a run
+	if(read->next()) {
+		delete read;
+		return nullptr;
+	}
+	return read;
+}
+
+BaseSensorStreamReader::reader* MpaBinaryStreamReader::getReaderAt(const std::string& filename,
+	std::shared_ptr<const EventIndex> index, size_t firstEvent) const
+{
+	auto read = new mpareader(filename);
+	if(!read->seek(firstEvent)) {
+		delete read;
+		return nullptr;
+	}
+	return read;
+}
+
+std::shared_ptr<const EventIndex> MpaBinaryStreamReader::buildIndex(const std::string& filename) const
+{
+	mpareader read(filename);
+	auto index = std::make_shared<EventIndex>();
+	for(uint64_t i = 0; i < read.getNumEvents(); ++i) {
+		index->add(sizeof(file_header_t) + i*sizeof(record_t), i, i);
+	}
+	return index;
+}
+
+void MpaBinaryStreamReader::probe() const
+{
+	// mapping the file and validating the header is cheap, no record is read
+	mpareader read(getFilename());
+}
+
+size_t MpaBinaryStreamReader::write(const BaseSensorStreamReader& source, const std::string& filename)
+{
+	std::ofstream fout;
+	fout.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+	fout.open(filename, std::ios_base::binary | std::ios_base::trunc);
+	file_header_t header;
+	std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.recordSize = sizeof(record_t);
+	header.numEvents = 0;
+	// number of events is not known yet, header is rewritten at the end
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	record_t record;
+	record.header = 0;
+	for(const auto& event: source) {
+		if(event.data.size() != numPixels) {
+			throw std::out_of_range("Event " + std::to_string(event.eventNumber) + " has "
+				+ std::to_string(event.data.size()) + " counters instead of 48");
+		}
+		for(size_t i = 0; i < numPixels; ++i) {
+			if(event.data[i] < 0 || event.data[i] > std::numeric_limits<uint16_t>::max()) {
+				throw std::out_of_range("Counter value " + std::to_string(event.data[i]) + " of event "
+					+ std::to_string(event.eventNumber) + " does not fit into 16 bits");
+			}
+			record.pixels[i] = event.data[i];
+		}
+		fout.write(reinterpret_cast<const char*>(&record), sizeof(record));
+		++header.numEvents;
+	}
+	fout.seekp(0);
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fout.close();
+	return header.numEvents;
+}
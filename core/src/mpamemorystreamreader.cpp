@@ -1,19 +1,24 @@
 
 #include "mpamemorystreamreader.h"
 #include <cassert>
-#include <regex.h>
-#include <bitset>
+#include <cstring>
 #include <iostream>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace core;
 
 MpaMemoryStreamReader::mpareader::mpareader(const std::string& filename, size_t seek)
- : reader(filename), _fin(), _numEventsRead(0)
+ : reader(filename), _fin(), _line(), _numEventsRead(0)
 {
 	open(seek);
-	if(seek == 0) {
-		next();
-	}
+}
+
+MpaMemoryStreamReader::mpareader::mpareader(const std::string& filename, std::shared_ptr<const EventIndex> index,
+	size_t firstEvent)
+ : reader(filename), _fin(), _line(), _numEventsRead(firstEvent), _index(index)
+{
 }
 
 MpaMemoryStreamReader::mpareader::~mpareader()
@@ -21,64 +26,199 @@ MpaMemoryStreamReader::mpareader::~mpareader()
 	_fin.close();
 }
 
-bool MpaMemoryStreamReader::mpareader::next()
+bool MpaMemoryStreamReader::mpareader::readLine()
 {
+	// open lazily at the position of the next event
+	if(_index && !_fin.is_open()) {
+		if(_numEventsRead >= _index->size()) {
+			return false;
+		}
+		open(_index->getOffset(_numEventsRead));
+	}
 	// last read reached EOF, so we are an end-iterator now
 	if(!_fin.good()) {
-		return true;
+		return false;
 	}
-	std::string line;
 	// try to read only non-empty lines
-	while(std::getline(_fin, line)) {
-		if(line == "\r" || line == "")
+	while(std::getline(_fin, _line)) {
+		if(_line == "\r" || _line == "")
 			continue;
 		break;
 	}
 	// empty line(s) at end of file -> reached end!
-	if(!_fin.good()) {
+	return _fin.good();
+}
+
+bool MpaMemoryStreamReader::mpareader::next()
+{
+	// the event number is the line number, so lines before the filter range are not decoded
+	if(!readLine()) {
 		return true;
 	}
+	while(isBeforeRange(_numEventsRead)) {
+		++_numEventsRead;
+		if(!readLine()) {
+			return true;
+		}
+	}
 
-	_currentEvent.data.clear();
-	_currentEvent.data.resize(48, 0);
 	_currentEvent.bunchCrossing.clear();
 	_currentEvent.eventNumber = _numEventsRead++;
+	uint64_t hits = decodeLine(_line.c_str(), _line.size(), _currentEvent.bunchCrossing);
+	_currentEvent.data.resize(48);
+	for(size_t i = 0; i < 48; ++i) {
+		_currentEvent.data[i] = (hits >> i) & 1;
+	}
+	return false;
+}
 
-	regex_t regex;
-	// possible optimization: do not recompile regex all the time...
-	int ret = regcomp(&regex, "'1{8}([01]{16})([01]{48})'", REG_EXTENDED);
-	size_t offset = 0;
-	regmatch_t m[3];
-	while((ret = regexec(&regex, line.c_str()+offset, 3, m, 0)) == 0) {
-		auto bxId = line.substr(offset+m[1].rm_so, m[1].rm_eo-m[1].rm_so);
-		auto pixelmap = line.substr(offset+m[2].rm_so, m[2].rm_eo - m[2].rm_so);
-		assert(bxId.size() == 16);
-		assert(pixelmap.size() == 48);
-		_currentEvent.bunchCrossing.push_back(std::stoi(bxId, nullptr, 2));
-		for(size_t i = 0; i < pixelmap.size(); ++i) {
-			int new_idx = i;
-			if(i >= 16 && i <= 31) {
-				new_idx = 47 - i;
-			}
-			if(pixelmap[i] == '1') {
-				_currentEvent.data[new_idx] = 1;
+bool MpaMemoryStreamReader::mpareader::seek(size_t eventIndex)
+{
+	if(!_index) {
+		return reader::seek(eventIndex);
+	}
+	// next() would skip to the start of the filter range
+	if(eventIndex >= _index->size() || isBeforeRange(eventIndex)) {
+		return false;
+	}
+	if(_fin.is_open()) {
+		_fin.clear();
+		_fin.seekg(_index->getOffset(eventIndex));
+	} else {
+		open(_index->getOffset(eventIndex));
+	}
+	_numEventsRead = eventIndex;
+	return !next();
+}
+
+bool MpaMemoryStreamReader::mpareader::nextBatch(batch_t& batch, size_t maxEvents)
+{
+	// filtered events are only known after decoding
+	if(getFilter()) {
+		return reader::nextBatch(batch, maxEvents);
+	}
+	if(maxEvents == 0) {
+		return false;
+	}
+	batch.push_back(_currentEvent);
+	// decode the following lines directly into the batch
+	for(size_t i = 1; i < maxEvents; ++i) {
+		if(!readLine()) {
+			return true;
+		}
+		uint64_t hits = decodeLine(_line.c_str(), _line.size(), batch.bunchCrossing);
+		const size_t offset = batch.data.size();
+		batch.data.resize(offset + 48);
+		for(size_t pixel = 0; pixel < 48; ++pixel) {
+			batch.data[offset + pixel] = (hits >> pixel) & 1;
+		}
+		batch.endEvent(_numEventsRead++);
+	}
+	return next();
+}
+
+namespace {
+
+/// Lookup table reversing the bit order of a byte, built once on first use
+struct bit_reverse_table_t
+{
+	bit_reverse_table_t()
+	{
+		for(unsigned int i = 0; i < 256; ++i) {
+			uint8_t r = 0;
+			for(unsigned int bit = 0; bit < 8; ++bit) {
+				if(i & (1 << bit)) {
+					r |= 1 << (7 - bit);
+				}
 			}
+			table[i] = r;
 		}
-		if(offset >= line.length()) {
-			break;
+	}
+
+	uint16_t reverse16(uint16_t v) const
+	{
+		return (table[v & 0xff] << 8) | table[v >> 8];
+	}
+
+	uint8_t table[256];
+};
+
+const bit_reverse_table_t& bitReverse()
+{
+	static const bit_reverse_table_t table;
+	return table;
+}
+
+/** Convert 64 ASCII '0'/'1' characters into an integer, character i becomes bit i.
+ *
+ * Returns false if any character is not a binary digit.
+ */
+inline bool decodeBitField(const char* str, uint64_t& bits)
+{
+	bits = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_set1_epi8('0');
+	const __m128i one = _mm_set1_epi8('1');
+	for(size_t chunk = 0; chunk < 4; ++chunk) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + 16*chunk));
+		__m128i isOne = _mm_cmpeq_epi8(v, one);
+		__m128i isBinary = _mm_or_si128(isOne, _mm_cmpeq_epi8(v, zero));
+		if(_mm_movemask_epi8(isBinary) != 0xffff) {
+			return false;
 		}
-		offset += m[0].rm_eo;
+		bits |= static_cast<uint64_t>(_mm_movemask_epi8(isOne)) << (16*chunk);
 	}
-	regfree(&regex);
-	return false;
+#else
+	for(size_t i = 0; i < 64; ++i) {
+		if(str[i] == '1') {
+			bits |= uint64_t(1) << i;
+		} else if(str[i] != '0') {
+			return false;
+		}
+	}
+#endif
+	return true;
 }
 
+} // namespace
+
+uint64_t MpaMemoryStreamReader::decodeLine(const char* line, size_t length, std::vector<int>& bunchCrossing)
+{
+	// a memory slot is '11111111' + 16 bit bunch crossing id + 48 bit pixel map + '
+	static const size_t slotLength = 1 + 8 + 64 + 1;
+	const auto& reverse = bitReverse();
+	const char* end = line + length;
+	const char* p = line;
+	uint64_t hits = 0;
+	while(end - p >= static_cast<ptrdiff_t>(slotLength)) {
+		p = static_cast<const char*>(std::memchr(p, '\'', end - p - slotLength + 1));
+		if(!p) {
+			break;
+		}
+		uint64_t bits;
+		if(std::memcmp(p + 1, "11111111", 8) != 0 ||
+		   p[slotLength - 1] != '\'' ||
+		   !decodeBitField(p + 9, bits)) {
+			++p;
+			continue;
+		}
+		// the bunch crossing id is stored MSB first
+		bunchCrossing.push_back(reverse.reverse16(bits & 0xffff));
+		hits |= bits >> 16;
+		p += slotLength;
+	}
+	// pixels 16-31 (second row) are read out in reversed order
+	uint64_t row = (hits >> 16) & 0xffff;
+	hits = (hits & ~(uint64_t(0xffff) << 16)) | (uint64_t(reverse.reverse16(row)) << 16);
+	return hits;
+}
 
 void MpaMemoryStreamReader::mpareader::open(size_t seek)
 {
 	_fin.exceptions(std::ios_base::failbit);
 	_fin.open(getFilename());
-	_fin.exceptions(std::ios_base::goodbit);
+	// throw on corrupt or truncated compressed data, the end of the file still just ends the stream
+	_fin.exceptions(std::ios_base::badbit);
 	if(seek) {
 		_fin.seekg(seek);
 	}
@@ -86,6 +226,11 @@ void MpaMemoryStreamReader::mpareader::open(size_t seek)
 
 BaseSensorStreamReader::reader* MpaMemoryStreamReader::mpareader::clone() const
 {
+	if(_index) {
+		auto newReader = new mpareader(getFilename(), _index, _numEventsRead);
+		newReader->_currentEvent = _currentEvent;
+		return newReader;
+	}
 	auto newReader = new mpareader(getFilename(), _fin.tellg());
 	newReader->_currentEvent = _currentEvent;
 	newReader->_numEventsRead = _numEventsRead;
@@ -94,5 +239,30 @@ BaseSensorStreamReader::reader* MpaMemoryStreamReader::mpareader::clone() const
 
 BaseSensorStreamReader::reader* MpaMemoryStreamReader::getReader(const std::string& filename) const
 {
-	return new mpareader(filename);
+	auto read = new mpareader(filename);
+	// empty file
+	if(read->next()) {
+		delete read;
+		return nullptr;
+	}
+	return read;
+}
+
+BaseSensorStreamReader::reader* MpaMemoryStreamReader::getReaderAt(const std::string& filename,
+	std::shared_ptr<const EventIndex> index, size_t firstEvent) const
+{
+	if(!index) {
+		return BaseSensorStreamReader::getReaderAt(filename, index, firstEvent);
+	}
+	if(firstEvent >= index->size()) {
+		return nullptr;
+	}
+	auto read = new mpareader(filename, index, firstEvent);
+	read->next();
+	return read;
+}
+
+std::shared_ptr<const EventIndex> MpaMemoryStreamReader::buildIndex(const std::string& filename) const
+{
+	return EventIndex::get(filename, EventIndex::buildLineIndex);
 }
@@ -1,17 +1,20 @@
 
 #include "mpastreamreader.h"
 #include <cassert>
-#include <regex.h>
+#include <cstring>
 
 using namespace core;
 
 MPAStreamReader::mpareader::mpareader(const std::string& filename, size_t seek)
-	: reader(filename), _fin(), _numEventsRead(0)
+	: reader(filename), _fin(), _line(), _numEventsRead(0)
 {
 	open(seek);
-	if(seek == 0) {
-		next();
-	}
+}
+
+MPAStreamReader::mpareader::mpareader(const std::string& filename, std::shared_ptr<const EventIndex> index,
+	size_t firstEvent)
+ : reader(filename), _fin(), _line(), _numEventsRead(firstEvent), _index(index)
+{
 }
 
 MPAStreamReader::mpareader::~mpareader()
@@ -19,51 +22,127 @@ MPAStreamReader::mpareader::~mpareader()
 	_fin.close();
 }
 
-bool MPAStreamReader::mpareader::next()
+bool MPAStreamReader::mpareader::readLine()
 {
+	// open lazily at the position of the next event
+	if(_index && !_fin.is_open()) {
+		if(_numEventsRead >= _index->size()) {
+			return false;
+		}
+		open(_index->getOffset(_numEventsRead));
+	}
 	// last read reached EOF, so we are an end-iterator now
 	if(!_fin.good()) {
-		return true;
+		return false;
 	}
-	std::string line;
-	// try to read only non-empty lines
-	while(std::getline(_fin, line)) {
-		if(line == "\r" || line == "")
+	// try to read only non-empty lines, _line keeps its capacity between events
+	while(std::getline(_fin, _line)) {
+		if(_line == "\r" || _line == "")
 			continue;
 		break;
 	}
 	// empty line(s) at end of file -> reached end!
-	if(!_fin.good()) {
+	return _fin.good();
+}
+
+bool MPAStreamReader::mpareader::next()
+{
+	// the event number is the line number, so lines before the filter range are not decoded
+	if(!readLine()) {
 		return true;
 	}
+	while(isBeforeRange(_numEventsRead)) {
+		++_numEventsRead;
+		if(!readLine()) {
+			return true;
+		}
+	}
 
-	_currentEvent.data.clear();
 	_currentEvent.eventNumber = _numEventsRead++;
-	_currentEvent.bunchCrossing.clear();
-	_currentEvent.bunchCrossing.push_back(0);
-	regex_t regex;
-	// possible optimization: do not recompile regex all the time...
-	int ret = regcomp(&regex, "[0-9]+", REG_EXTENDED);
-	size_t offset = 0;
-	regmatch_t m[1];
-	while((ret = regexec(&regex, line.c_str()+offset, 1, m, 0)) == 0) {
-		auto counter = std::stoi(line.substr(offset+m[0].rm_so, m[0].rm_eo - m[0].rm_so));
-		_currentEvent.data.push_back(counter);
-		if(offset >= line.length()) {
-			break;
+	_currentEvent.bunchCrossing.assign(1, 0);
+	parseCounterLine(_line.data(), _line.data() + _line.size(), _currentEvent.data);
+	return false;
+}
+
+bool MPAStreamReader::mpareader::seek(size_t eventIndex)
+{
+	if(!_index) {
+		return reader::seek(eventIndex);
+	}
+	// next() would skip to the start of the filter range
+	if(eventIndex >= _index->size() || isBeforeRange(eventIndex)) {
+		return false;
+	}
+	if(_fin.is_open()) {
+		_fin.clear();
+		_fin.seekg(_index->getOffset(eventIndex));
+	} else {
+		open(_index->getOffset(eventIndex));
+	}
+	_numEventsRead = eventIndex;
+	return !next();
+}
+
+bool MPAStreamReader::mpareader::nextBatch(batch_t& batch, size_t maxEvents)
+{
+	// filtered events are only known after decoding
+	if(getFilter()) {
+		return reader::nextBatch(batch, maxEvents);
+	}
+	if(maxEvents == 0) {
+		return false;
+	}
+	batch.push_back(_currentEvent);
+	// decode the following lines directly into the batch
+	for(size_t i = 1; i < maxEvents; ++i) {
+		if(!readLine()) {
+			return true;
 		}
-		offset += m[0].rm_eo;
+		parseCounterLine(_line.data(), _line.data() + _line.size(), batch.data, batch.data.size());
+		batch.bunchCrossing.push_back(0);
+		batch.endEvent(_numEventsRead++);
 	}
-	regfree(&regex);
-	return false;
+	return next();
 }
 
+size_t MPAStreamReader::parseCounterLine(const char* line, std::vector<int>& counters, size_t offset)
+{
+	return parseCounterLine(line, line + std::strlen(line), counters, offset);
+}
+
+size_t MPAStreamReader::parseCounterLine(const char* line, const char* end, std::vector<int>& counters,
+	size_t offset)
+{
+	size_t numCounters = offset;
+	const char* p = line;
+	while(p < end) {
+		if(*p < '0' || *p > '9') {
+			++p;
+			continue;
+		}
+		int counter = 0;
+		do {
+			counter = counter*10 + (*p - '0');
+			++p;
+		} while(p < end && *p >= '0' && *p <= '9');
+		// overwrite in place, only grow the container for the first events
+		if(numCounters < counters.size()) {
+			counters[numCounters] = counter;
+		} else {
+			counters.push_back(counter);
+		}
+		++numCounters;
+	}
+	counters.resize(numCounters);
+	return numCounters - offset;
+}
 
 void MPAStreamReader::mpareader::open(size_t seek)
 {
 	_fin.exceptions(std::ios_base::failbit);
 	_fin.open(getFilename());
-	_fin.exceptions(std::ios_base::goodbit);
+	// throw on corrupt or truncated compressed data, the end of the file still just ends the stream
+	_fin.exceptions(std::ios_base::badbit);
 	if(seek) {
 		_fin.seekg(seek);
 	}
@@ -71,6 +150,11 @@ void MPAStreamReader::mpareader::open(size_t seek)
 
 BaseSensorStreamReader::reader* MPAStreamReader::mpareader::clone() const
 {
+	if(_index) {
+		auto newReader = new mpareader(getFilename(), _index, _numEventsRead);
+		newReader->_currentEvent = _currentEvent;
+		return newReader;
+	}
 	auto newReader = new mpareader(getFilename(), _fin.tellg());
 	newReader->_currentEvent = _currentEvent;
 	newReader->_numEventsRead = _numEventsRead;
@@ -79,5 +163,30 @@ BaseSensorStreamReader::reader* MPAStreamReader::mpareader::clone() const
 
 BaseSensorStreamReader::reader* MPAStreamReader::getReader(const std::string& filename) const
 {
-	return new mpareader(filename);
+	auto read = new mpareader(filename);
+	// empty file
+	if(read->next()) {
+		delete read;
+		return nullptr;
+	}
+	return read;
+}
+
+BaseSensorStreamReader::reader* MPAStreamReader::getReaderAt(const std::string& filename,
+	std::shared_ptr<const EventIndex> index, size_t firstEvent) const
+{
+	if(!index) {
+		return BaseSensorStreamReader::getReaderAt(filename, index, firstEvent);
+	}
+	if(firstEvent >= index->size()) {
+		return nullptr;
+	}
+	auto read = new mpareader(filename, index, firstEvent);
+	read->next();
+	return read;
+}
+
+std::shared_ptr<const EventIndex> MPAStreamReader::buildIndex(const std::string& filename) const
+{
+	return EventIndex::get(filename, EventIndex::buildLineIndex);
 }
@@ -0,0 +1,252 @@
+#include "multipartsensorstreamreader.h"
+#include <cctype>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace core;
+
+MultiPartSensorStreamReader::partreader::partreader(const std::string& filename,
+	std::shared_ptr<const readers_t> parts, std::shared_ptr<const std::vector<part_t>> index)
+ : reader(filename), _parts(parts), _index(index), _part(0), _offset(0), _position(0),
+   _it(parts->front()->begin()), _batch()
+{
+	if(_it == parts->front()->end() && !nextPart()) {
+		return;
+	}
+	load();
+}
+
+bool MultiPartSensorStreamReader::partreader::next()
+{
+	++_it;
+	++_position;
+	if(_it == (*_parts)[_part]->end() && !nextPart()) {
+		return true;
+	}
+	load();
+	return false;
+}
+
+bool MultiPartSensorStreamReader::partreader::nextBatch(batch_t& batch, size_t maxEvents)
+{
+	// filtered events are only known after decoding
+	if(getFilter()) {
+		return reader::nextBatch(batch, maxEvents);
+	}
+	size_t numEvents = 0;
+	while(numEvents < maxEvents) {
+		// the batch of the part starts with the current event
+		const size_t numRead = _it.readBatch(_batch, maxEvents - numEvents);
+		batch.data.insert(batch.data.end(), _batch.data.begin(), _batch.data.end());
+		batch.bunchCrossing.insert(batch.bunchCrossing.end(), _batch.bunchCrossing.begin(),
+		                           _batch.bunchCrossing.end());
+		for(size_t i = 0; i < numRead; ++i) {
+			batch.dataOffsets.push_back(batch.dataOffsets.back() + _batch.getDataSize(i));
+			batch.bunchCrossingOffsets.push_back(batch.bunchCrossingOffsets.back() +
+			                                     _batch.getBunchCrossingSize(i));
+			batch.eventNumbers.push_back(_batch.eventNumbers[i] + _offset);
+		}
+		numEvents += numRead;
+		_position += numRead;
+		if(_it == (*_parts)[_part]->end() && !nextPart()) {
+			return true;
+		}
+	}
+	load();
+	return false;
+}
+
+bool MultiPartSensorStreamReader::partreader::seek(size_t eventIndex)
+{
+	if(!_index) {
+		return reader::seek(eventIndex);
+	}
+	// last part starting at or before the event, empty parts start at the same event as the next one
+	auto part = std::upper_bound(_index->begin(), _index->end(), eventIndex,
+		[](size_t i, const part_t& p) { return i < p.firstEvent; }) - 1;
+	if(eventIndex >= part->firstEvent + part->numEvents) {
+		return false;
+	}
+	const size_t i = part - _index->begin();
+	if(i != _part) {
+		_part = i;
+		_it = (*_parts)[i]->begin();
+	}
+	_offset = part->firstEvent;
+	_position = eventIndex - _offset;
+	if(!_it.seek(_position)) {
+		return false;
+	}
+	load();
+	return true;
+}
+
+BaseSensorStreamReader::reader* MultiPartSensorStreamReader::partreader::clone() const
+{
+	// the iterator copy reopens the part at the current event
+	return new partreader(*this);
+}
+
+bool MultiPartSensorStreamReader::partreader::nextPart()
+{
+	do {
+		_offset += _position;
+		_position = 0;
+		if(++_part >= _parts->size()) {
+			return false;
+		}
+		_it = (*_parts)[_part]->begin();
+	} while(_it == (*_parts)[_part]->end());
+	return true;
+}
+
+void MultiPartSensorStreamReader::partreader::load()
+{
+	_currentEvent = *_it;
+	_currentEvent.eventNumber += _offset;
+}
+
+std::vector<std::string> MultiPartSensorStreamReader::findParts(const std::string& filename)
+{
+	std::vector<std::string> parts(1, filename);
+	const size_t underscore = filename.find_last_of('_');
+	if(underscore == std::string::npos) {
+		return parts;
+	}
+	size_t end = underscore + 1;
+	while(end < filename.size() && std::isdigit(filename[end])) {
+		++end;
+	}
+	const std::string suffix = filename.substr(end);
+	if(end == underscore + 1 || (!suffix.empty() && suffix[0] != '.') || suffix.find('/') != std::string::npos) {
+		return parts;
+	}
+	const std::string prefix = filename.substr(0, underscore + 1);
+	for(unsigned long n = std::stoul(filename.substr(underscore + 1, end - underscore - 1)) + 1; ; ++n) {
+		const std::string part = prefix + std::to_string(n) + suffix;
+		std::ifstream fin(part);
+		if(!fin.is_open()) {
+			break;
+		}
+		parts.push_back(part);
+	}
+	return parts;
+}
+
+std::vector<MultiPartSensorStreamReader::part_t> MultiPartSensorStreamReader::getParts() const
+{
+	auto parts = getPartReaders();
+	if(!_index) {
+		std::shared_ptr<std::vector<part_t>> index(new std::vector<part_t>);
+		size_t firstEvent = 0;
+		for(const auto& part: *parts) {
+			auto eventIndex = part->getIndex();
+			if(!eventIndex) {
+				throw std::logic_error(part->getFilename() + ": Reader does not support an event index");
+			}
+			index->push_back(part_t{part->getFilename(), firstEvent, eventIndex->size()});
+			firstEvent += eventIndex->size();
+		}
+		_index = index;
+	}
+	return *_index;
+}
+
+void MultiPartSensorStreamReader::probe() const
+{
+	for(const auto& part: *getPartReaders()) {
+		part->probe();
+	}
+}
+
+void MultiPartSensorStreamReader::setUseIndex(bool useIndex)
+{
+	BaseSensorStreamReader::setUseIndex(useIndex);
+	if(_parts) {
+		for(const auto& part: *_parts) {
+			part->setUseIndex(useIndex);
+		}
+	}
+}
+
+void MultiPartSensorStreamReader::setCatalog(std::shared_ptr<RunCatalog> catalog)
+{
+	// the iterators of the parts record them, the file set itself is not recorded
+	_catalog = catalog;
+	if(_parts) {
+		for(const auto& part: *_parts) {
+			part->setCatalog(catalog);
+		}
+	}
+}
+
+std::shared_ptr<const MultiPartSensorStreamReader::readers_t> MultiPartSensorStreamReader::getPartReaders() const
+{
+	if(!_parts || _partsFilename != getFilename()) {
+		std::shared_ptr<readers_t> parts(new readers_t);
+		for(const auto& filename: findParts(getFilename())) {
+			std::shared_ptr<BaseSensorStreamReader> part(_create());
+			part->setFilename(filename);
+			part->setCatalog(_catalog);
+			part->setUseIndex(getUseIndex());
+			parts->push_back(part);
+		}
+		_parts = parts;
+		_index.reset();
+		_partsFilename = getFilename();
+	}
+	return _parts;
+}
+
+BaseSensorStreamReader::reader* MultiPartSensorStreamReader::getReader(const std::string& filename) const
+{
+	auto read = new partreader(filename, getPartReaders(), nullptr);
+	if(read->isEnd()) {
+		delete read;
+		return nullptr;
+	}
+	return read;
+}
+
+BaseSensorStreamReader::reader* MultiPartSensorStreamReader::getReaderAt(const std::string& filename,
+	std::shared_ptr<const EventIndex> index, size_t firstEvent) const
+{
+	if(!getUseIndex()) {
+		// read and discard the leading events
+		auto read = getReader(filename);
+		for(size_t i = 0; read && i < firstEvent; ++i) {
+			if(read->next()) {
+				delete read;
+				return nullptr;
+			}
+		}
+		return read;
+	}
+	// the parts seek with their own index
+	getParts();
+	auto read = new partreader(filename, _parts, _index);
+	if(!read->seek(firstEvent)) {
+		delete read;
+		return nullptr;
+	}
+	return read;
+}
+
+std::shared_ptr<const EventIndex> MultiPartSensorStreamReader::buildIndex(const std::string& filename) const
+{
+	std::shared_ptr<EventIndex> index(new EventIndex);
+	size_t firstEvent = 0;
+	for(const auto& part: *getPartReaders()) {
+		auto partIndex = part->getIndex();
+		if(!partIndex) {
+			return nullptr;
+		}
+		for(size_t i = 0; i < partIndex->size(); ++i) {
+			index->add(partIndex->getOffset(i), partIndex->getLinesBefore(i),
+			           partIndex->getEventNumber(i) + firstEvent);
+		}
+		firstEvent += partIndex->size();
+	}
+	return index;
+}
@@ -0,0 +1,156 @@
+#include "parallelmpaloader.h"
+#include "mappedfile.h"
+#include "inputstream.h"
+#include "mpastreamreader.h"
+#include "mpamemorystreamreader.h"
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+
+using namespace core;
+
+ParallelMpaLoader::ParallelMpaLoader(const std::string& filename, format_t format, size_t numThreads,
+	size_t chunkSize)
+ : _data(nullptr), _size(0), _format(format), _numEventsDelivered(0)
+{
+	if(InputStream::detectCompression(filename) == InputStream::COMPRESSION_NONE) {
+		_file.reset(new MappedFile(filename));
+		_file->adviseSequential();
+		_data = _file->data();
+		_size = _file->size();
+	} else {
+		InputStream fin;
+		fin.exceptions(std::ios_base::failbit);
+		fin.open(filename);
+		fin.exceptions(std::ios_base::badbit);
+		_buffer.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+		_data = _buffer.data();
+		_size = _buffer.size();
+	}
+	if(_format == FORMAT_AUTO) {
+		_format = detectFormat(_data, _size);
+	}
+	_chunks = splitLines(_data, _size, chunkSize);
+	_pipeline.reset(new ChunkPipeline<batch_t>(_chunks.size(), numThreads, [this](size_t i, batch_t& batch) {
+		batch.clear();
+		parseChunk(_data + _chunks[i].first, _chunks[i].second, _format, batch);
+	}));
+}
+
+ParallelMpaLoader::~ParallelMpaLoader()
+{
+}
+
+bool ParallelMpaLoader::next(batch_t& batch)
+{
+	batch.clear();
+	while(_pipeline->next(batch)) {
+		// the workers number the events of each chunk from 0
+		for(auto& eventNumber: batch.eventNumbers) {
+			eventNumber += _numEventsDelivered;
+		}
+		_numEventsDelivered += batch.size();
+		// chunks of empty lines only
+		if(!batch.empty()) {
+			return true;
+		}
+	}
+	batch.clear();
+	return false;
+}
+
+void ParallelMpaLoader::load(const std::string& filename, std::vector<batch_t>& chunks, format_t format,
+	size_t numThreads)
+{
+	ParallelMpaLoader loader(filename, format, numThreads);
+	chunks.clear();
+	chunks.reserve(loader.getNumChunks());
+	batch_t batch;
+	while(loader.next(batch)) {
+		chunks.push_back(std::move(batch));
+		batch = batch_t();
+	}
+}
+
+std::vector<std::pair<size_t, size_t>> ParallelMpaLoader::splitLines(const char* data, size_t size,
+	size_t chunkSize)
+{
+	std::vector<std::pair<size_t, size_t>> chunks;
+	chunkSize = std::max<size_t>(1, chunkSize);
+	size_t begin = 0;
+	while(begin < size) {
+		// end the chunk after the first newline following the nominal chunk end
+		size_t target = std::min(size, begin + chunkSize) - 1;
+		const char* eol = static_cast<const char*>(std::memchr(data + target, '\n', size - target));
+		if(!eol) {
+			// the last chunk ends with the last complete line
+			eol = data + size - 1;
+			while(eol >= data + begin && *eol != '\n') {
+				--eol;
+			}
+			if(eol < data + begin) {
+				break;
+			}
+		}
+		const size_t end = eol - data + 1;
+		chunks.push_back(std::make_pair(begin, end - begin));
+		begin = end;
+	}
+	return chunks;
+}
+
+void ParallelMpaLoader::parseChunk(const char* data, size_t size, format_t format, batch_t& batch)
+{
+	if(format == FORMAT_AUTO) {
+		format = detectFormat(data, size);
+	}
+	const char* end = data + size;
+	const char* line = data;
+	int eventNumber = 0;
+	while(line < end) {
+		const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+		if(!eol) {
+			break;
+		}
+		// the readers skip lines which are empty or contain only \r
+		const size_t length = eol - line;
+		if(length > 1 || (length == 1 && line[0] != '\r')) {
+			if(format == FORMAT_MEMORY) {
+				uint64_t hits = MpaMemoryStreamReader::decodeLine(line, length, batch.bunchCrossing);
+				const size_t offset = batch.data.size();
+				batch.data.resize(offset + 48);
+				for(size_t pixel = 0; pixel < 48; ++pixel) {
+					batch.data[offset + pixel] = (hits >> pixel) & 1;
+				}
+			} else {
+				MPAStreamReader::parseCounterLine(line, eol, batch.data, batch.data.size());
+				batch.bunchCrossing.push_back(0);
+			}
+			batch.endEvent(eventNumber++);
+		}
+		line = eol + 1;
+	}
+}
+
+ParallelMpaLoader::format_t ParallelMpaLoader::detectFormat(const char* data, size_t size)
+{
+	// memory data starts with a quoted slot, counter data with a digit
+	const char* end = data + size;
+	const char* line = data;
+	while(line < end) {
+		const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+		if(!eol) {
+			eol = end;
+		}
+		for(const char* p = line; p < eol; ++p) {
+			if(*p == '\'' || *p == '"') {
+				return FORMAT_MEMORY;
+			}
+			if(*p >= '0' && *p <= '9') {
+				return FORMAT_COUNTER;
+			}
+		}
+		line = eol + 1;
+	}
+	return FORMAT_COUNTER;
+}
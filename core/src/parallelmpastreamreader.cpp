@@ -0,0 +1,108 @@
+#include "parallelmpastreamreader.h"
+#include <algorithm>
+
+using namespace core;
+
+ParallelMpaStreamReader::memreader::memreader(const std::string& filename, std::shared_ptr<const run_t> run,
+	size_t i)
+ : reader(filename), _run(run), _chunk(0), _pos(0)
+{
+	seek(i);
+}
+
+bool ParallelMpaStreamReader::memreader::step()
+{
+	if(++_pos < chunk().size()) {
+		return true;
+	}
+	_pos = 0;
+	return ++_chunk < _run->chunks.size();
+}
+
+bool ParallelMpaStreamReader::memreader::next()
+{
+	do {
+		if(!step()) {
+			return true;
+		}
+	} while(isBeforeRange(chunk().eventNumbers[_pos]));
+	chunk().getEvent(_pos, _currentEvent);
+	return false;
+}
+
+bool ParallelMpaStreamReader::memreader::nextBatch(batch_t& batch, size_t maxEvents)
+{
+	// filtered events are only known after decoding
+	if(getFilter()) {
+		return reader::nextBatch(batch, maxEvents);
+	}
+	for(size_t i = 0; i < maxEvents; ++i) {
+		const batch_t& source = chunk();
+		batch.data.insert(batch.data.end(), source.getData(_pos), source.getData(_pos) + source.getDataSize(_pos));
+		batch.bunchCrossing.insert(batch.bunchCrossing.end(), source.getBunchCrossing(_pos),
+		                           source.getBunchCrossing(_pos) + source.getBunchCrossingSize(_pos));
+		batch.endEvent(source.eventNumbers[_pos]);
+		if(!step()) {
+			return true;
+		}
+	}
+	chunk().getEvent(_pos, _currentEvent);
+	return false;
+}
+
+bool ParallelMpaStreamReader::memreader::seek(size_t eventIndex)
+{
+	if(eventIndex >= _run->size()) {
+		return false;
+	}
+	// last chunk starting at or before the event
+	_chunk = std::upper_bound(_run->firstEvents.begin(), _run->firstEvents.end(), eventIndex) -
+		_run->firstEvents.begin() - 1;
+	_pos = eventIndex - _run->firstEvents[_chunk];
+	chunk().getEvent(_pos, _currentEvent);
+	return true;
+}
+
+BaseSensorStreamReader::reader* ParallelMpaStreamReader::memreader::clone() const
+{
+	auto newReader = new memreader(getFilename(), _run, 0);
+	newReader->_chunk = _chunk;
+	newReader->_pos = _pos;
+	newReader->_currentEvent = _currentEvent;
+	return newReader;
+}
+
+std::shared_ptr<const ParallelMpaStreamReader::run_t> ParallelMpaStreamReader::getRun() const
+{
+	if(!_run || _runFilename != getFilename()) {
+		std::shared_ptr<run_t> run(new run_t);
+		ParallelMpaLoader::load(getFilename(), run->chunks, ParallelMpaLoader::FORMAT_AUTO, _numThreads);
+		run->firstEvents.push_back(0);
+		for(const auto& chunk: run->chunks) {
+			run->firstEvents.push_back(run->firstEvents.back() + chunk.size());
+		}
+		_run = run;
+		_runFilename = getFilename();
+	}
+	return _run;
+}
+
+BaseSensorStreamReader::reader* ParallelMpaStreamReader::getReader(const std::string& filename) const
+{
+	return getReaderAt(filename, nullptr, 0);
+}
+
+BaseSensorStreamReader::reader* ParallelMpaStreamReader::getReaderAt(const std::string& filename,
+	std::shared_ptr<const EventIndex> index, size_t firstEvent) const
+{
+	auto run = getRun();
+	if(firstEvent >= run->size()) {
+		return nullptr;
+	}
+	return new memreader(filename, run, firstEvent);
+}
+
+std::shared_ptr<const EventIndex> ParallelMpaStreamReader::buildIndex(const std::string& filename) const
+{
+	return EventIndex::get(filename, EventIndex::buildLineIndex);
+}
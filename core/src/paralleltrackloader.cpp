@@ -0,0 +1,236 @@
+#include "paralleltrackloader.h"
+#include "mappedfile.h"
+#include "inputstream.h"
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+
+using namespace core;
+
+namespace {
+	/// Block separator lines are empty or contain only \r
+	bool isEmptyLine(const char* line, size_t length)
+	{
+		return length == 0 || (length == 1 && line[0] == '\r');
+	}
+}
+
+ParallelTrackLoader::ParallelTrackLoader(const std::string& filename, size_t numThreads, size_t chunkSize,
+	const std::vector<int>& sensors, std::shared_ptr<const EventFilter> filter, size_t firstEvent)
+ : _filename(filename), _data(nullptr), _size(0), _sensors(sensors), _filter(filter), _pos(0),
+   _runID(0), _haveRunID(false), _skip(firstEvent), _pastRange(false)
+{
+	if(InputStream::detectCompression(filename) == InputStream::COMPRESSION_NONE) {
+		_file.reset(new MappedFile(filename));
+		_file->adviseSequential();
+		_data = _file->data();
+		_size = _file->size();
+	} else {
+		InputStream fin;
+		fin.exceptions(std::ios_base::failbit);
+		fin.open(filename);
+		fin.exceptions(std::ios_base::badbit);
+		_buffer.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+		_data = _buffer.data();
+		_size = _buffer.size();
+	}
+	_chunks = splitBlocks(_data, _size, chunkSize);
+	_pipeline.reset(new ChunkPipeline<chunk_t>(_chunks.size(), numThreads, [this](size_t i, chunk_t& chunk) {
+		// the line numbers are only known once the previous chunks have been counted
+		try {
+			parseChunk(i, 0, chunk);
+		} catch(TrackStreamReader::parse_error&) {
+			chunk.failed = true;
+		} catch(TrackStreamReader::consistency_error&) {
+			chunk.failed = true;
+		}
+	}));
+}
+
+ParallelTrackLoader::~ParallelTrackLoader()
+{
+}
+
+bool ParallelTrackLoader::next(event_t& event)
+{
+	while(!_pastRange && nextEvent(event)) {
+		// the leading events are skipped regardless of the filter
+		if(_skip > 0) {
+			--_skip;
+			continue;
+		}
+		if(!_filter) {
+			return true;
+		}
+		if(_filter->isPastRange(event.eventNumber)) {
+			_pastRange = true;
+			break;
+		}
+		if(_filter->acceptsEventNumber(event.eventNumber) && _filter->acceptsTracks(event.tracks.size())) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ParallelTrackLoader::nextEvent(event_t& event)
+{
+	while(_pos >= _chunk.events.size()) {
+		if(!nextChunk()) {
+			return false;
+		}
+	}
+	event = std::move(_chunk.events[_pos++]);
+	// the last event of a chunk continues in the next chunk if the event number does not change
+	while(_pos >= _chunk.events.size() && nextChunk()) {
+		if(!_chunk.events.empty() && _chunk.events.front().eventNumber == event.eventNumber) {
+			auto& tracks = _chunk.events.front().tracks;
+			event.tracks.insert(event.tracks.end(), std::make_move_iterator(tracks.begin()),
+			                    std::make_move_iterator(tracks.end()));
+			_pos = 1;
+		}
+	}
+	return true;
+}
+
+bool ParallelTrackLoader::nextChunk()
+{
+	const size_t i = _pipeline->getNextChunk();
+	if(!_pipeline->next(_chunk)) {
+		return false;
+	}
+	_pos = 0;
+	if(_chunk.failed) {
+		// throws the error of the worker with the line number of the whole file, or a run ID change at the
+		// first point if it comes first
+		parseChunk(i, countLinesBefore(i), _chunk, _haveRunID ? &_runID : nullptr);
+	}
+	if(_chunk.events.empty()) {
+		return true;
+	}
+	const int runID = _chunk.events.front().runID;
+	if(_haveRunID && runID != _runID) {
+		throw TrackStreamReader::consistency_error(_filename, countLinesBefore(i) + _chunk.firstPointLine,
+			"Run ID must not change in a single track block!");
+	}
+	// all events of a chunk share the run ID
+	_runID = runID;
+	_haveRunID = true;
+	return true;
+}
+
+size_t ParallelTrackLoader::countLinesBefore(size_t chunk) const
+{
+	return std::count(_data, _data + _chunks[chunk].first, '\n');
+}
+
+void ParallelTrackLoader::parseChunk(size_t i, size_t linesBefore, chunk_t& chunk, const int* previousRunID) const
+{
+	chunk.events.clear();
+	chunk.firstPointLine = 0;
+	chunk.failed = false;
+	const char* p = _data + _chunks[i].first;
+	const char* end = p + _chunks[i].second;
+	size_t lineNo = linesBefore;
+	// the tokenizer needs null-terminated lines
+	std::string line;
+	event_t* event = nullptr;
+	Track track;
+	// number of points in the current track block, including the ones of skipped sensors
+	size_t numPoints = 0;
+	int numEmptyLines = 0;
+	while(p < end) {
+		const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		if(!eol) {
+			// unterminated last line of the file
+			eol = end;
+		}
+		++lineNo;
+		const size_t length = eol - p;
+		line.assign(p, length);
+		p = eol + 1;
+		if(isEmptyLine(line.data(), length)) {
+			++numEmptyLines;
+			continue;
+		}
+		// beginning of a new block, comment lines count as well
+		if(numEmptyLines >= 2 && numPoints) {
+			event->tracks.push_back(std::move(track));
+			track = Track();
+			numPoints = 0;
+		}
+		numEmptyLines = 0;
+		TrackStreamReader::point_t point;
+		if(!TrackStreamReader::tokenizeLine(line.c_str(), point, _sensors, _filter.get(), _filename, lineNo)) {
+			continue;
+		}
+		if(!event) {
+			if(previousRunID && point.runID != *previousRunID) {
+				throw TrackStreamReader::consistency_error(_filename, lineNo,
+					"Run ID must not change in a single track block!");
+			}
+			chunk.events.push_back(event_t());
+			event = &chunk.events.back();
+			event->eventNumber = point.eventNumber;
+			event->runID = point.runID;
+			chunk.firstPointLine = lineNo - linesBefore;
+		}
+		if(point.runID != event->runID) {
+			throw TrackStreamReader::consistency_error(_filename, lineNo,
+				"Run ID must not change in a single track block!");
+		}
+		if(point.eventNumber != event->eventNumber) {
+			// changing the event number while constructing a track is a file format error
+			if(numPoints) {
+				throw TrackStreamReader::consistency_error(_filename, lineNo,
+					"Event number must not change in a single track block!");
+			}
+			chunk.events.push_back(event_t());
+			event = &chunk.events.back();
+			event->eventNumber = point.eventNumber;
+			event->runID = point.runID;
+		}
+		++numPoints;
+		track.sensorIDs.push_back(point.sensorID);
+		track.points.push_back(TrackStreamReader::isPointRequired(point, _sensors, _filter.get()) ?
+			Eigen::Vector3d(point.x, point.y, point.z) : TrackStreamReader::getSkippedPosition());
+	}
+	// the chunk ends at a block boundary or at the end of the file
+	if(numPoints) {
+		event->tracks.push_back(std::move(track));
+	}
+}
+
+std::vector<std::pair<size_t, size_t>> ParallelTrackLoader::splitBlocks(const char* data, size_t size,
+	size_t chunkSize)
+{
+	std::vector<std::pair<size_t, size_t>> chunks;
+	chunkSize = std::max<size_t>(1, chunkSize);
+	size_t begin = 0;
+	while(begin < size) {
+		size_t chunkEnd = size;
+		// first line starting at or after the nominal chunk end
+		const size_t target = std::min(size, begin + chunkSize) - 1;
+		const char* line = static_cast<const char*>(std::memchr(data + target, '\n', size - target));
+		if(line) {
+			++line;
+			int numEmptyLines = 0;
+			while(line < data + size) {
+				const char* eol = static_cast<const char*>(std::memchr(line, '\n', data + size - line));
+				if(!eol) {
+					break;
+				}
+				if(!isEmptyLine(line, eol - line)) {
+					numEmptyLines = 0;
+				} else if(++numEmptyLines == 2) {
+					chunkEnd = eol - data + 1;
+					break;
+				}
+				line = eol + 1;
+			}
+		}
+		chunks.push_back(std::make_pair(begin, chunkEnd - begin));
+		begin = chunkEnd;
+	}
+	return chunks;
+}
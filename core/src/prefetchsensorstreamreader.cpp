@@ -0,0 +1,53 @@
+#include "prefetchsensorstreamreader.h"
+
+using namespace core;
+
+PrefetchSensorStreamReader::prefetchreader::prefetchreader(std::shared_ptr<BaseSensorStreamReader> source,
+	size_t depth, size_t skip)
+ : reader(source->getFilename()), _source(source), _depth(depth), _numEventsRead(skip), _prefetcher()
+{
+	std::shared_ptr<iterator> it(new iterator(_source->begin()));
+	for(size_t i = 0; i < skip && *it != _source->end(); ++i) {
+		++(*it);
+	}
+	// the source iterator is only touched by the prefetch thread from now on
+	_prefetcher.reset(new Prefetcher<event_t>(depth, [it, source](event_t& event) {
+		if(*it == source->end()) {
+			return false;
+		}
+		event = **it;
+		++(*it);
+		return true;
+	}));
+}
+
+bool PrefetchSensorStreamReader::prefetchreader::next()
+{
+	if(!_prefetcher->next(_currentEvent)) {
+		return true;
+	}
+	++_numEventsRead;
+	return false;
+}
+
+BaseSensorStreamReader::reader* PrefetchSensorStreamReader::prefetchreader::clone() const
+{
+	auto newReader = new prefetchreader(_source, _depth, _numEventsRead);
+	newReader->_currentEvent = _currentEvent;
+	return newReader;
+}
+
+BaseSensorStreamReader::reader* PrefetchSensorStreamReader::getReader(const std::string& filename) const
+{
+	if(filename != _source->getFilename()) {
+		_source->setFilename(filename);
+	}
+	auto read = new prefetchreader(_source, _depth, 0);
+	read->next();
+	return read;
+}
+
+std::shared_ptr<const EventIndex> PrefetchSensorStreamReader::buildIndex(const std::string& filename) const
+{
+	return _source->getIndex();
+}
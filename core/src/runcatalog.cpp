@@ -0,0 +1,273 @@
+#include "runcatalog.h"
+#include "coreconfig.h"
+#include <iostream>
+#include <stdexcept>
+#include <climits>
+#include <cstdlib>
+#include <sys/stat.h>
+#ifdef HAVE_SQLITE3
+#include <sqlite3.h>
+#endif
+
+using namespace core;
+
+#ifdef HAVE_SQLITE3
+namespace {
+struct file_stat_t {
+	int64_t size;
+	int64_t mtimeSec;
+	int64_t mtimeNsec;
+};
+
+bool statDataFile(const std::string& filename, file_stat_t& fileStat)
+{
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0) {
+		return false;
+	}
+	fileStat.size = st.st_size;
+	fileStat.mtimeSec = st.st_mtim.tv_sec;
+	fileStat.mtimeNsec = st.st_mtim.tv_nsec;
+	return true;
+}
+
+/// Prepared statement, finalized when going out of scope
+class statement_t {
+public:
+	statement_t(sqlite3* db, const std::string& catalog, const char* sql) : _db(db), _catalog(catalog), _stmt(nullptr)
+	{
+		check(sqlite3_prepare_v2(_db, sql, -1, &_stmt, nullptr));
+	}
+	~statement_t() { sqlite3_finalize(_stmt); }
+
+	statement_t& bind(int i, const std::string& value)
+	{
+		check(sqlite3_bind_text(_stmt, i, value.c_str(), -1, SQLITE_TRANSIENT));
+		return *this;
+	}
+	statement_t& bind(int i, int64_t value)
+	{
+		check(sqlite3_bind_int64(_stmt, i, value));
+		return *this;
+	}
+	/// Execute the statement, returns true while there are result rows
+	bool step()
+	{
+		const int status = sqlite3_step(_stmt);
+		if(status == SQLITE_ROW) {
+			return true;
+		}
+		check(status == SQLITE_DONE ? SQLITE_OK : status);
+		return false;
+	}
+	void reset()
+	{
+		sqlite3_reset(_stmt);
+	}
+	int64_t get(int column) const { return sqlite3_column_int64(_stmt, column); }
+
+private:
+	void check(int status) const
+	{
+		if(status != SQLITE_OK) {
+			throw std::runtime_error(_catalog + ": " + sqlite3_errmsg(_db));
+		}
+	}
+
+	sqlite3* _db;
+	const std::string& _catalog;
+	sqlite3_stmt* _stmt;
+};
+}
+#endif//HAVE_SQLITE3
+
+RunCatalog::Collector::Collector(std::shared_ptr<RunCatalog> catalog, const std::string& dataFilename)
+ : _catalog(catalog), _stats()
+{
+	_stats.filename = dataFilename;
+}
+
+void RunCatalog::Collector::addEventNumber(int eventNumber)
+{
+	if(_stats.numEvents == 0) {
+		_stats.firstEvent = eventNumber;
+	}
+	_stats.lastEvent = eventNumber;
+	++_stats.numEvents;
+}
+
+void RunCatalog::Collector::addEvent(int eventNumber, size_t numTracks)
+{
+	addEventNumber(eventNumber);
+	if(numTracks >= _stats.trackCounts.size()) {
+		_stats.trackCounts.resize(numTracks + 1, 0);
+	}
+	++_stats.trackCounts[numTracks];
+}
+
+void RunCatalog::Collector::addEvent(int eventNumber, const int* data, size_t size)
+{
+	addEventNumber(eventNumber);
+	if(size > _stats.pixelHits.size()) {
+		_stats.pixelHits.resize(size, 0);
+	}
+	for(size_t i = 0; i < size; ++i) {
+		_stats.pixelHits[i] += data[i] != 0;
+	}
+}
+
+void RunCatalog::Collector::finish()
+{
+	try {
+		_catalog->put(_stats);
+	} catch(std::exception& e) {
+		std::cerr << "Cannot record run statistics: " << e.what() << std::endl;
+	}
+}
+
+RunCatalog::RunCatalog(const std::string& filename) : _filename(filename), _db(nullptr)
+{
+#ifdef HAVE_SQLITE3
+	if(sqlite3_open(filename.c_str(), &_db) != SQLITE_OK) {
+		const std::string message = filename + ": " + sqlite3_errmsg(_db);
+		sqlite3_close(_db);
+		throw std::runtime_error(message);
+	}
+	// wait for other processes writing to the catalog
+	sqlite3_busy_timeout(_db, 10000);
+	try {
+		exec("CREATE TABLE IF NOT EXISTS runs (filename TEXT PRIMARY KEY, file_size INTEGER, mtime_sec INTEGER, "
+		     "mtime_nsec INTEGER, num_events INTEGER, first_event INTEGER, last_event INTEGER);"
+		     "CREATE TABLE IF NOT EXISTS track_counts (filename TEXT, num_tracks INTEGER, num_events INTEGER, "
+		     "PRIMARY KEY(filename, num_tracks));"
+		     "CREATE TABLE IF NOT EXISTS pixel_hits (filename TEXT, pixel INTEGER, num_events INTEGER, "
+		     "PRIMARY KEY(filename, pixel));");
+	} catch(...) {
+		sqlite3_close(_db);
+		throw;
+	}
+#else
+	throw std::runtime_error(filename + ": The run catalog is not supported by this build (requires sqlite3)");
+#endif
+}
+
+RunCatalog::~RunCatalog()
+{
+#ifdef HAVE_SQLITE3
+	sqlite3_close(_db);
+#endif
+}
+
+bool RunCatalog::isAvailable()
+{
+#ifdef HAVE_SQLITE3
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::string RunCatalog::getCanonicalName(const std::string& filename)
+{
+	char path[PATH_MAX];
+	if(!realpath(filename.c_str(), path)) {
+		return filename;
+	}
+	return path;
+}
+
+void RunCatalog::exec(const char* sql) const
+{
+#ifdef HAVE_SQLITE3
+	char* error = nullptr;
+	if(sqlite3_exec(_db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+		const std::string message = _filename + ": " + (error ? error : "Unknown error");
+		sqlite3_free(error);
+		throw std::runtime_error(message);
+	}
+#endif
+}
+
+bool RunCatalog::get(const std::string& dataFilename, stats_t& stats) const
+{
+#ifdef HAVE_SQLITE3
+	file_stat_t fileStat;
+	const std::string filename = getCanonicalName(dataFilename);
+	if(!statDataFile(filename, fileStat)) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	statement_t run(_db, _filename, "SELECT file_size, mtime_sec, mtime_nsec, num_events, first_event, last_event "
+	                                "FROM runs WHERE filename = ?");
+	run.bind(1, filename);
+	if(!run.step() || run.get(0) != fileStat.size || run.get(1) != fileStat.mtimeSec ||
+	   run.get(2) != fileStat.mtimeNsec) {
+		return false;
+	}
+	stats = stats_t();
+	stats.filename = filename;
+	stats.numEvents = run.get(3);
+	stats.firstEvent = run.get(4);
+	stats.lastEvent = run.get(5);
+	statement_t tracks(_db, _filename, "SELECT num_tracks, num_events FROM track_counts WHERE filename = ? "
+	                                   "ORDER BY num_tracks");
+	tracks.bind(1, filename);
+	while(tracks.step()) {
+		stats.trackCounts.resize(tracks.get(0) + 1, 0);
+		stats.trackCounts[tracks.get(0)] = tracks.get(1);
+	}
+	statement_t pixels(_db, _filename, "SELECT pixel, num_events FROM pixel_hits WHERE filename = ? ORDER BY pixel");
+	pixels.bind(1, filename);
+	while(pixels.step()) {
+		stats.pixelHits.resize(pixels.get(0) + 1, 0);
+		stats.pixelHits[pixels.get(0)] = pixels.get(1);
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void RunCatalog::put(const stats_t& stats)
+{
+#ifdef HAVE_SQLITE3
+	file_stat_t fileStat;
+	const std::string filename = getCanonicalName(stats.filename);
+	if(!statDataFile(filename, fileStat)) {
+		throw std::runtime_error(stats.filename + ": Cannot stat data file");
+	}
+	std::lock_guard<std::mutex> lock(_mutex);
+	exec("BEGIN IMMEDIATE");
+	try {
+		for(const char* table: {"runs", "track_counts", "pixel_hits"}) {
+			const std::string sql = std::string("DELETE FROM ") + table + " WHERE filename = ?";
+			statement_t remove(_db, _filename, sql.c_str());
+			remove.bind(1, filename).step();
+		}
+		statement_t run(_db, _filename, "INSERT INTO runs VALUES (?, ?, ?, ?, ?, ?, ?)");
+		run.bind(1, filename).bind(2, fileStat.size).bind(3, fileStat.mtimeSec).bind(4, fileStat.mtimeNsec);
+		run.bind(5, static_cast<int64_t>(stats.numEvents)).bind(6, stats.firstEvent).bind(7, stats.lastEvent);
+		run.step();
+		// only track counts which occur are stored
+		statement_t tracks(_db, _filename, "INSERT INTO track_counts VALUES (?, ?, ?)");
+		for(size_t i = 0; i < stats.trackCounts.size(); ++i) {
+			if(stats.trackCounts[i] == 0) {
+				continue;
+			}
+			tracks.bind(1, filename).bind(2, static_cast<int64_t>(i)).bind(3, stats.trackCounts[i]);
+			tracks.step();
+			tracks.reset();
+		}
+		statement_t pixels(_db, _filename, "INSERT INTO pixel_hits VALUES (?, ?, ?)");
+		for(size_t i = 0; i < stats.pixelHits.size(); ++i) {
+			pixels.bind(1, filename).bind(2, static_cast<int64_t>(i)).bind(3, stats.pixelHits[i]);
+			pixels.step();
+			pixels.reset();
+		}
+		exec("COMMIT");
+	} catch(...) {
+		exec("ROLLBACK");
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,196 @@
+#include "runsnapshot.h"
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+
+using namespace core;
+
+static_assert(sizeof(RunSnapshot::file_header_t) == 80, "Unexpected padding in file header");
+static_assert(sizeof(UShort_t) == sizeof(uint16_t), "Counters are stored as uint16");
+
+namespace {
+const char fileMagic[8] = {'M', 'P', 'A', 'F', 'L', 'A', 'T', 0};
+const uint32_t fileVersion = 1;
+
+template<typename T>
+void writeArray(std::ofstream& fout, const T* data, size_t size)
+{
+	fout.write(reinterpret_cast<const char*>(data), size*sizeof(T));
+}
+
+bool checkOffsets(const uint64_t* offsets, uint64_t num, uint64_t total)
+{
+	if(offsets[0] != 0 || offsets[num] != total) {
+		return false;
+	}
+	for(uint64_t i = 0; i < num; ++i) {
+		if(offsets[i] > offsets[i+1]) {
+			return false;
+		}
+	}
+	return true;
+}
+}
+
+RunSnapshot::RunSnapshot(const run_data_t& run)
+ : _numEvents(getEntries(run)), _mpaIndices(), _planes(), _counters(nullptr), _storage(), _counterStorage()
+{
+	for(const auto& mpa: run.mpaData) {
+		_mpaIndices.push_back(mpa.index);
+	}
+	_counterStorage.reserve(_numEvents * _mpaIndices.size() * numPixels);
+	for(auto& plane: _storage) {
+		plane.offsets.reserve(_numEvents + 1);
+	}
+	const auto planes = getPlanes(*run.telescopeHits);
+	for(size_t evt = 0; evt < _numEvents; ++evt) {
+		getEntry(run, evt);
+		for(size_t i = 0; i < numPlanes; ++i) {
+			const PlaneHits& hits = *planes[i];
+			storage_t& plane = _storage[i];
+			const float* x = hits.x.GetMatrixArray();
+			const float* y = hits.y.GetMatrixArray();
+			const float* z = hits.z.GetMatrixArray();
+			plane.x.insert(plane.x.end(), x, x + hits.x.GetNoElements());
+			plane.y.insert(plane.y.end(), y, y + hits.y.GetNoElements());
+			plane.z.insert(plane.z.end(), z, z + hits.z.GetNoElements());
+			plane.offsets.push_back(plane.x.size());
+		}
+		for(const auto& mpa: run.mpaData) {
+			const UShort_t* pixels = (*mpa.data)->counter.pixels;
+			_counterStorage.insert(_counterStorage.end(), pixels, pixels + numPixels);
+		}
+	}
+	for(size_t i = 0; i < numPlanes; ++i) {
+		_planes[i] = { _storage[i].offsets.data(), _storage[i].x.data(), _storage[i].y.data(),
+		               _storage[i].z.data() };
+	}
+	_counters = _counterStorage.data();
+}
+
+RunSnapshot::RunSnapshot(const std::string& filename)
+ : _numEvents(0), _mpaIndices(), _planes(), _counters(nullptr), _storage(), _counterStorage(),
+   _file(new MappedFile(filename))
+{
+	file_header_t header;
+	if(_file->size() < sizeof(header)) {
+		throw std::ios_base::failure(filename + ": File too short for flat file header");
+	}
+	std::memcpy(&header, _file->data(), sizeof(header));
+	if(std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0) {
+		throw std::ios_base::failure(filename + ": Not a flat run file");
+	}
+	if(header.version != fileVersion) {
+		throw std::ios_base::failure(filename + ": Unsupported flat run file version");
+	}
+	uint64_t expectedSize = sizeof(header)
+		+ numPlanes*(header.numEvents + 1)*sizeof(uint64_t)
+		+ header.numMpa*sizeof(int32_t)
+		+ header.numEvents*header.numMpa*numPixels*sizeof(uint16_t);
+	for(size_t i = 0; i < numPlanes; ++i) {
+		expectedSize += 3*header.numHits[i]*sizeof(float);
+	}
+	if(_file->size() != expectedSize) {
+		throw std::ios_base::failure(filename + ": Flat run file size does not match header");
+	}
+	_numEvents = header.numEvents;
+	// the mapping is page aligned and the arrays are sorted by alignment
+	const char* p = _file->data() + sizeof(header);
+	for(size_t i = 0; i < numPlanes; ++i) {
+		_planes[i].offsets = reinterpret_cast<const uint64_t*>(p);
+		p += (_numEvents + 1)*sizeof(uint64_t);
+		// broken offsets would lead to reads outside of the mapping later on
+		if(!checkOffsets(_planes[i].offsets, _numEvents, header.numHits[i])) {
+			throw std::ios_base::failure(filename + ": Inconsistent offsets in flat run file");
+		}
+	}
+	for(size_t i = 0; i < numPlanes; ++i) {
+		_planes[i].x = reinterpret_cast<const float*>(p);
+		p += header.numHits[i]*sizeof(float);
+		_planes[i].y = reinterpret_cast<const float*>(p);
+		p += header.numHits[i]*sizeof(float);
+		_planes[i].z = reinterpret_cast<const float*>(p);
+		p += header.numHits[i]*sizeof(float);
+	}
+	const int32_t* mpaIndices = reinterpret_cast<const int32_t*>(p);
+	_mpaIndices.assign(mpaIndices, mpaIndices + header.numMpa);
+	p += header.numMpa*sizeof(int32_t);
+	_counters = reinterpret_cast<const UShort_t*>(p);
+	_file->adviseSequential();
+}
+
+bool RunSnapshot::isFlatFile(const std::string& filename)
+{
+	const std::string extension(".flat");
+	return filename.size() >= extension.size() &&
+	       filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void RunSnapshot::write(const std::string& filename) const
+{
+	file_header_t header;
+	std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.numMpa = _mpaIndices.size();
+	header.numEvents = _numEvents;
+	for(size_t i = 0; i < numPlanes; ++i) {
+		header.numHits[i] = _planes[i].offsets[_numEvents];
+	}
+
+	std::ofstream fout;
+	fout.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+	fout.open(filename, std::ios_base::binary | std::ios_base::trunc);
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for(const auto& plane: _planes) {
+		writeArray(fout, plane.offsets, _numEvents + 1);
+	}
+	for(size_t i = 0; i < numPlanes; ++i) {
+		writeArray(fout, _planes[i].x, header.numHits[i]);
+		writeArray(fout, _planes[i].y, header.numHits[i]);
+		writeArray(fout, _planes[i].z, header.numHits[i]);
+	}
+	writeArray(fout, _mpaIndices.data(), _mpaIndices.size());
+	writeArray(fout, _counters, _numEvents * _mpaIndices.size() * numPixels);
+	fout.close();
+}
+
+void RunSnapshot::load(size_t evt, const run_data_t& run) const
+{
+	const auto planes = getPlanes(*run.telescopeHits);
+	for(size_t i = 0; i < numPlanes; ++i) {
+		const size_t numHits = getNumHits(evt, i);
+		PlaneHits& hits = *planes[i];
+		hits.x.ResizeTo(numHits);
+		hits.y.ResizeTo(numHits);
+		hits.z.ResizeTo(numHits);
+		std::copy(getX(evt, i), getX(evt, i) + numHits, hits.x.GetMatrixArray());
+		std::copy(getY(evt, i), getY(evt, i) + numHits, hits.y.GetMatrixArray());
+		std::copy(getZ(evt, i), getZ(evt, i) + numHits, hits.z.GetMatrixArray());
+	}
+	for(size_t mpa = 0; mpa < getNumMpa(); ++mpa) {
+		const UShort_t* counter = getCounter(evt, mpa);
+		std::copy(counter, counter + numPixels, (*run.mpaData[mpa].data)->counter.pixels);
+	}
+}
+
+std::array<PlaneHits*, RunSnapshot::numPlanes> RunSnapshot::getPlanes(TelescopeHits* hits)
+{
+	return {{&hits->p1, &hits->p2, &hits->p3, &hits->p4, &hits->p5, &hits->p6, &hits->ref}};
+}
+
+size_t core::getEntries(const run_data_t& run)
+{
+	if(run.snapshot) {
+		return run.snapshot->size();
+	}
+	return run.tree->GetEntries();
+}
+
+void core::getEntry(const run_data_t& run, size_t evt)
+{
+	if(run.snapshot) {
+		run.snapshot->load(evt, run);
+	} else {
+		run.tree->GetEntry(evt);
+	}
+}
@@ -5,13 +5,19 @@
 #include <iostream>
 #include <cxxabi.h>
 #include <algorithm>
+#include <limits>
+#include <random>
+#include <stdexcept>
 #include "mpastreamreader.h"
+#include "prefetchsensorstreamreader.h"
+#include "multipartsensorstreamreader.h"
 #include "util.h"
 
 using namespace core;
 
 TrackAnalysis::TrackAnalysis() :
-	Analysis(), _analysisRunning(false)
+	Analysis(), _eventFilter(), _requiredSensors(), _samplingMode(SAMPLE_ALL), _numSamples(0), _samplingSeed(0),
+	_analysisRunning(false)
 {
 	getOptionsDescription().add_options()
 		("runlist,l", po::value<std::string>()->default_value("../runlist.csv"), "Per-run information table")
@@ -59,6 +65,14 @@ bool TrackAnalysis::loadConfig(const po::variables_map& vm)
 void TrackAnalysis::run(const po::variables_map& vm)
 {
 	init(vm);
+	// statistics of the data files, recorded while the processes read them
+	_catalog.reset();
+	try {
+		_catalog = std::make_shared<RunCatalog>(_config.getVariable("run_catalog"));
+	} catch(CfgParse::no_variable_error& e) {
+	} catch(std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+	}
 	std::vector<run_read_pair_t> readers;
 	for(auto runId: _allRunIds) {
 		_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(runId)));
@@ -73,26 +87,106 @@ void TrackAnalysis::run(const po::variables_map& vm)
 		}
 		auto reader = BaseSensorStreamReader::Factory::Instance()->createShared(reader_type);
 		reader->setFilename(_config.getVariable("mapsa_data"));
+		// long runs are split into _0, _1, ... files, which are read as one stream
+		bool multiPart = true;
+		try {
+			multiPart = _config.getVariable("mapsa_multipart") != "false";
+		} catch(CfgParse::no_variable_error& e) {
+		}
+		auto files = multiPart ? MultiPartSensorStreamReader::findParts(reader->getFilename()) :
+			std::vector<std::string>{reader->getFilename()};
+		if(files.size() > 1) {
+			reader = std::make_shared<MultiPartSensorStreamReader>([reader_type]() {
+				return BaseSensorStreamReader::Factory::Instance()->create(reader_type);
+			}, reader->getFilename());
+		}
+		// regex parser is slow, only use it to validate the default tokenizer
+		auto parse_mode = TrackStreamReader::PARSE_TOKENIZER;
+		try {
+			if(_config.getVariable("track_parse_mode") == "regex") {
+				parse_mode = TrackStreamReader::PARSE_REGEX;
+			}
+		} catch(CfgParse::no_variable_error& e) {
+		}
 		run_read_pair_t r {
 			runId,
 			reader,
-			{_config.getVariable("track_data")}
+			{_config.getVariable("track_data"), parse_mode},
+			nullptr,
+			_numSamples,
+			0
 		};
+		// offsets of runs that lose synchronisation, e.g. written by DataSkip --detect-desync
+		try {
+			auto offsetMap = std::make_shared<DataOffsetMap>();
+			offsetMap->read(_config.getVariable("data_offset_map"));
+			r.offsetMap = offsetMap;
+		} catch(CfgParse::no_variable_error& e) {
+		} catch(std::ios_base::failure& e) {
+			std::cerr << e.what() << std::endl;
+			return;
+		}
+		r.trackreader.setRequiredSensors(_requiredSensors);
+		// parse the text track file in blocks on several threads
+		try {
+			r.trackreader.setNumThreads(_config.get<size_t>("track_threads"));
+		} catch(CfgParse::no_variable_error& e) {
+		}
+		// sidecar .idx files for seeking in the text data files
+		try {
+			if(_config.getVariable("event_index") == "true") {
+				r.pixelreader->setUseIndex(true);
+				r.trackreader.setUseIndex(true);
+			}
+		} catch(CfgParse::no_variable_error& e) {
+		}
+		// stride sampling seeks in both files, parallel track iterators cannot seek
+		if(_samplingMode == SAMPLE_STRIDE) {
+			r.pixelreader->setUseIndex(true);
+			r.trackreader.setUseIndex(true);
+			r.trackreader.setNumThreads(0);
+		}
+
+		if(_catalog) {
+			r.pixelreader->setCatalog(_catalog);
+			r.trackreader.setCatalog(_catalog);
+		}
+		if(!_eventFilter.empty()) {
+			applyEventFilter(r);
+		}
 
+		// only check the files, iterating is left to the processes
 		try {
-			r.pixelreader->begin();
+			r.pixelreader->probe();
 		} catch(std::ios_base::failure& e) {
 			std::cerr << "Cannot open MPA data file '" << _config.getVariable("mapsa_data") << "'." << std::endl;
 			return;
 		}
 		try {
-			r.trackreader.begin();
+			r.trackreader.probe();
 		} catch(std::ios_base::failure& e) {
 			std::cerr << "Cannot open track data file '" << _config.getVariable("track_data") << "'." << std::endl;
 			return;
 		}
+		// size of the run for distributing the samples, without reading the data file
+		if(_catalog && _samplingMode != SAMPLE_ALL) {
+			r.numEvents = getCatalogEvents(files);
+		}
+		// overlap reading of both files with the analysis on background threads
+		size_t prefetch = 0;
+		try {
+			prefetch = _config.get<size_t>("prefetch");
+		} catch(CfgParse::no_variable_error& e) {
+		}
+		if(prefetch > 0 && _samplingMode != SAMPLE_STRIDE) {
+			r.pixelreader = std::make_shared<PrefetchSensorStreamReader>(r.pixelreader, prefetch);
+			r.trackreader.setPrefetch(prefetch);
+		}
 		readers.push_back(r);
 	}
+	if(_samplingMode != SAMPLE_ALL) {
+		distributeSamples(readers);
+	}
 	for(const auto& process: _processes) {
 		executeProcess(readers, process);
 	}
@@ -198,22 +292,124 @@ void TrackAnalysis::setDataOffset(int dataOffset)
 	_dataOffset = dataOffset;
 }
 
+void TrackAnalysis::applyEventFilter(run_read_pair_t& read) const
+{
+	EventFilter pixelFilter(_eventFilter);
+	pixelFilter.minTracks = 0;
+	pixelFilter.maxTracks = EventFilter::npos;
+	read.pixelreader->setEventFilter(pixelFilter);
+
+	// CS_ALWAYS processes pass MPA events without telescope event, so the track reader may only drop
+	// events if events without tracks are rejected anyway. The track cuts are checked again in the join.
+	EventFilter trackFilter;
+	if(_eventFilter.minTracks > 0) {
+		trackFilter.minTracks = _eventFilter.minTracks;
+		trackFilter.maxTracks = _eventFilter.maxTracks;
+	}
+	// event range in telescope event numbers, covering all offsets of the run
+	int minOffset = _dataOffset;
+	int maxOffset = _dataOffset;
+	if(read.offsetMap) {
+		for(const auto& segment: read.offsetMap->getSegments()) {
+			minOffset = std::min(minOffset, segment.offset);
+			maxOffset = std::max(maxOffset, segment.offset);
+		}
+	}
+	if(_eventFilter.firstEvent != std::numeric_limits<int>::min()) {
+		trackFilter.firstEvent = _eventFilter.firstEvent + minOffset;
+	}
+	if(_eventFilter.lastEvent != std::numeric_limits<int>::max()) {
+		trackFilter.lastEvent = _eventFilter.lastEvent + maxOffset;
+	}
+	read.trackreader.setEventFilter(trackFilter);
+}
+
+int TrackAnalysis::getDataOffset(const run_read_pair_t& read, int eventNumber) const
+{
+	if(read.offsetMap) {
+		return read.offsetMap->getOffset(eventNumber, _dataOffset);
+	}
+	return _dataOffset;
+}
+
 void TrackAnalysis::rerun()
 {
 	assert(_analysisRunning == false);
 	_rerunProcess = true;
 }
 
+void TrackAnalysis::setSampling(sampling_mode_t mode, size_t numEvents, uint64_t seed)
+{
+	_samplingMode = mode;
+	_numSamples = numEvents;
+	_samplingSeed = seed;
+}
+
+TrackAnalysis::sampling_mode_t TrackAnalysis::parseSamplingMode(const std::string& name)
+{
+	if(name == "first" || name == "all") {
+		return SAMPLE_ALL;
+	} else if(name == "stride") {
+		return SAMPLE_STRIDE;
+	} else if(name == "reservoir") {
+		return SAMPLE_RESERVOIR;
+	}
+	throw std::invalid_argument("Unknown sampling mode '" + name + "'");
+}
+
+size_t TrackAnalysis::getCatalogEvents(const std::vector<std::string>& files) const
+{
+	size_t numEvents = 0;
+	for(const auto& filename: files) {
+		RunCatalog::stats_t stats;
+		try {
+			if(!_catalog->get(filename, stats)) {
+				return 0;
+			}
+		} catch(std::runtime_error& e) {
+			std::cerr << e.what() << std::endl;
+			return 0;
+		}
+		numEvents += stats.numEvents;
+	}
+	return numEvents;
+}
+
+void TrackAnalysis::distributeSamples(std::vector<run_read_pair_t>& readers) const
+{
+	// proportional to the number of events of the runs if all of them are known from the catalog or from the
+	// index used for seeking, building an index would be another pass over the files
+	std::vector<size_t> sizes;
+	size_t total = 0;
+	for(const auto& read: readers) {
+		size_t numEvents = read.numEvents;
+		if(!numEvents && read.pixelreader->getUseIndex()) {
+			auto index = read.pixelreader->getIndex();
+			numEvents = index ? index->size() : 0;
+		}
+		if(!numEvents) {
+			total = 0;
+			break;
+		}
+		sizes.push_back(numEvents);
+		total += numEvents;
+	}
+	for(size_t i = 0; i < readers.size(); ++i) {
+		size_t size = total ? (size_t)((double)_numSamples * sizes[i] / total + 0.5) : _numSamples / readers.size();
+		readers[i].sampleSize = std::max<size_t>(1, size);
+	}
+}
+
 void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pair_t>& reader, const process_t& process)
 {
+	_reservoirs.clear();
 	_rerunNumber = 0;
 	do {
 		if(process.init) {
 			process.init();
 		}
 		_rerunProcess = false;
-		size_t evtCount = 0;
-		if(process.mode == CS_ALWAYS && process.run) {
+		if(process.run) {
 			for(const auto& read: reader) {
 				_currentRunId = read.runId;
 				_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(_currentRunId)));
@@ -222,62 +418,12 @@ void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pai
 					process.run_init();
 				}
 				_analysisRunning = true;
-				evtCount = 0;
-				auto track_it = read.trackreader.begin();
-				for(const auto& pixel: *read.pixelreader) {
-					while(track_it->eventNumber < (int)pixel.eventNumber + _dataOffset && track_it != read.trackreader.end())
-						++track_it;
-					TrackStreamReader::event_t track = *track_it;
-					if(track.eventNumber != pixel.eventNumber) {
-						track.tracks.clear();
-						track.eventNumber = pixel.eventNumber;
-					}
-					if(evtCount % 1000 == 0) {
-						std::cout << process.name << ": Processing step " << evtCount;
-						if(_rerunNumber)
-							std::cout << " rerun " << _rerunNumber;
-						std::cout << " for MPA run " << read.runId << std::endl;
-					}
-					++evtCount;
-					if(!process.run(track, pixel))
-						break;
-				}
-				_analysisRunning = false;
-				if(process.run_post) {
-					process.run_post();
-				}
-			}
-		} else if (process.run) {
-			for(const auto& read: reader) {
-				_currentRunId = read.runId;
-				_config.setVariable("TelRun", getRunIdPadded(_runlist.getTelRunByMpaRun(_currentRunId)));
-				_config.setVariable("MpaRun", getMpaIdPadded(_currentRunId));
-				if(process.run_init) {
-					process.run_init();
-				}
-				_analysisRunning = true;
-				evtCount = 0;
-				auto pixel_it = read.pixelreader->begin();
-				for(const auto& track: read.trackreader) {
-					while((int)pixel_it->eventNumber + _dataOffset < track.eventNumber &&
-					      pixel_it != read.pixelreader->end())
-						++pixel_it;
-					if((int)pixel_it->eventNumber + _dataOffset > track.eventNumber) {
-						continue;
-					}
-					if(evtCount % 1000 == 0) {
-						std::cout << process.name <<  ": Processing step " << evtCount;
-						if(_rerunNumber)
-							std::cout << " rerun " << _rerunNumber;
-						std::cout << " event no. " << track.eventNumber << "/" << pixel_it->eventNumber;
-						std::cout << " for MPA run " << _currentRunId << std::endl;
-					}
-					++evtCount;
-					if(pixel_it == read.pixelreader->end())
-						break;
-					assert((int)pixel_it->eventNumber + _dataOffset == track.eventNumber);
-					if(!process.run(track, *pixel_it))
-						break;
+				if(_samplingMode == SAMPLE_STRIDE) {
+					joinStride(read, process);
+				} else if(_samplingMode == SAMPLE_RESERVOIR) {
+					joinReservoir(read, process);
+				} else {
+					join(read, process, process.run);
 				}
 				_analysisRunning = false;
 				if(process.run_post) {
@@ -290,4 +436,162 @@ void TrackAnalysis::executeProcess(const std::vector<TrackAnalysis::run_read_pai
 		}
 		++_rerunNumber;
 	} while(_rerunProcess);
+	_reservoirs.clear();
+}
+
+void TrackAnalysis::join(const run_read_pair_t& read, const process_t& process, const run_callback_t& run)
+{
+	size_t evtCount = 0;
+	if(process.mode == CS_ALWAYS) {
+		auto track_it = read.trackreader.begin();
+		// pixel events without tracks are passed this sentinel, so track events are never copied
+		TrackStreamReader::event_t noTracks;
+		for(const auto& pixel: *read.pixelreader) {
+			const int dataOffset = getDataOffset(read, pixel.eventNumber);
+			while(track_it->eventNumber < (int)pixel.eventNumber + dataOffset && track_it != read.trackreader.end())
+				++track_it;
+			const TrackStreamReader::event_t* trackEvent = &*track_it;
+			if(trackEvent->eventNumber != (int)pixel.eventNumber + dataOffset) {
+				noTracks.eventNumber = pixel.eventNumber;
+				noTracks.runID = trackEvent->runID;
+				trackEvent = &noTracks;
+			}
+			const TrackStreamReader::event_t& track = *trackEvent;
+			if(!_eventFilter.acceptsTracks(track.tracks.size())) {
+				continue;
+			}
+			if(evtCount % 1000 == 0) {
+				std::cout << process.name << ": Processing step " << evtCount;
+				if(_rerunNumber)
+					std::cout << " rerun " << _rerunNumber;
+				std::cout << " for MPA run " << read.runId << std::endl;
+			}
+			++evtCount;
+			if(!run(track, pixel))
+				break;
+		}
+	} else {
+		auto pixel_it = read.pixelreader->begin();
+		for(const auto& track: read.trackreader) {
+			if(!_eventFilter.acceptsTracks(track.tracks.size())) {
+				continue;
+			}
+			while(pixel_it != read.pixelreader->end() &&
+			      (int)pixel_it->eventNumber + getDataOffset(read, pixel_it->eventNumber) < track.eventNumber)
+				++pixel_it;
+			if(pixel_it != read.pixelreader->end() &&
+			   (int)pixel_it->eventNumber + getDataOffset(read, pixel_it->eventNumber) > track.eventNumber) {
+				continue;
+			}
+			if(evtCount % 1000 == 0) {
+				std::cout << process.name <<  ": Processing step " << evtCount;
+				if(_rerunNumber)
+					std::cout << " rerun " << _rerunNumber;
+				std::cout << " event no. " << track.eventNumber << "/" << pixel_it->eventNumber;
+				std::cout << " for MPA run " << _currentRunId << std::endl;
+			}
+			++evtCount;
+			if(pixel_it == read.pixelreader->end())
+				break;
+			assert((int)pixel_it->eventNumber + getDataOffset(read, pixel_it->eventNumber) == track.eventNumber);
+			if(!run(track, *pixel_it))
+				break;
+		}
+	}
+}
+
+void TrackAnalysis::joinStride(const run_read_pair_t& read, const process_t& process)
+{
+	auto index = read.pixelreader->getIndex();
+	if(!index) {
+		std::cout << process.name << ": No event index for MPA run " << read.runId
+		          << ", using reservoir sampling" << std::endl;
+		joinReservoir(read, process);
+		return;
+	}
+	const size_t numEvents = index->size();
+	const size_t stride = std::max<size_t>(1, numEvents / std::max<size_t>(1, read.sampleSize));
+	// every pass visits every stride-th event of the whole run, the passes start at shuffled phases until
+	// the run has supplied its share of the sample
+	std::vector<size_t> phases(stride);
+	for(size_t i = 0; i < stride; ++i) {
+		phases[i] = i;
+	}
+	std::mt19937_64 gen(_samplingSeed + read.runId);
+	// Fisher-Yates with the raw generator output, reproducible across standard libraries
+	for(size_t i = stride; i > 1; --i) {
+		std::swap(phases[i-1], phases[gen() % i]);
+	}
+	auto pixel_it = read.pixelreader->begin();
+	auto track_it = read.trackreader.begin();
+	TrackStreamReader::event_t noTracks;
+	noTracks.runID = track_it != read.trackreader.end() ? track_it->runID : 0;
+	size_t evtCount = 0;
+	for(auto phase: phases) {
+		for(size_t i = phase; i < numEvents; i += stride) {
+			if(!pixel_it.seek(i)) {
+				continue;
+			}
+			const auto& pixel = *pixel_it;
+			const int trackEventNumber = (int)pixel.eventNumber + getDataOffset(read, pixel.eventNumber);
+			const TrackStreamReader::event_t* trackEvent = &noTracks;
+			if(track_it.seekEvent(trackEventNumber) && track_it->eventNumber == trackEventNumber) {
+				trackEvent = &*track_it;
+			} else if(process.mode == CS_TRACK) {
+				continue;
+			} else {
+				noTracks.eventNumber = pixel.eventNumber;
+			}
+			if(!_eventFilter.acceptsTracks(trackEvent->tracks.size())) {
+				continue;
+			}
+			if(evtCount % 1000 == 0) {
+				std::cout << process.name << ": Processing sample " << evtCount;
+				if(_rerunNumber)
+					std::cout << " rerun " << _rerunNumber;
+				std::cout << " for MPA run " << read.runId << std::endl;
+			}
+			++evtCount;
+			if(!process.run(*trackEvent, pixel) || evtCount >= read.sampleSize) {
+				return;
+			}
+		}
+	}
+}
+
+void TrackAnalysis::joinReservoir(const run_read_pair_t& read, const process_t& process)
+{
+	// the same seed would select the same events again
+	auto cached = _reservoirs.find(read.runId);
+	if(cached == _reservoirs.end()) {
+		std::vector<sample_t> reservoir;
+		reservoir.reserve(read.sampleSize);
+		std::mt19937_64 gen(_samplingSeed + read.runId);
+		size_t numSeen = 0;
+		join(read, process, [&](const TrackStreamReader::event_t& track,
+		                        const BaseSensorStreamReader::event_t& pixel) {
+			if(reservoir.size() < read.sampleSize) {
+				reservoir.push_back({track, pixel});
+			} else {
+				// raw generator output, reproducible across standard libraries
+				const size_t j = gen() % (numSeen + 1);
+				if(j < read.sampleSize) {
+					reservoir[j] = {track, pixel};
+				}
+			}
+			++numSeen;
+			return true;
+		});
+		std::sort(reservoir.begin(), reservoir.end(), [](const sample_t& a, const sample_t& b) {
+			return a.pixel.eventNumber < b.pixel.eventNumber;
+		});
+		std::cout << process.name << ": Sampled " << reservoir.size() << " of " << numSeen
+		          << " events for MPA run " << read.runId << std::endl;
+		cached = _reservoirs.emplace(read.runId, std::move(reservoir)).first;
+	}
+	for(const auto& sample: cached->second) {
+		if(!process.run(sample.track, sample.pixel)) {
+			break;
+		}
+	}
 }
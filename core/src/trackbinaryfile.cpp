@@ -0,0 +1,180 @@
+#include "trackbinaryfile.h"
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+using namespace core;
+
+static_assert(sizeof(TrackBinaryFile::file_header_t) == 40, "Unexpected padding in file header");
+
+namespace {
+const char fileMagic[8] = {'M', 'P', 'A', 'T', 'R', 'K', 0, 0};
+const uint32_t fileVersion = 1;
+
+template<typename T>
+void writeArray(std::ofstream& fout, const std::vector<T>& data)
+{
+	fout.write(reinterpret_cast<const char*>(data.data()), data.size()*sizeof(T));
+}
+
+bool checkOffsets(const uint64_t* offsets, uint64_t num, uint64_t total)
+{
+	if(offsets[0] != 0 || offsets[num] != total) {
+		return false;
+	}
+	for(uint64_t i = 0; i < num; ++i) {
+		if(offsets[i] > offsets[i+1]) {
+			return false;
+		}
+	}
+	return true;
+}
+}
+
+TrackBinaryFile::TrackBinaryFile(const std::string& filename)
+ : _file(filename)
+{
+	if(_file.size() < sizeof(_header)) {
+		throw std::ios_base::failure(filename + ": File too short for track file header");
+	}
+	std::memcpy(&_header, _file.data(), sizeof(_header));
+	if(std::memcmp(_header.magic, fileMagic, sizeof(fileMagic)) != 0) {
+		throw std::ios_base::failure(filename + ": Not a binary track file");
+	}
+	if(_header.version != fileVersion) {
+		throw std::ios_base::failure(filename + ": Unsupported binary track file version");
+	}
+	const uint64_t expectedSize = sizeof(_header)
+		+ (_header.numEvents + 1)*sizeof(uint64_t)
+		+ (_header.numTracks + 1)*sizeof(uint64_t)
+		+ 3*_header.numPoints*sizeof(double)
+		+ 2*_header.numEvents*sizeof(int32_t)
+		+ _header.numPoints*sizeof(int32_t);
+	if(_file.size() != expectedSize) {
+		throw std::ios_base::failure(filename + ": Binary track file size does not match header");
+	}
+	// the mapping is page aligned and the arrays are sorted by alignment
+	const char* p = _file.data() + sizeof(_header);
+	_eventTrackOffsets = reinterpret_cast<const uint64_t*>(p);
+	p += (_header.numEvents + 1)*sizeof(uint64_t);
+	_trackPointOffsets = reinterpret_cast<const uint64_t*>(p);
+	p += (_header.numTracks + 1)*sizeof(uint64_t);
+	_x = reinterpret_cast<const double*>(p);
+	p += _header.numPoints*sizeof(double);
+	_y = reinterpret_cast<const double*>(p);
+	p += _header.numPoints*sizeof(double);
+	_z = reinterpret_cast<const double*>(p);
+	p += _header.numPoints*sizeof(double);
+	_eventNumbers = reinterpret_cast<const int32_t*>(p);
+	p += _header.numEvents*sizeof(int32_t);
+	_runIDs = reinterpret_cast<const int32_t*>(p);
+	p += _header.numEvents*sizeof(int32_t);
+	_sensorIDs = reinterpret_cast<const int32_t*>(p);
+	// broken offsets would lead to reads outside of the mapping later on
+	if(!checkOffsets(_eventTrackOffsets, _header.numEvents, _header.numTracks) ||
+	   !checkOffsets(_trackPointOffsets, _header.numTracks, _header.numPoints)) {
+		throw std::ios_base::failure(filename + ": Inconsistent offsets in binary track file");
+	}
+	_file.adviseSequential();
+}
+
+bool TrackBinaryFile::isBinaryFile(const std::string& filename)
+{
+	const std::string extension(".trk");
+	return filename.size() >= extension.size() &&
+	       filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void TrackBinaryFile::readEvent(size_t index, TrackStreamReader::event_t& event) const
+{
+	assert(index < _header.numEvents);
+	event.eventNumber = _eventNumbers[index];
+	event.runID = _runIDs[index];
+	const uint64_t firstTrack = _eventTrackOffsets[index];
+	const uint64_t lastTrack = _eventTrackOffsets[index+1];
+	event.tracks.resize(lastTrack - firstTrack);
+	for(uint64_t tr = firstTrack; tr < lastTrack; ++tr) {
+		auto& track = event.tracks[tr - firstTrack];
+		const uint64_t begin = _trackPointOffsets[tr];
+		const uint64_t end = _trackPointOffsets[tr+1];
+		track.sensorIDs.assign(_sensorIDs + begin, _sensorIDs + end);
+		track.points.resize(end - begin);
+		for(uint64_t pt = begin; pt < end; ++pt) {
+			track.points[pt - begin] = Eigen::Vector3d(_x[pt], _y[pt], _z[pt]);
+		}
+	}
+}
+
+void TrackBinaryFile::readEvent(size_t index, TrackStreamReader::event_t& event, const std::vector<int>& sensors) const
+{
+	if(sensors.empty()) {
+		readEvent(index, event);
+		return;
+	}
+	assert(index < _header.numEvents);
+	event.eventNumber = _eventNumbers[index];
+	event.runID = _runIDs[index];
+	const uint64_t firstTrack = _eventTrackOffsets[index];
+	const uint64_t lastTrack = _eventTrackOffsets[index+1];
+	event.tracks.resize(lastTrack - firstTrack);
+	for(uint64_t tr = firstTrack; tr < lastTrack; ++tr) {
+		auto& track = event.tracks[tr - firstTrack];
+		track.sensorIDs.clear();
+		track.points.clear();
+		// only the sensor ID column is touched for the skipped points
+		for(uint64_t pt = _trackPointOffsets[tr]; pt < _trackPointOffsets[tr+1]; ++pt) {
+			track.sensorIDs.push_back(_sensorIDs[pt]);
+			if(std::find(sensors.begin(), sensors.end(), _sensorIDs[pt]) == sensors.end()) {
+				track.points.push_back(TrackStreamReader::getSkippedPosition());
+			} else {
+				track.points.push_back(Eigen::Vector3d(_x[pt], _y[pt], _z[pt]));
+			}
+		}
+	}
+}
+
+size_t TrackBinaryFile::write(const TrackStreamReader& source, const std::string& filename)
+{
+	std::vector<uint64_t> eventTrackOffsets(1, 0);
+	std::vector<uint64_t> trackPointOffsets(1, 0);
+	std::vector<double> x, y, z;
+	std::vector<int32_t> eventNumbers, runIDs, sensorIDs;
+	for(const auto& event: source) {
+		eventNumbers.push_back(event.eventNumber);
+		runIDs.push_back(event.runID);
+		for(const auto& track: event.tracks) {
+			for(size_t i = 0; i < track.points.size(); ++i) {
+				x.push_back(track.points[i](0));
+				y.push_back(track.points[i](1));
+				z.push_back(track.points[i](2));
+				sensorIDs.push_back(track.sensorIDs[i]);
+			}
+			trackPointOffsets.push_back(x.size());
+		}
+		eventTrackOffsets.push_back(trackPointOffsets.size() - 1);
+	}
+	file_header_t header;
+	std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+	header.version = fileVersion;
+	header.reserved = 0;
+	header.numEvents = eventNumbers.size();
+	header.numTracks = trackPointOffsets.size() - 1;
+	header.numPoints = x.size();
+
+	std::ofstream fout;
+	fout.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+	fout.open(filename, std::ios_base::binary | std::ios_base::trunc);
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writeArray(fout, eventTrackOffsets);
+	writeArray(fout, trackPointOffsets);
+	writeArray(fout, x);
+	writeArray(fout, y);
+	writeArray(fout, z);
+	writeArray(fout, eventNumbers);
+	writeArray(fout, runIDs);
+	writeArray(fout, sensorIDs);
+	fout.close();
+	return header.numEvents;
+}
@@ -1,31 +1,102 @@
 
 #include "trackstreamreader.h"
+#include "trackbinaryfile.h"
+#include "paralleltrackloader.h"
 #include <cassert>
 #include <regex.h>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "numberparse.h"
 
 using namespace core;
 
 #define REG_SUBSTR(str, match) str.substr(match.rm_so, match.rm_eo - match.rm_so)
 
-TrackStreamReader::EventIterator::EventIterator(const std::string& filename, bool end) :
- _fin(), _filename(filename), _end(end), _currentEvent(), _nextEvent(),_regexCompiled(false), _eventsRead(0),
+TrackStreamReader::EventIterator::EventIterator(const std::string& filename, bool end, parse_mode_t mode,
+	std::shared_ptr<const EventIndex> index, size_t firstEvent, size_t numEvents,
+	const std::vector<int>& sensors, std::shared_ptr<const EventFilter> filter) :
+ _fin(), _filename(filename), _end(end), _currentEvent(), _nextEvent(), _parseMode(mode), _binary(),
+ _index(index), _sensors(sensors), _filter(), _remaining(npos), _restart(false), _prefetch(), _regexCompiled(false), _eventsRead(0),
  _currentLineNo(0)
 {
+	if(!_end && numEvents == 0) {
+		_end = true;
+	}
 	if(!_end) {
-		compileRegex();
-		open();
+		if(TrackBinaryFile::isBinaryFile(_filename)) {
+			_binary.reset(new TrackBinaryFile(_filename));
+			_eventsRead = firstEvent;
+		} else {
+			if(_parseMode == PARSE_REGEX) {
+				compileRegex();
+			}
+			open();
+			if(firstEvent > 0 && _index) {
+				if(firstEvent >= _index->size()) {
+					_end = true;
+					return;
+				}
+				_fin.seekg(_index->getOffset(firstEvent));
+				_currentLineNo = _index->getLinesBefore(firstEvent);
+				_eventsRead = firstEvent;
+				_restart = true;
+			}
+			// no index, read and discard the leading events
+			for(size_t i = _eventsRead; i < firstEvent && !_end; ++i) {
+				++(*this);
+			}
+			if(_end) {
+				return;
+			}
+		}
+		// the leading events are skipped regardless of the filter
+		_filter = filter;
+		_remaining = numEvents;
 		++(*this);
 	}
 }
 
 TrackStreamReader::EventIterator::EventIterator(const EventIterator& other)
  : _fin(), _filename(other._filename), _end(other._end), 
-   _currentEvent(other._currentEvent), _nextEvent(other._nextEvent), _regexCompiled(false),
-   _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo)
+   _currentEvent(other._currentEvent), _nextEvent(other._nextEvent), _parseMode(other._parseMode),
+   _binary(other._binary), _index(other._index), _sensors(other._sensors), _filter(other._filter),
+   _remaining(other._remaining),
+   _restart(other._restart),
+   _prefetch(), _regexCompiled(false), _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo)
 {
-	if(!_end) {
-		compileRegex();
+	// the prefetch thread cannot be shared, the copy reads synchronously from the same position
+	if(!_end && other._prefetch) {
+		if(_filter) {
+			// _eventsRead only counts the accepted events, search the current event from the start
+			const int eventNumber = other.getEventNumber();
+			const size_t remaining = _remaining;
+			*this = EventIterator(_filename, false, _parseMode, _index, 0, npos, _sensors, _filter);
+			while(!_end && getEventNumber() < eventNumber) {
+				++(*this);
+			}
+			_remaining = remaining;
+			return;
+		}
+		*this = EventIterator(_filename, false, _parseMode, _index, _eventsRead - 1,
+			_remaining == npos ? npos : _remaining + 1, _sensors);
+		return;
+	}
+	if(!_end && !_binary && _index) {
+		if(_parseMode == PARSE_REGEX) {
+			compileRegex();
+		}
+		// the file is opened by the next increment, which continues at the index position of the next
+		// event instead of the point of it buffered in _nextEvent
+		_nextEvent.tracks.clear();
+		return;
+	}
+	// binary files are shared, only text files need to be reopened
+	if(!_end && !_binary) {
+		if(_parseMode == PARSE_REGEX) {
+			compileRegex();
+		}
 		open();
 		_fin.seekg(other._fin.tellg());
 	}
@@ -39,15 +110,19 @@ TrackStreamReader::EventIterator::EventIterator(EventIterator&& other) noexcept
 #endif
  _filename(other._filename), _end(other._end),
  _currentEvent(std::move(other._currentEvent)),
- _nextEvent(std::move(other._nextEvent)),
- _regexCompiled(other._regexCompiled), _regexLine(other._regexLine), _regexComment(other._regexComment),
- _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo)
+ _nextEvent(std::move(other._nextEvent)), _parseMode(other._parseMode),
+ _binary(std::move(other._binary)), _index(std::move(other._index)), _sensors(std::move(other._sensors)),
+ _filter(std::move(other._filter)), _remaining(other._remaining),
+ _restart(other._restart), _prefetch(std::move(other._prefetch)), _regexCompiled(other._regexCompiled), _regexLine(other._regexLine), _regexComment(other._regexComment),
+ _eventsRead(other._eventsRead), _currentLineNo(other._currentLineNo), _collector(std::move(other._collector))
 {
 #ifdef NO_IOSTREAM_MOVE
-	open();
-	_fin.seekg(other._fin.tellg());
-	other._regexCompiled = false; // steal ownership of compiled regexes
+	if(!_end && !_binary && other._fin.is_open()) {
+		open();
+		_fin.seekg(other._fin.tellg());
+	}
 #endif
+	other._regexCompiled = false; // steal ownership of compiled regexes
 }
 
 TrackStreamReader::EventIterator::~EventIterator()
@@ -70,8 +145,10 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator=(Ev
 {
 	_fin.close();
 #ifdef NO_IOSTREAM_MOVE
-	open();
-	_fin.seekg(other._fin.tellg());
+	if(!other._end && !other._binary && other._fin.is_open()) {
+		open();
+		_fin.seekg(other._fin.tellg());
+	}
 #else
 	_fin = std::move(other._fin);
 #endif
@@ -79,11 +156,24 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator=(Ev
 	_end = other._end;
 	_currentEvent = std::move(other._currentEvent);
 	_nextEvent = std::move(other._nextEvent);
+	_parseMode = other._parseMode;
+	_binary = std::move(other._binary);
+	_index = std::move(other._index);
+	_sensors = std::move(other._sensors);
+	_filter = std::move(other._filter);
+	_remaining = other._remaining;
+	_restart = other._restart;
+	_prefetch = std::move(other._prefetch);
+	if(_regexCompiled) {
+		regfree(&_regexLine);
+		regfree(&_regexComment);
+	}
 	_regexCompiled = other._regexCompiled;
 	_regexLine = other._regexLine;
-	_regexComment = other._regexLine;
+	_regexComment = other._regexComment;
 	_eventsRead = other._eventsRead;
 	_currentLineNo = other._currentLineNo;
+	_collector = std::move(other._collector);
 	other._regexCompiled = false; // steal regex ownership
 	return *this;
 }
@@ -103,11 +193,142 @@ bool TrackStreamReader::EventIterator::operator!=(const EventIterator& other) co
 
 TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 {
-	assert(_regexCompiled);
+	if(_collector && !_end) {
+		_collector->addEvent(_currentEvent.eventNumber, _currentEvent.tracks.size());
+	}
+	increment();
+	if(_end && _collector) {
+		_collector->finish();
+		_collector.reset();
+	}
+	return *this;
+}
+
+void TrackStreamReader::EventIterator::increment()
+{
+	if(_remaining == 0) {
+		_end = true;
+		return;
+	}
+	if(_remaining != npos) {
+		--_remaining;
+	}
+	// the prefetch thread applies the filter
+	if(_prefetch) {
+		if(_prefetch->next(_currentEvent)) {
+			++_eventsRead;
+		} else {
+			_end = true;
+		}
+		return;
+	}
+	do {
+		readEvent();
+	} while(!_end && _filter && !acceptsEvent());
+}
+
+bool TrackStreamReader::EventIterator::seekEvent(int eventNumber)
+{
+	if(_prefetch || (!_binary && !_index)) {
+		throw std::logic_error(_filename + ": Seeking requires an event index");
+	}
+	size_t eventIndex;
+	size_t numEvents;
+	if(_binary) {
+		numEvents = _binary->getNumEvents();
+		size_t low = 0;
+		size_t high = numEvents;
+		while(low < high) {
+			size_t mid = low + (high - low) / 2;
+			if(_binary->getEventNumber(mid) < eventNumber) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		eventIndex = low;
+	} else {
+		numEvents = _index->size();
+		eventIndex = _index->find(eventNumber);
+	}
+	_remaining = npos;
+	// not a pass over the whole file any more
+	_collector.reset();
+	if(eventIndex >= numEvents) {
+		_end = true;
+		return false;
+	}
+	_end = false;
+	_eventsRead = eventIndex;
+	if(_binary) {
+		_binary->readEvent(_eventsRead++, _currentEvent, _sensors);
+	} else {
+		// opened lazily by readEvent() otherwise
+		if(_fin.is_open()) {
+			_fin.clear();
+			_fin.seekg(_index->getOffset(eventIndex));
+			_currentLineNo = _index->getLinesBefore(eventIndex);
+			_restart = true;
+		}
+		_nextEvent.tracks.clear();
+		readEvent();
+		if(_end) {
+			return false;
+		}
+	}
+	if(_filter && !(_filter->acceptsEventNumber(_currentEvent.eventNumber) &&
+	                _filter->acceptsTracks(_currentEvent.tracks.size()))) {
+		_end = true;
+		return false;
+	}
+	return true;
+}
+
+bool TrackStreamReader::EventIterator::acceptsEvent()
+{
+	if(_filter->isPastRange(_currentEvent.eventNumber)) {
+		_end = true;
+		return false;
+	}
+	return _filter->acceptsEventNumber(_currentEvent.eventNumber) &&
+	       _filter->acceptsTracks(_currentEvent.tracks.size());
+}
+
+void TrackStreamReader::EventIterator::readEvent()
+{
+	if(_binary) {
+		// rejected events are not copied
+		while(_filter && _eventsRead < _binary->getNumEvents()) {
+			const int eventNumber = _binary->getEventNumber(_eventsRead);
+			if(_filter->isPastRange(eventNumber) || (_filter->acceptsEventNumber(eventNumber) &&
+			   _filter->acceptsTracks(_binary->getNumTracks(_eventsRead)))) {
+				break;
+			}
+			++_eventsRead;
+		}
+		if(_eventsRead >= _binary->getNumEvents()) {
+			_end = true;
+		} else {
+			_binary->readEvent(_eventsRead++, _currentEvent, _sensors);
+		}
+		return;
+	}
+	assert(_parseMode != PARSE_REGEX || _regexCompiled);
+	// copied iterator, open the file at the position of the next event
+	if(_index && !_fin.is_open()) {
+		if(_eventsRead >= _index->size()) {
+			_end = true;
+			return;
+		}
+		open();
+		_fin.seekg(_index->getOffset(_eventsRead));
+		_currentLineNo = _index->getLinesBefore(_eventsRead);
+		_restart = true;
+	}
 	// last read reached EOF, so we are an end-iterator now
 	if(!_fin.good()) {
 		_end = true;
-		return *this;
+		return;
 	}
 	std::string line;
 
@@ -117,16 +338,20 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 	_currentEvent.eventNumber = _nextEvent.eventNumber;
 	_currentEvent.runID = _nextEvent.runID;
 	Track cur_track;
+	// number of points in the current track block, including the ones of skipped sensors
+	size_t cur_points = 0;
 	if(_nextEvent.tracks.size()) {
 		cur_track = _nextEvent.tracks[0];
+		cur_points = 1;
 	}
 	_currentEvent.tracks.clear();
 	_nextEvent.tracks.clear();
 
-	bool first_event = _eventsRead == 0;
+	// no point of the current event has been read yet
+	bool first_event = _eventsRead == 0 || _restart;
+	_restart = false;
 	bool last_line_parsed = false;
 
-	regmatch_t m[10];
 	// read until event number changes
 	while(true) {
 		int num_empty_lines = 0;
@@ -139,12 +364,11 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 				break;
 		}
 		// beginning of new block or file ended, save current track into event
-		if((num_empty_lines >= 2 || (!_fin.good() && last_line_parsed)) &&
-		   cur_track.points.size()) {
+		if((num_empty_lines >= 2 || (!_fin.good() && last_line_parsed)) && cur_points) {
 			_currentEvent.tracks.push_back(cur_track);
 			cur_track.sensorIDs.clear();
 			cur_track.points.clear();
-			cur_track.sensorIDs.clear();
+			cur_points = 0;
 		}
 		// EOF! Do not convert to beyond-last-element iterator if we have a non-empty _currentEvent
 		if(!_fin.good() && last_line_parsed) {
@@ -165,29 +389,15 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 /*		if(num_empty_lines >= 2) {
 			continue;
 		}*/
+		point_t point;
 		// Is line comment? Ignore
-		if(regexec(&_regexComment, line.c_str(), 10, m, 0) != REG_NOMATCH) {
+		if(!parseLine(line, point)) {
 			continue;
 		}
-		// Try to match data regex
-		if(regexec(&_regexLine, line.c_str(), 10, m, 0) == REG_NOMATCH) {
-			throw parse_error(_filename, _currentLineNo, -1, "Line does not match regular expression");
-		}
-		double x, y, z;
-		int sensorID, eventNumber, runID;
-		try { x = std::stod(REG_SUBSTR(line, m[1])); }
-		catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[1].rm_so, e.what()); }
-		try { y = std::stod(REG_SUBSTR(line, m[2])); }
-		catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[2].rm_so, e.what()); }
-		try { z = std::stod(REG_SUBSTR(line, m[3])); }
-		catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[3].rm_so, e.what()); }
-		try { sensorID = std::stoi(REG_SUBSTR(line, m[4])); }
-		catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[4].rm_so, e.what()); }
-		try { eventNumber = std::stoi(REG_SUBSTR(line, m[5])); }
-		catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[5].rm_so, e.what()); }
-		try { runID = std::stoi(REG_SUBSTR(line, m[6])); }
-		catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[6].rm_so, e.what()); }
-		Eigen::Vector3d pos(x, y, z);
+		const int sensorID = point.sensorID;
+		const int eventNumber = point.eventNumber;
+		const int runID = point.runID;
+		const bool required = isPointRequired(point, _sensors, _filter.get());
 		if(first_event) {
 			_currentEvent.eventNumber = eventNumber;
 			_currentEvent.runID = runID;
@@ -202,7 +412,7 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 		if(eventNumber != _currentEvent.eventNumber) {
 			// Changing the event-number while constructing a track is
 			// considered a file format error
-			if(cur_track.points.size()) {
+			if(cur_points) {
 				throw consistency_error(_filename, _currentLineNo, 
 					"Event number must not change in a single track block!");
 			}
@@ -212,23 +422,156 @@ TrackStreamReader::EventIterator& TrackStreamReader::EventIterator::operator++()
 			_nextEvent.runID = runID;
 			Track tr;
 			tr.sensorIDs.push_back(sensorID);
-			tr.points.push_back(pos);
+			tr.points.push_back(required ? Eigen::Vector3d(point.x, point.y, point.z) : getSkippedPosition());
 			_nextEvent.tracks.push_back(tr);
 			// We're done
 			break;
 		} else {
 			// add data to current track
+			++cur_points;
 			cur_track.sensorIDs.push_back(sensorID);
-			cur_track.points.push_back(pos);
+			cur_track.points.push_back(required ? Eigen::Vector3d(point.x, point.y, point.z) :
+				getSkippedPosition());
 		}
 	}
+}
 
-	return *this;
+bool TrackStreamReader::EventIterator::parseLine(const std::string& line, point_t& point) const
+{
+	if(_parseMode == PARSE_REGEX) {
+		return parseLineRegex(line, point);
+	}
+	return parseLineTokenizer(line, point);
+}
+
+bool TrackStreamReader::EventIterator::parseLineRegex(const std::string& line, point_t& point) const
+{
+	regmatch_t m[10];
+	if(regexec(&_regexComment, line.c_str(), 10, m, 0) != REG_NOMATCH) {
+		return false;
+	}
+	// Try to match data regex
+	if(regexec(&_regexLine, line.c_str(), 10, m, 0) == REG_NOMATCH) {
+		throw parse_error(_filename, _currentLineNo, -1, "Line does not match regular expression");
+	}
+	try { point.x = std::stod(REG_SUBSTR(line, m[1])); }
+	catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[1].rm_so, e.what()); }
+	try { point.y = std::stod(REG_SUBSTR(line, m[2])); }
+	catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[2].rm_so, e.what()); }
+	try { point.z = std::stod(REG_SUBSTR(line, m[3])); }
+	catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[3].rm_so, e.what()); }
+	try { point.sensorID = std::stoi(REG_SUBSTR(line, m[4])); }
+	catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[4].rm_so, e.what()); }
+	try { point.eventNumber = std::stoi(REG_SUBSTR(line, m[5])); }
+	catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[5].rm_so, e.what()); }
+	try { point.runID = std::stoi(REG_SUBSTR(line, m[6])); }
+	catch(std::logic_error e) { throw parse_error(_filename, _currentLineNo, m[6].rm_so, e.what()); }
+	return true;
+}
+
+bool TrackStreamReader::EventIterator::parseLineTokenizer(const std::string& line, point_t& point) const
+{
+	return tokenizeLine(line.c_str(), point, _sensors, _filter.get(), _filename, _currentLineNo);
+}
+
+bool TrackStreamReader::tokenizeLine(const char* line, point_t& point, const std::vector<int>& sensors,
+	const EventFilter* filter, const std::string& filename, size_t lineNo)
+{
+	const char* begin = line;
+	const char* p = begin;
+	while(isSpace(*p)) ++p;
+	if(*p == '#') {
+		return false;
+	}
+	double* floats[] = { &point.x, &point.y, &point.z };
+	int* ints[] = { &point.sensorID, &point.eventNumber, &point.runID };
+	// the coordinates are converted once the sensor ID is known
+	const char* floatBegin[3];
+	const char* floatEnd[3];
+	for(size_t col = 0; col < 6; ++col) {
+		const char* field = p;
+		if(col < 3) {
+			// same character set as accepted by the regex parser
+			while((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')
+				++p;
+			if(p == field) {
+				throw parse_error(filename, lineNo, field - begin, "Expected floating point value");
+			}
+			floatBegin[col] = field;
+			floatEnd[col] = p;
+		} else {
+			p = parseInt(field, *ints[col - 3]);
+			if(!p) {
+				throw parse_error(filename, lineNo, field - begin, "Invalid integer value");
+			}
+		}
+		if(col == 5) {
+			break;
+		}
+		// columns are separated by whitespace
+		if(!isSpace(*p)) {
+			throw parse_error(filename, lineNo, p - begin, "Expected whitespace column separator");
+		}
+		while(isSpace(*p)) ++p;
+	}
+	if(!isPointRequired(point, sensors, filter)) {
+		return true;
+	}
+	for(size_t col = 0; col < 3; ++col) {
+		const char* end = parseDouble(floatBegin[col], *floats[col]);
+		if(!end || end > floatEnd[col]) {
+			throw parse_error(filename, lineNo, floatBegin[col] - begin, "Invalid floating point value");
+		}
+	}
+	return true;
+}
+
+void TrackStreamReader::EventIterator::startPrefetch(size_t depth)
+{
+	if(_end || _prefetch) {
+		return;
+	}
+	// the reading iterator is moved to the prefetch thread, this iterator only keeps its position
+	std::shared_ptr<EventIterator> source(new EventIterator(std::move(*this)));
+	_currentEvent = source->_currentEvent;
+	_index = source->_index;
+	_binary = source->_binary;
+	_sensors = source->_sensors;
+	_filter = source->_filter;
+	_prefetch.reset(new Prefetcher<event_t>(depth, [source](event_t& event) {
+		++(*source);
+		if(source->isEnd()) {
+			return false;
+		}
+		event = **source;
+		return true;
+	}));
+}
+
+void TrackStreamReader::EventIterator::startParallel(size_t numThreads, size_t depth, size_t firstEvent,
+	size_t numEvents)
+{
+	if(numEvents == 0) {
+		return;
+	}
+	std::shared_ptr<ParallelTrackLoader> loader(new ParallelTrackLoader(_filename, numThreads, 1 << 22,
+		_sensors, _filter, firstEvent));
+	_prefetch.reset(new Prefetcher<event_t>(depth, [loader](event_t& event) {
+		return loader->next(event);
+	}));
+	_end = false;
+	_eventsRead = firstEvent;
+	_remaining = numEvents;
+	++(*this);
 }
 
 TrackStreamReader::EventIterator TrackStreamReader::EventIterator::operator++(int)
 {
-	EventIterator old(*this);
+	EventIterator old(_filename, true, _parseMode);
+	old._end = _end;
+	old._currentEvent = _currentEvent;
+	old._eventsRead = _eventsRead;
+	old._remaining = 0;
 	++(*this);
 	return old;
 }
@@ -237,7 +580,8 @@ void TrackStreamReader::EventIterator::open()
 {
 	_fin.exceptions(std::ios_base::failbit);
 	_fin.open(_filename);
-	_fin.exceptions(std::ios_base::goodbit);
+	// throw on corrupt or truncated compressed data, the end of the file still just ends the stream
+	_fin.exceptions(std::ios_base::badbit);
 }
 
 void TrackStreamReader::EventIterator::compileRegex()
@@ -267,17 +611,110 @@ void TrackStreamReader::EventIterator::compileRegex()
 	_regexCompiled = true;
 }
 
-TrackStreamReader::TrackStreamReader(const std::string& filename)
- : _filename(filename)
+TrackStreamReader::TrackStreamReader(const std::string& filename, parse_mode_t mode)
+ : _filename(filename), _parseMode(mode), _useIndex(false), _firstEvent(0), _numEvents(npos),
+   _prefetchDepth(0), _numThreads(0), _sensors(), _filter(), _index()
 {
 }
 
 TrackStreamReader::EventIterator TrackStreamReader::begin() const
 {
-	return EventIterator(_filename, false);
+	if(_numThreads > 1 && _parseMode == PARSE_TOKENIZER && !TrackBinaryFile::isBinaryFile(_filename)) {
+		EventIterator it(_filename, true, _parseMode, nullptr, 0, npos, _sensors);
+		it._filter = _filter;
+		// the parsed blocks are handed to the iterator by a prefetch thread
+		it.startParallel(_numThreads, _prefetchDepth > 0 ? _prefetchDepth : 64, _firstEvent, _numEvents);
+		startCollector(it);
+		return it;
+	}
+	EventIterator it(_filename, false, _parseMode, _useIndex ? getIndex() : nullptr, _firstEvent, _numEvents,
+		_sensors, _filter);
+	if(_prefetchDepth > 0) {
+		it.startPrefetch(_prefetchDepth);
+	}
+	startCollector(it);
+	return it;
+}
+
+void TrackStreamReader::startCollector(EventIterator& it) const
+{
+	if(!_catalog || _firstEvent != 0 || _numEvents != npos || _filter) {
+		return;
+	}
+	it._collector = std::make_shared<RunCatalog::Collector>(_catalog, _filename);
+	// empty file
+	if(it._end) {
+		it._collector->finish();
+		it._collector.reset();
+	}
+}
+
+void TrackStreamReader::probe() const
+{
+	if(TrackBinaryFile::isBinaryFile(_filename)) {
+		TrackBinaryFile file(_filename);
+		return;
+	}
+	InputStream fin;
+	fin.exceptions(std::ios_base::failbit);
+	fin.open(_filename);
+}
+
+std::shared_ptr<const EventIndex> TrackStreamReader::getIndex() const
+{
+	// binary files provide random access by themselves
+	if(!_index && !TrackBinaryFile::isBinaryFile(_filename)) {
+		_index = EventIndex::get(_filename, buildIndex);
+	}
+	return _index;
+}
+
+void TrackStreamReader::buildIndex(const char* data, size_t size, EventIndex& index)
+{
+	const char* begin = data;
+	const char* end = begin + size;
+	const char* line = begin;
+	uint64_t lineNo = 0;
+	bool firstEvent = true;
+	int currentEventNumber = 0;
+	while(line < end) {
+		const char* eol = static_cast<const char*>(std::memchr(line, '\n', end - line));
+		if(!eol) {
+			eol = end;
+		}
+		const char* p = line;
+		while(p < eol && isSpace(*p)) ++p;
+		// skip empty and comment lines
+		if(p < eol && *p != '#') {
+			// event number is the fifth column
+			for(int col = 0; col < 4 && p < eol; ++col) {
+				while(p < eol && !isSpace(*p)) ++p;
+				while(p < eol && isSpace(*p)) ++p;
+			}
+			bool negative = p < eol && *p == '-';
+			if(negative) ++p;
+			// malformed lines are not indexed, the parser reports them
+			if(p < eol && *p >= '0' && *p <= '9') {
+				int eventNumber = 0;
+				for(; p < eol && *p >= '0' && *p <= '9'; ++p) {
+					eventNumber = eventNumber*10 + (*p - '0');
+				}
+				if(negative) {
+					eventNumber = -eventNumber;
+				}
+				if(firstEvent || eventNumber != currentEventNumber) {
+					index.add(line - begin, lineNo, eventNumber);
+					currentEventNumber = eventNumber;
+					firstEvent = false;
+				}
+			}
+		}
+		line = eol + 1;
+		++lineNo;
+	}
 }
 
 TrackStreamReader::EventIterator TrackStreamReader::end() const
 {
-	return EventIterator(_filename, true);
+	return EventIterator(_filename, true, _parseMode);
 }
@@ -1,6 +1,7 @@
 #include "triplettrack.h"
 #include <TFitResult.h>
 #include "mpahitgenerator.h"
+#include "runsnapshot.h"
 #include <iostream>
 #include "aligner.h"
 
@@ -42,8 +43,8 @@ std::vector<core::TripletTrack> TripletTrack::getTracks(constants_t consts,
                                                         histograms_t* hist)
 {
 	std::vector<core::TripletTrack> candidates;
-	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+	for(size_t evt = 0; evt < core::getEntries(run); ++evt) {
+		core::getEntry(run, evt);
 		auto downstream = core::Triplet::findTriplets(run, consts.angle_cut, consts.downstream_residual_cut, {3, 4, 5});
 		if(hist) {
 			// debug histograms
@@ -109,8 +110,8 @@ std::vector<core::TripletTrack> TripletTrack::getTracksWithRef(constants_t const
 {
 	assert(hist.down_angle_x);
 	std::vector<core::TripletTrack> candidates;
-	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+	for(size_t evt = 0; evt < core::getEntries(run); ++evt) {
+		core::getEntry(run, evt);
 		auto downstream = core::Triplet::findTriplets(run, consts.angle_cut, consts.downstream_residual_cut, {3, 4, 5});
 		// debug histograms
 		for(const auto& triplet: downstream) {
@@ -224,8 +225,8 @@ std::vector<std::pair<core::TripletTrack, Eigen::Vector3d>> TripletTrack::getTra
 	transform.setOffset(consts.dut_offset);
 	transform.setRotation(consts.dut_rotation);
 	int numMpa = 0;
-	for(size_t evt = 0; evt < run.tree->GetEntries(); ++evt) {
-		run.tree->GetEntry(evt);
+	for(size_t evt = 0; evt < core::getEntries(run); ++evt) {
+		core::getEntry(run, evt);
 		auto downstream = core::Triplet::findTriplets(run, consts.angle_cut, consts.downstream_residual_cut, {3, 4, 5});
 		// debug histograms
 		for(const auto& triplet: downstream) {
@@ -0,0 +1,110 @@
+#include "desyncdetector.h"
+#include "dataoffsetmap.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <random>
+#include <map>
+
+using namespace core;
+
+/// Feeds a detector with events whose offset is 0 before switchEvent and newOffset after it
+static void feedDetector(DesyncDetector& detector, int numEvents, int switchEvent, int newOffset)
+{
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> position(-20., 20.);
+	std::normal_distribution<double> resolution(0., 0.05);
+	std::uniform_int_distribution<int> multiplicity(0, 3);
+	std::map<int, std::vector<double>> pixels;
+	std::map<int, std::vector<double>> tracks;
+	for(int evt = 0; evt < numEvents; ++evt) {
+		int offset = evt < switchEvent ? 0 : newOffset;
+		int hits = multiplicity(gen);
+		for(int i = 0; i < hits; ++i) {
+			double x = position(gen);
+			pixels[evt].push_back(x);
+			// constant misalignment of the sensor
+			tracks[evt + offset].push_back(x + 1.3 + resolution(gen));
+		}
+		// tracks not passing the sensor
+		tracks[evt].push_back(position(gen) + 50.);
+	}
+	for(int evt = 0; evt < numEvents; ++evt) {
+		detector.addEvent(evt, pixels[evt], tracks[evt]);
+	}
+	detector.finish();
+}
+
+TEST(desync_detector, constant_offset)
+{
+	DesyncDetector detector(5);
+	feedDetector(detector, 10000, 10000, 0);
+	ASSERT_TRUE(detector.isSynchronised());
+	EXPECT_EQ(detector.getOffset(), 0);
+	ASSERT_EQ(detector.getOffsetMap().getSegments().size(), 1u);
+	EXPECT_EQ(detector.getOffsetMap().getSegments()[0].firstEvent, 0);
+	EXPECT_EQ(detector.getOffsetMap().getSegments()[0].offset, 0);
+}
+
+TEST(desync_detector, offset_jump)
+{
+	DesyncDetector detector(5);
+	feedDetector(detector, 10000, 4000, 2);
+	ASSERT_TRUE(detector.isSynchronised());
+	EXPECT_EQ(detector.getOffset(), 2);
+	const auto& segments = detector.getOffsetMap().getSegments();
+	ASSERT_EQ(segments.size(), 2u);
+	EXPECT_EQ(segments[0].firstEvent, 0);
+	EXPECT_EQ(segments[0].offset, 0);
+	EXPECT_NEAR(segments[1].firstEvent, 4000, 5);
+	EXPECT_EQ(segments[1].offset, 2);
+}
+
+TEST(desync_detector, no_correlation)
+{
+	DesyncDetector detector(5);
+	std::mt19937 gen(1);
+	std::uniform_real_distribution<double> position(-20., 20.);
+	for(int evt = 0; evt < 5000; ++evt) {
+		detector.addEvent(evt, {position(gen)}, {position(gen)});
+	}
+	detector.finish();
+	EXPECT_FALSE(detector.isSynchronised());
+	EXPECT_TRUE(detector.getOffsetMap().empty());
+}
+
+TEST(data_offset_map, get_offset)
+{
+	DataOffsetMap map;
+	EXPECT_EQ(map.getOffset(100, 3), 3);
+	map.add(10, 0);
+	map.add(500, 0);
+	map.add(1000, 2);
+	EXPECT_EQ(map.getSegments().size(), 2u) << "Segment with unchanged offset was not merged.";
+	EXPECT_EQ(map.getOffset(5, 3), 3);
+	EXPECT_EQ(map.getOffset(10, 3), 0);
+	EXPECT_EQ(map.getOffset(999, 3), 0);
+	EXPECT_EQ(map.getOffset(1000, 3), 2);
+	EXPECT_EQ(map.getOffset(100000, 3), 2);
+	EXPECT_THROW(map.add(1000, 1), std::invalid_argument);
+}
+
+TEST(data_offset_map, read_write)
+{
+	char s[4096];
+	std::string filename = std::tmpnam(s);
+	DataOffsetMap map;
+	map.add(0, 1);
+	map.add(18237, -2);
+	map.write(filename);
+	DataOffsetMap loaded;
+	loaded.read(filename);
+	ASSERT_EQ(loaded.getSegments().size(), 2u);
+	EXPECT_EQ(loaded.getSegments()[1].firstEvent, 18237);
+	EXPECT_EQ(loaded.getSegments()[1].offset, -2);
+	std::remove(filename.c_str());
+	EXPECT_THROW(loaded.read(filename), std::ios_base::failure);
+}
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -1,11 +1,24 @@
 
 #include "mpastreamreader.h"
+#include "mpamemorystreamreader.h"
+#include "mpabinarystreamreader.h"
+#include "prefetchsensorstreamreader.h"
+#include "parallelmpaloader.h"
+#include "parallelmpastreamreader.h"
+#include "multipartsensorstreamreader.h"
+#include "inputstream.h"
 #include "gtest/gtest.h"
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <random>
+#include <chrono>
+#include <regex.h>
 
 using namespace core;
 
+const size_t numLargeEvents = 200000;
+
 class DataFileEnv : public ::testing::Environment
 {
 public:
@@ -19,18 +32,112 @@ public:
 		     << "[21, 22, 23, 24, 25, 26, 27, 28, 29, 30]\n";
 		fout.flush();
 		fout.close();
+
+		// larger file with realistic event size for comparison with the regex parser
+		largeFilename = std::tmpnam(s);
+		fout.open(largeFilename);
+		std::mt19937 gen(42);
+		std::uniform_int_distribution<int> counter(0, 70000);
+		std::uniform_int_distribution<int> occupied(0, 9);
+		for(size_t evt = 0; evt < numLargeEvents; ++evt) {
+			fout << "[";
+			for(size_t pixel = 0; pixel < 48; ++pixel) {
+				fout << (occupied(gen) == 0 ? counter(gen) : 0);
+				if(pixel < 47) {
+					fout << ", ";
+				}
+			}
+			fout << "]\n";
+			if(evt % 1000 == 0) {
+				fout << "\r\n";
+			}
+		}
+		fout.flush();
+		fout.close();
+
+		// 16 bit counters for the binary format
+		counterFilename = std::tmpnam(s);
+		fout.open(counterFilename);
+		std::uniform_int_distribution<int> counter16(0, 65535);
+		for(size_t evt = 0; evt < numLargeEvents/10; ++evt) {
+			fout << "[";
+			for(size_t pixel = 0; pixel < 48; ++pixel) {
+				fout << counter16(gen) << (pixel < 47 ? ", " : "]\n");
+			}
+		}
+		fout.flush();
+		fout.close();
+		binaryFilename = std::tmpnam(s);
+
+		memoryFilename = std::tmpnam(s);
+		fout.open(memoryFilename);
+		std::uniform_int_distribution<int> bit(0, 30);
+		for(size_t evt = 0; evt < 500; ++evt) {
+			fout << "[";
+			for(size_t slot = 0; slot < 96; ++slot) {
+				fout << "'11111111";
+				for(size_t i = 0; i < 64; ++i) {
+					fout << (bit(gen) == 0 ? '1' : '0');
+				}
+				fout << (slot < 95 ? "', " : "'");
+			}
+			fout << "]\n";
+		}
+		fout.flush();
+		fout.close();
 	}
 
 	virtual void TearDown()
 	{
 		std::remove(filename.c_str());
+		std::remove(largeFilename.c_str());
+		std::remove(memoryFilename.c_str());
+		std::remove(counterFilename.c_str());
+		std::remove(binaryFilename.c_str());
 	}
 
 	std::string getFilename() const { return filename; }
+	std::string getLargeFilename() const { return largeFilename; }
+	std::string getMemoryFilename() const { return memoryFilename; }
+	std::string getCounterFilename() const { return counterFilename; }
+	std::string getBinaryFilename() const { return binaryFilename; }
 private:
 	std::string filename;
+	std::string largeFilename;
+	std::string memoryFilename;
+	std::string counterFilename;
+	std::string binaryFilename;
 };
 
+/** Reference implementation of the former regex-based counter line parser */
+std::vector<std::vector<int>> readWithRegex(const std::string& filename)
+{
+	std::vector<std::vector<int>> events;
+	std::ifstream fin(filename);
+	regex_t regex;
+	regcomp(&regex, "[0-9]+", REG_EXTENDED);
+	std::string line;
+	while(std::getline(fin, line)) {
+		if(line == "\r" || line == "")
+			continue;
+		if(!fin.good())
+			break;
+		std::vector<int> data;
+		size_t offset = 0;
+		regmatch_t m[1];
+		while(regexec(&regex, line.c_str()+offset, 1, m, 0) == 0) {
+			data.push_back(std::stoi(line.substr(offset+m[0].rm_so, m[0].rm_eo - m[0].rm_so)));
+			if(offset >= line.length()) {
+				break;
+			}
+			offset += m[0].rm_eo;
+		}
+		events.push_back(data);
+	}
+	regfree(&regex);
+	return events;
+}
+
 DataFileEnv* env;
 
 TEST(mpastreamreader, read)
@@ -57,7 +164,817 @@ TEST(mpastreamreader, filenotfound)
 		MPAStreamReader reader(env->getFilename()+"abc");
 		reader.begin();
 	}, std::ios_base::failure);
+	MPAStreamReader reader(env->getFilename()+"abc");
+	EXPECT_THROW(reader.probe(), std::ios_base::failure);
+	reader.setFilename(env->getFilename());
+	EXPECT_NO_THROW(reader.probe());
+}
+
+TEST(mpastreamreader, move_iterator)
+{
+	MPAStreamReader reader(env->getLargeFilename());
+	auto it = reader.begin();
+	++it;
+	auto moved = std::move(it);
+	EXPECT_TRUE(it == reader.end());
+	EXPECT_EQ(moved->eventNumber, 1);
+	++moved;
+	EXPECT_EQ(moved->eventNumber, 2);
+
+	it = std::move(moved);
+	EXPECT_TRUE(moved == reader.end());
+	EXPECT_EQ(it->eventNumber, 2);
+	BaseSensorStreamReader::const_iterator cit(std::move(it));
+	EXPECT_EQ(cit->eventNumber, 2);
+
+	// post-increment returns the previous event without copying the reader
+	auto old = cit++;
+	EXPECT_EQ(old->eventNumber, 2);
+	EXPECT_EQ(cit->eventNumber, 3);
+	EXPECT_FALSE(old == cit);
+	++old;
+	EXPECT_TRUE(old == reader.end());
+	EXPECT_EQ((*cit++).eventNumber, 3);
+	EXPECT_EQ(cit->eventNumber, 4);
+
+	// assigning end iterators
+	it = reader.end();
+	EXPECT_TRUE(it == reader.end());
+}
+
+TEST(mpastreamreader, parse_line)
+{
+	std::vector<int> counters(100, -1);
+	EXPECT_EQ(MPAStreamReader::parseCounterLine("[0, 17,3,  65535]\r", counters), 4);
+	ASSERT_EQ(counters.size(), 4);
+	EXPECT_EQ(counters[0], 0);
+	EXPECT_EQ(counters[1], 17);
+	EXPECT_EQ(counters[2], 3);
+	EXPECT_EQ(counters[3], 65535);
+	EXPECT_EQ(MPAStreamReader::parseCounterLine("[]", counters), 0);
+	EXPECT_EQ(counters.size(), 0);
+	// append after existing elements
+	counters.assign(2, 5);
+	EXPECT_EQ(MPAStreamReader::parseCounterLine("[1, 2]", counters, counters.size()), 2);
+	EXPECT_EQ(counters, std::vector<int>({5, 5, 1, 2}));
+}
+
+TEST(mpastreamreader, regex_equivalence)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto reference = readWithRegex(env->getLargeFilename());
+	std::chrono::duration<double> regexTime = std::chrono::steady_clock::now() - start;
+	ASSERT_EQ(reference.size(), numLargeEvents);
+
+	MPAStreamReader reader(env->getLargeFilename());
+	size_t totalEvts = 0;
+	start = std::chrono::steady_clock::now();
+	for(const auto& evt: reader) {
+		ASSERT_LT(totalEvts, reference.size());
+		ASSERT_EQ(evt.eventNumber, totalEvts);
+		ASSERT_EQ(evt.data, reference[totalEvts]) << "Mismatch in event " << totalEvts;
+		++totalEvts;
+	}
+	std::chrono::duration<double> scannerTime = std::chrono::steady_clock::now() - start;
+	EXPECT_EQ(totalEvts, reference.size());
+
+	// only reported in the XML output (--gtest_output=xml), the rates depend on the machine
+	const double regexRate = totalEvts / regexTime.count();
+	const double scannerRate = totalEvts / scannerTime.count();
+	RecordProperty("regex_events_per_second", static_cast<int>(regexRate));
+	RecordProperty("scanner_events_per_second", static_cast<int>(scannerRate));
+	RecordProperty("gain_events_per_second", static_cast<int>(scannerRate - regexRate));
+}
+
+TEST(mpamemorystreamreader, regex_equivalence)
+{
+	std::ifstream fin(env->getMemoryFilename());
+	regex_t regex;
+	regcomp(&regex, "'1{8}([01]{16})([01]{48})'", REG_EXTENDED);
+	MpaMemoryStreamReader reader(env->getMemoryFilename());
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		std::string line;
+		ASSERT_TRUE(std::getline(fin, line));
+		std::vector<int> data(48, 0);
+		std::vector<int> bunchCrossing;
+		size_t offset = 0;
+		regmatch_t m[3];
+		while(regexec(&regex, line.c_str()+offset, 3, m, 0) == 0) {
+			auto bxId = line.substr(offset+m[1].rm_so, m[1].rm_eo-m[1].rm_so);
+			auto pixelmap = line.substr(offset+m[2].rm_so, m[2].rm_eo - m[2].rm_so);
+			bunchCrossing.push_back(std::stoi(bxId, nullptr, 2));
+			for(size_t i = 0; i < pixelmap.size(); ++i) {
+				size_t idx = (i >= 16 && i <= 31) ? 47 - i : i;
+				if(pixelmap[i] == '1') {
+					data[idx] = 1;
+				}
+			}
+			offset += m[0].rm_eo;
+		}
+		EXPECT_EQ(evt.eventNumber, totalEvts);
+		EXPECT_EQ(evt.data, data) << "Hit map mismatch in event " << totalEvts;
+		EXPECT_EQ(evt.bunchCrossing, bunchCrossing) << "Bunch crossing mismatch in event " << totalEvts;
+		++totalEvts;
+	}
+	regfree(&regex);
+	EXPECT_EQ(totalEvts, 500);
+}
+
+TEST(mpamemorystreamreader, invalid_slots)
+{
+	std::vector<int> bunchCrossing;
+	std::string slot = "'11111111" + std::string(15, '0') + "1" + "1" + std::string(47, '0') + "'";
+	std::string broken = "'11111111" + std::string(63, '0') + "2'";
+	std::string line = "[" + broken + ", " + slot + ", 'abc']";
+	auto hits = MpaMemoryStreamReader::decodeLine(line.c_str(), line.size(), bunchCrossing);
+	ASSERT_EQ(bunchCrossing.size(), 1);
+	EXPECT_EQ(bunchCrossing[0], 1);
+	EXPECT_EQ(hits, 1);
+}
+
+TEST(mpabinarystreamreader, roundtrip)
+{
+	MPAStreamReader text(env->getCounterFilename());
+	ASSERT_EQ(MpaBinaryStreamReader::write(text, env->getBinaryFilename()), numLargeEvents/10);
+
+	std::vector<BaseSensorStreamReader::event_t> reference;
+	for(const auto& evt: text) {
+		reference.push_back(evt);
+	}
+
+	MpaBinaryStreamReader reader(env->getBinaryFilename());
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		ASSERT_LT(totalEvts, reference.size());
+		ASSERT_EQ(evt.eventNumber, reference[totalEvts].eventNumber);
+		ASSERT_EQ(evt.data, reference[totalEvts].data) << "Mismatch in event " << totalEvts;
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, reference.size());
+}
+
+TEST(mpabinarystreamreader, copy_iterator)
+{
+	MpaBinaryStreamReader reader(env->getBinaryFilename());
+	auto it = reader.begin();
+	++it;
+	auto copy = it;
+	++copy;
+	EXPECT_EQ(it->eventNumber, 1);
+	EXPECT_EQ(copy->eventNumber, 2);
+	++it;
+	EXPECT_EQ(it->data, copy->data);
+}
+
+TEST(mpabinarystreamreader, invalid_files)
+{
+	EXPECT_THROW({
+		MpaBinaryStreamReader reader(env->getFilename());
+		reader.begin();
+	}, std::ios_base::failure);
+	EXPECT_THROW({
+		MpaBinaryStreamReader reader(env->getFilename()+"abc");
+		reader.begin();
+	}, std::ios_base::failure);
+	// only 10 counters per event
+	MPAStreamReader text(env->getFilename());
+	EXPECT_THROW(MpaBinaryStreamReader::write(text, env->getBinaryFilename() + "_short"), std::out_of_range);
+	std::remove((env->getBinaryFilename() + "_short").c_str());
+}
+
+TEST(mpabinarystreamreader, empty_file)
+{
+	// mpa2bin writes files without events for empty parts of a run
+	const std::string textFilename = env->getBinaryFilename() + "_empty.txt";
+	const std::string binaryFilename = env->getBinaryFilename() + "_empty";
+	std::ofstream(textFilename).close();
+	ASSERT_EQ(MpaBinaryStreamReader::write(MPAStreamReader(textFilename), binaryFilename), 0);
+	MpaBinaryStreamReader reader(binaryFilename);
+	EXPECT_NO_THROW(reader.probe());
+	EXPECT_EQ(reader.begin(), reader.end());
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, 0);
+	BaseSensorStreamReader::batch_t batch;
+	EXPECT_EQ(reader.begin().readBatch(batch, 10), 0);
+	std::remove(textFilename.c_str());
+	std::remove(binaryFilename.c_str());
+}
+
+TEST(mpabinarystreamreader, seek)
+{
+	MPAStreamReader text(env->getCounterFilename());
+	MpaBinaryStreamReader::write(text, env->getBinaryFilename());
+	std::vector<BaseSensorStreamReader::event_t> reference;
+	for(const auto& evt: text) {
+		reference.push_back(evt);
+	}
+	// the records have a fixed size, seeking and the index do not read the file
+	MpaBinaryStreamReader reader(env->getBinaryFilename());
+	auto index = reader.getIndex();
+	ASSERT_TRUE(index != nullptr);
+	ASSERT_EQ(index->size(), reference.size());
+	EXPECT_EQ(index->getEventNumber(1234), 1234);
+	auto it = reader.begin();
+	for(size_t i: {1500, 3, 999, 1000}) {
+		ASSERT_TRUE(it.seek(i));
+		EXPECT_EQ(it->eventNumber, i);
+		EXPECT_EQ(it->data, reference[i].data);
+		++it;
+		EXPECT_EQ(it->data, reference[i + 1].data);
+	}
+	EXPECT_FALSE(it.seek(reference.size()));
+	reader.setUseIndex(true);
+	reader.setEventRange(10, 5);
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		EXPECT_EQ(evt.eventNumber, 10 + totalEvts);
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, 5);
+}
+
+/** Compare readBatch() with iterating event by event */
+void expectEqualBatches(BaseSensorStreamReader& reader, size_t batchSize, size_t expectedEvents)
+{
+	std::vector<BaseSensorStreamReader::event_t> reference;
+	for(const auto& evt: reader) {
+		reference.push_back(evt);
+	}
+	ASSERT_EQ(reference.size(), expectedEvents);
+	auto it = reader.begin();
+	BaseSensorStreamReader::batch_t batch;
+	BaseSensorStreamReader::event_t evt;
+	size_t totalEvts = 0;
+	while(it.readBatch(batch, batchSize)) {
+		ASSERT_LE(batch.size(), batchSize);
+		EXPECT_EQ(batch.getWidth(), 48);
+		for(size_t i = 0; i < batch.size(); ++i) {
+			ASSERT_LT(totalEvts, reference.size());
+			batch.getEvent(i, evt);
+			ASSERT_EQ(evt.eventNumber, reference[totalEvts].eventNumber);
+			ASSERT_EQ(evt.data, reference[totalEvts].data);
+			ASSERT_EQ(evt.bunchCrossing, reference[totalEvts].bunchCrossing);
+			++totalEvts;
+		}
+	}
+	EXPECT_EQ(totalEvts, reference.size());
+	EXPECT_TRUE(it == reader.end());
+	EXPECT_EQ(it.readBatch(batch, batchSize), 0);
+	EXPECT_TRUE(batch.empty());
+}
+
+TEST(mpastreamreader, read_batch)
+{
+	MPAStreamReader reader(env->getLargeFilename());
+	expectEqualBatches(reader, 1000, numLargeEvents);
+	expectEqualBatches(reader, 7, numLargeEvents);
+	// event ranges are respected
+	reader.setEventRange(10, 25);
+	expectEqualBatches(reader, 7, 25);
+	reader.setEventRange(numLargeEvents - 3);
+	expectEqualBatches(reader, 100, 3);
+	reader.setEventRange(0);
+
+	// mixing increments and batches
+	auto it = reader.begin();
+	++it;
+	BaseSensorStreamReader::batch_t batch;
+	ASSERT_EQ(it.readBatch(batch, 5), 5);
+	EXPECT_EQ(batch.eventNumbers.front(), 1);
+	EXPECT_EQ(it->eventNumber, 6);
+
+	long sum = 0;
+	for(const auto& evt: reader) {
+		for(auto counter: evt.data) {
+			sum += counter;
+		}
+	}
+	it = reader.begin();
+	long batchSum = 0;
+	while(it.readBatch(batch, 4096)) {
+		for(auto counter: batch.data) {
+			batchSum += counter;
+		}
+	}
+	EXPECT_EQ(batchSum, sum);
+}
+
+TEST(mpamemorystreamreader, read_batch)
+{
+	MpaMemoryStreamReader reader(env->getMemoryFilename());
+	size_t numEvents = 0;
+	for(const auto& evt: reader) {
+		++numEvents;
+	}
+	expectEqualBatches(reader, 64, numEvents);
+	expectEqualBatches(reader, 1, numEvents);
+}
+
+TEST(mpabinarystreamreader, read_batch)
+{
+	// readers without a batch implementation fall back to next()
+	MpaBinaryStreamReader reader(env->getBinaryFilename());
+	expectEqualBatches(reader, 33, numLargeEvents/10);
+}
+
+TEST(mpastreamreader, event_index)
+{
+	std::remove(EventIndex::getIndexFilename(env->getLargeFilename()).c_str());
+	auto reference = readWithRegex(env->getLargeFilename());
+	MPAStreamReader reader(env->getLargeFilename());
+	auto index = reader.getIndex();
+	ASSERT_TRUE(index != nullptr);
+	EXPECT_EQ(index->size(), reference.size());
+	EventIndex loaded;
+	EXPECT_TRUE(loaded.load(env->getLargeFilename()));
+
+	for(bool useIndex: {false, true}) {
+		reader.setUseIndex(useIndex);
+		reader.setEventRange(999, 3);
+		size_t i = 999;
+		for(const auto& evt: reader) {
+			ASSERT_LT(i, 1002);
+			EXPECT_EQ(evt.eventNumber, i);
+			EXPECT_EQ(evt.data, reference[i]);
+			++i;
+		}
+		EXPECT_EQ(i, 1002);
+		reader.setEventRange(reference.size() + 5);
+		EXPECT_TRUE(reader.begin() == reader.end());
+	}
+
+	// copies continue at the next event
+	reader.setEventRange(0);
+	auto it = reader.begin();
+	++it;
+	auto copy = it;
+	EXPECT_EQ(copy->data, reference[1]);
+	++copy;
+	EXPECT_EQ(copy->eventNumber, 2);
+	EXPECT_EQ(copy->data, reference[2]);
+
+	auto ranges = index->split(7);
+	ASSERT_EQ(ranges.size(), 7);
+	size_t total = 0;
+	for(const auto& range: ranges) {
+		EXPECT_EQ(range.first, total);
+		total += range.second;
+	}
+	EXPECT_EQ(total, reference.size());
+	std::remove(EventIndex::getIndexFilename(env->getLargeFilename()).c_str());
+}
+
+TEST(mpastreamreader, seek)
+{
+	auto reference = readWithRegex(env->getLargeFilename());
+	MPAStreamReader reader(env->getLargeFilename());
+	auto it = reader.begin();
+	EXPECT_THROW(it.seek(5), std::logic_error) << "Seeking without index";
+	reader.setUseIndex(true);
+	it = reader.begin();
+	// backwards and forwards, the iterator continues after the sought event
+	for(size_t i: {1500, 3, 999, 1000}) {
+		ASSERT_TRUE(it.seek(i));
+		EXPECT_EQ(it->eventNumber, i);
+		EXPECT_EQ(it->data, reference[i]);
+		++it;
+		EXPECT_EQ(it->eventNumber, i + 1);
+		EXPECT_EQ(it->data, reference[i + 1]);
+	}
+	EXPECT_FALSE(it.seek(reference.size()));
+	EXPECT_EQ(it, reader.end());
+	EventFilter filter;
+	filter.firstEvent = 100;
+	filter.lastEvent = 109;
+	reader.setEventFilter(filter);
+	it = reader.begin();
+	EXPECT_FALSE(it.seek(99)) << "Event before the filter range";
+	EXPECT_FALSE(it.seek(110)) << "Event after the filter range";
+	ASSERT_TRUE(it.seek(105));
+	EXPECT_EQ(it->data, reference[105]);
+	std::remove(EventIndex::getIndexFilename(env->getLargeFilename()).c_str());
+}
+
+TEST(mpamemorystreamreader, event_index)
+{
+	MpaMemoryStreamReader reader(env->getMemoryFilename());
+	std::vector<BaseSensorStreamReader::event_t> reference;
+	for(const auto& evt: reader) {
+		reference.push_back(evt);
+	}
+	reader.setUseIndex(true);
+	reader.setEventRange(100, 50);
+	size_t i = 100;
+	for(const auto& evt: reader) {
+		EXPECT_EQ(evt.eventNumber, i);
+		EXPECT_EQ(evt.data, reference[i].data);
+		EXPECT_EQ(evt.bunchCrossing, reference[i].bunchCrossing);
+		++i;
+	}
+	EXPECT_EQ(i, 150);
+	std::remove(EventIndex::getIndexFilename(env->getMemoryFilename()).c_str());
+}
+
+TEST(prefetchsensorstreamreader, read)
+{
+	auto reference = readWithRegex(env->getLargeFilename());
+	PrefetchSensorStreamReader reader(std::make_shared<MPAStreamReader>(env->getLargeFilename()), 16);
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		ASSERT_LT(totalEvts, reference.size());
+		ASSERT_EQ(evt.eventNumber, totalEvts);
+		ASSERT_EQ(evt.data, reference[totalEvts]);
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, reference.size());
+
+	// copies and early destruction
+	auto it = reader.begin();
+	++it;
+	++it;
+	auto copy = it;
+	++copy;
+	EXPECT_EQ(copy->eventNumber, 3);
+	EXPECT_EQ(copy->data, reference[3]);
+	++it;
+	EXPECT_EQ(it->data, copy->data);
+}
+
+TEST(mpastreamreader, event_filter)
+{
+	auto reference = readWithRegex(env->getLargeFilename());
+	EventFilter filter;
+	filter.firstEvent = 100;
+	filter.lastEvent = 5000;
+	filter.minHits = 3;
+	filter.maxHits = 6;
+	std::vector<int> expected;
+	for(int evt = 0; evt < static_cast<int>(reference.size()); ++evt) {
+		size_t hits = reference[evt].size() - std::count(reference[evt].begin(), reference[evt].end(), 0);
+		if(filter.acceptsEventNumber(evt) && filter.acceptsHits(hits)) {
+			expected.push_back(evt);
+		}
+	}
+	ASSERT_GT(expected.size(), 0);
+
+	auto source = std::make_shared<MPAStreamReader>(env->getLargeFilename());
+	source->setEventFilter(filter);
+	std::vector<int> events;
+	for(const auto& evt: *source) {
+		ASSERT_EQ(evt.data, reference[evt.eventNumber]);
+		events.push_back(evt.eventNumber);
+	}
+	EXPECT_EQ(events, expected);
+
+	// batches and copies
+	events.clear();
+	auto it = source->begin();
+	BaseSensorStreamReader::batch_t batch;
+	while(it.readBatch(batch, 100)) {
+		events.insert(events.end(), batch.eventNumbers.begin(), batch.eventNumbers.end());
+	}
+	EXPECT_EQ(events, expected);
+	it = source->begin();
+	++it;
+	auto copy = it;
+	++copy;
+	EXPECT_EQ(it->eventNumber, expected[1]);
+	EXPECT_EQ(copy->eventNumber, expected[2]);
+
+	PrefetchSensorStreamReader prefetch(source, 16);
+	events.clear();
+	for(const auto& evt: prefetch) {
+		events.push_back(evt.eventNumber);
+	}
+	EXPECT_EQ(events, expected);
+
+	MpaMemoryStreamReader memory(env->getMemoryFilename());
+	EventFilter rangeFilter;
+	rangeFilter.firstEvent = 2;
+	rangeFilter.lastEvent = 3;
+	memory.setEventFilter(rangeFilter);
+	events.clear();
+	for(const auto& evt: memory) {
+		events.push_back(evt.eventNumber);
+	}
+	EXPECT_EQ(events, std::vector<int>({2, 3}));
+}
+
+TEST(mpastreamreader, compressed)
+{
+	auto reference = readWithRegex(env->getLargeFilename());
+	const std::vector<std::pair<std::string, InputStream::compression_t>> formats = {
+		{"gzip", InputStream::COMPRESSION_GZIP},
+		{"xz", InputStream::COMPRESSION_XZ}
+	};
+	for(const auto& format: formats) {
+		const std::string filename = env->getLargeFilename() + "." + format.first;
+		if(std::system((format.first + " -1 -c " + env->getLargeFilename() + " > " + filename).c_str()) != 0) {
+			std::cout << format.first << " not available, skipping" << std::endl;
+			std::remove(filename.c_str());
+			continue;
+		}
+		EXPECT_EQ(InputStream::detectCompression(filename), format.second);
+		MPAStreamReader reader(filename);
+		size_t totalEvts = 0;
+		for(const auto& evt: reader) {
+			ASSERT_LT(totalEvts, reference.size());
+			ASSERT_EQ(evt.data, reference[totalEvts]);
+			++totalEvts;
+		}
+		EXPECT_EQ(totalEvts, reference.size());
+
+		// copies seek in the uncompressed data
+		auto it = reader.begin();
+		for(size_t i = 0; i < 5000; ++i) {
+			++it;
+		}
+		auto copy = it;
+		++copy;
+		EXPECT_EQ(copy->eventNumber, 5001);
+		EXPECT_EQ(copy->data, reference[5001]);
+
+		// index offsets refer to the uncompressed data as well
+		reader.setUseIndex(true);
+		reader.setEventRange(reference.size() - 10);
+		size_t i = reference.size() - 10;
+		for(const auto& evt: reader) {
+			EXPECT_EQ(evt.data, reference[i]);
+			++i;
+		}
+		EXPECT_EQ(i, reference.size());
+		std::remove(EventIndex::getIndexFilename(filename).c_str());
+
+		// truncated files are an error, not a shorter run
+		std::ifstream fin(filename, std::ios_base::binary);
+		std::string compressed((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+		std::ofstream fout(filename, std::ios_base::binary | std::ios_base::trunc);
+		fout.write(compressed.data(), compressed.size()/2);
+		fout.close();
+		totalEvts = 0;
+		EXPECT_THROW({
+			for(const auto& evt: MPAStreamReader(filename)) {
+				ASSERT_EQ(evt.data, reference[totalEvts]);
+				++totalEvts;
+			}
+		}, std::ios_base::failure);
+		EXPECT_GT(totalEvts, 0u);
+		EXPECT_LT(totalEvts, reference.size());
+		std::remove(filename.c_str());
+	}
+}
+
+TEST(parallelmpaloader, split_lines)
+{
+	const std::string data = "[1, 2]\n\n[3, 4]\r\n[5, 6]\n[7";
+	for(size_t chunkSize: {1, 3, 7, 8, 100}) {
+		auto chunks = ParallelMpaLoader::splitLines(data.data(), data.size(), chunkSize);
+		size_t begin = 0;
+		for(const auto& chunk: chunks) {
+			EXPECT_EQ(chunk.first, begin);
+			ASSERT_GT(chunk.second, 0);
+			EXPECT_EQ(data[chunk.first + chunk.second - 1], '\n');
+			begin += chunk.second;
+		}
+		EXPECT_EQ(begin, data.size() - 2) << "Unterminated last line";
+	}
+	BaseSensorStreamReader::batch_t batch;
+	ParallelMpaLoader::parseChunk(data.data(), data.size(), ParallelMpaLoader::FORMAT_AUTO, batch);
+	ASSERT_EQ(batch.size(), 3);
+	EXPECT_EQ(batch.eventNumbers[2], 2);
+	EXPECT_EQ(batch.data, std::vector<int>({1, 2, 3, 4, 5, 6}));
+}
+
+TEST(parallelmpaloader, stream)
+{
+	auto reference = readWithRegex(env->getLargeFilename());
+	// small chunks, so the workers have to wait for free slots
+	for(size_t numThreads: {1, 4}) {
+		ParallelMpaLoader loader(env->getLargeFilename(), ParallelMpaLoader::FORMAT_AUTO, numThreads, 1 << 14);
+		EXPECT_EQ(loader.getFormat(), ParallelMpaLoader::FORMAT_COUNTER);
+		EXPECT_GT(loader.getNumChunks(), 100);
+		BaseSensorStreamReader::batch_t batch;
+		size_t totalEvts = 0;
+		while(loader.next(batch)) {
+			EXPECT_EQ(batch.getWidth(), 48);
+			for(size_t i = 0; i < batch.size(); ++i) {
+				ASSERT_LT(totalEvts, reference.size());
+				ASSERT_EQ(batch.eventNumbers[i], totalEvts);
+				ASSERT_EQ(std::vector<int>(batch.getData(i), batch.getData(i) + batch.getDataSize(i)),
+				          reference[totalEvts]);
+				++totalEvts;
+			}
+		}
+		EXPECT_EQ(totalEvts, reference.size());
+		EXPECT_FALSE(loader.next(batch));
+	}
+	// destruction before all chunks have been consumed
+	{
+		ParallelMpaLoader loader(env->getLargeFilename(), ParallelMpaLoader::FORMAT_AUTO, 4, 1 << 12);
+		BaseSensorStreamReader::batch_t batch;
+		EXPECT_TRUE(loader.next(batch));
+	}
+	EXPECT_THROW(ParallelMpaLoader("/nonexistent/file"), std::ios_base::failure);
+}
+
+TEST(parallelmpastreamreader, read)
+{
+	size_t totalEvts = 0;
+	for(const auto& evt: MPAStreamReader(env->getLargeFilename())) {
+		totalEvts += evt.data.size() > 0;
+	}
+	ParallelMpaStreamReader reader(env->getLargeFilename());
+	auto run = reader.getRun();
+	EXPECT_EQ(run->size(), totalEvts);
+
+	auto reference = readWithRegex(env->getLargeFilename());
+	totalEvts = 0;
+	for(const auto& evt: reader) {
+		ASSERT_LT(totalEvts, reference.size());
+		ASSERT_EQ(evt.eventNumber, totalEvts);
+		ASSERT_EQ(evt.data, reference[totalEvts]);
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, reference.size());
+	expectEqualBatches(reader, 1000, reference.size());
+	reader.setEventRange(10, 25);
+	expectEqualBatches(reader, 7, 25);
+	reader.setEventRange(0);
+
+	// seeking does not need an index
+	auto it = reader.begin();
+	ASSERT_TRUE(it.seek(1500));
+	EXPECT_EQ(it->data, reference[1500]);
+	auto copy = it;
+	++copy;
+	EXPECT_EQ(copy->data, reference[1501]);
+	EXPECT_FALSE(it.seek(reference.size()));
+
+	EventFilter filter;
+	filter.minHits = 10;
+	reader.setEventFilter(filter);
+	MPAStreamReader sequential(env->getLargeFilename());
+	sequential.setEventFilter(filter);
+	auto expected = sequential.begin();
+	for(const auto& evt: reader) {
+		ASSERT_NE(expected, sequential.end());
+		ASSERT_EQ(evt.eventNumber, expected->eventNumber);
+		++expected;
+	}
+	EXPECT_EQ(expected, sequential.end());
 }
+
+TEST(parallelmpastreamreader, memory)
+{
+	MpaMemoryStreamReader sequential(env->getMemoryFilename());
+	ParallelMpaStreamReader reader(env->getMemoryFilename());
+	reader.setNumThreads(3);
+	auto expected = sequential.begin();
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		ASSERT_NE(expected, sequential.end());
+		ASSERT_EQ(evt.eventNumber, expected->eventNumber);
+		ASSERT_EQ(evt.data, expected->data);
+		ASSERT_EQ(evt.bunchCrossing, expected->bunchCrossing);
+		++expected;
+		++totalEvts;
+	}
+	EXPECT_EQ(expected, sequential.end());
+	EXPECT_EQ(totalEvts, 500);
+}
+
+TEST(multipartsensorstreamreader, find_parts)
+{
+	char s[4096];
+	const std::string prefix = std::string(std::tmpnam(s)) + "_counter.txt_";
+	for(const char* suffix: {"0", "1", "2", "4", "0.gz", "1.gz"}) {
+		std::ofstream(prefix + suffix) << "[1, 2]\n";
+	}
+	std::vector<std::string> expected = {prefix + "0", prefix + "1", prefix + "2"};
+	EXPECT_EQ(MultiPartSensorStreamReader::findParts(prefix + "0"), expected);
+	expected = {prefix + "2"};
+	EXPECT_EQ(MultiPartSensorStreamReader::findParts(prefix + "2"), expected);
+	expected = {prefix + "0.gz", prefix + "1.gz"};
+	EXPECT_EQ(MultiPartSensorStreamReader::findParts(prefix + "0.gz"), expected);
+	expected = {env->getFilename()};
+	EXPECT_EQ(MultiPartSensorStreamReader::findParts(env->getFilename()), expected);
+	for(const char* suffix: {"0", "1", "2", "4", "0.gz", "1.gz"}) {
+		std::remove((prefix + suffix).c_str());
+	}
+}
+
+TEST(multipartsensorstreamreader, read)
+{
+	// split the large file into parts of different sizes
+	auto reference = readWithRegex(env->getLargeFilename());
+	char s[4096];
+	const std::string prefix = std::string(std::tmpnam(s)) + "_counter.txt_";
+	const std::vector<size_t> partSizes = {70000, 1, 0, 50000};
+	std::ifstream fin(env->getLargeFilename());
+	std::string line;
+	for(size_t part = 0; part <= partSizes.size(); ++part) {
+		std::ofstream fout(prefix + std::to_string(part));
+		for(size_t i = 0; (part == partSizes.size() || i < partSizes[part]) && std::getline(fin, line); ) {
+			fout << line << "\n";
+			i += line.size() > 1;
+		}
+	}
+	fin.close();
+
+	auto create = []() { return make_unique<MPAStreamReader>(); };
+	MultiPartSensorStreamReader reader(create, prefix + "0");
+	EXPECT_NO_THROW(reader.probe());
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		ASSERT_LT(totalEvts, reference.size());
+		ASSERT_EQ(evt.eventNumber, totalEvts);
+		ASSERT_EQ(evt.data, reference[totalEvts]);
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, reference.size());
+	expectEqualBatches(reader, 999, reference.size());
+	reader.setEventRange(69990, 25);
+	expectEqualBatches(reader, 7, 25);
+	auto it = reader.begin();
+	EXPECT_THROW(it.seek(5), std::logic_error) << "Seeking without index";
+
+	// offset index
+	reader.setUseIndex(true);
+	auto parts = reader.getParts();
+	ASSERT_EQ(parts.size(), partSizes.size() + 1);
+	size_t firstEvent = 0;
+	for(size_t i = 0; i < parts.size(); ++i) {
+		EXPECT_EQ(parts[i].filename, prefix + std::to_string(i));
+		EXPECT_EQ(parts[i].firstEvent, firstEvent);
+		if(i < partSizes.size()) {
+			EXPECT_EQ(parts[i].numEvents, partSizes[i]);
+		}
+		firstEvent += parts[i].numEvents;
+	}
+	EXPECT_EQ(firstEvent, reference.size());
+	// combined index of the file set, offsets within the parts
+	auto index = reader.getIndex();
+	ASSERT_TRUE(index != nullptr);
+	EXPECT_EQ(index->size(), reference.size());
+	EXPECT_EQ(index->getEventNumber(70001), 70001);
+	auto partIndex = MPAStreamReader(prefix + "3").getIndex();
+	EXPECT_EQ(index->getOffset(70001), partIndex->getOffset(0)) << "First event of the fourth part";
+	EXPECT_EQ(index->getLinesBefore(70005), partIndex->getLinesBefore(4));
+	EXPECT_EQ(index->find(120001), 120001);
+	expectEqualBatches(reader, 7, 25);
+	reader.setEventRange(0);
+	it = reader.begin();
+	for(size_t i: {70000, 3, 120001, 69999, 70001}) {
+		ASSERT_TRUE(it.seek(i));
+		EXPECT_EQ(it->eventNumber, i);
+		EXPECT_EQ(it->data, reference[i]);
+		auto copy = it;
+		++copy;
+		EXPECT_EQ(copy->eventNumber, i + 1);
+		EXPECT_EQ(copy->data, reference[i + 1]);
+	}
+	EXPECT_FALSE(it.seek(reference.size()));
+
+	// each part on its own reader
+	for(const auto& part: parts) {
+		MultiPartSensorStreamReader partReader(create, prefix + "0");
+		partReader.setUseIndex(true);
+		partReader.setEventRange(part.firstEvent, part.numEvents);
+		size_t numEvents = 0;
+		for(const auto& evt: partReader) {
+			ASSERT_EQ(evt.eventNumber, part.firstEvent + numEvents);
+			++numEvents;
+		}
+		EXPECT_EQ(numEvents, part.numEvents);
+	}
+
+	EventFilter filter;
+	filter.firstEvent = 69000;
+	filter.lastEvent = 71000;
+	filter.minHits = 8;
+	reader.setEventFilter(filter);
+	MPAStreamReader sequential(env->getLargeFilename());
+	sequential.setEventFilter(filter);
+	auto expected = sequential.begin();
+	for(const auto& evt: reader) {
+		ASSERT_NE(expected, sequential.end());
+		ASSERT_EQ(evt.eventNumber, expected->eventNumber);
+		++expected;
+	}
+	EXPECT_EQ(expected, sequential.end());
+	MPAStreamReader empty(prefix + "2");
+	EXPECT_TRUE(empty.begin() == empty.end()) << "Empty part";
+
+	for(size_t part = 0; part <= partSizes.size(); ++part) {
+		std::remove((prefix + std::to_string(part)).c_str());
+		std::remove(EventIndex::getIndexFilename(prefix + std::to_string(part)).c_str());
+	}
+}
+
 int main(int argc, char **argv) {
 	::testing::InitGoogleTest(&argc, argv);
 	::testing::AddGlobalTestEnvironment(env = new DataFileEnv);
@@ -0,0 +1,222 @@
+#include "runcatalog.h"
+#include "mpastreamreader.h"
+#include "multipartsensorstreamreader.h"
+#include "trackstreamreader.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+
+using namespace core;
+
+class DataFileEnv : public ::testing::Environment
+{
+public:
+	virtual void SetUp()
+	{
+		char s[4096];
+		mpaFilename = std::tmpnam(s);
+		std::ofstream fout(mpaFilename);
+		fout << "[0, 1, 2]\n"
+		     << "[3, 0, 0]\n"
+		     << "[0, 0, 5]\n";
+		fout.close();
+
+		trackFilename = std::tmpnam(s);
+		fout.open(trackFilename);
+		fout << "# X     Y       Z       SensorID        Evt     Run\n"
+		     << "0.1\t0.2\t0\t0\t7\t1\n"
+		     << "0.1\t0.2\t151\t1\t7\t1\n\n\n"
+		     << "0.3\t0.4\t0\t0\t7\t1\n"
+		     << "0.3\t0.4\t151\t1\t7\t1\n\n\n"
+		     << "0.5\t0.6\t0\t0\t11\t1\n"
+		     << "0.5\t0.6\t151\t1\t11\t1\n\n\n"
+		     << "0.7\t0.8\t0\t0\t20\t1\n"
+		     << "0.7\t0.8\t151\t1\t20\t1\n\n\n";
+		fout.close();
+	}
+
+	virtual void TearDown()
+	{
+		std::remove(mpaFilename.c_str());
+		std::remove(trackFilename.c_str());
+	}
+
+	std::string mpaFilename;
+	std::string trackFilename;
+};
+
+DataFileEnv* env;
+
+/// Fresh catalog in a temporary file, removed with the object
+class TemporaryCatalog
+{
+public:
+	TemporaryCatalog()
+	{
+		char s[4096];
+		_filename = std::string(std::tmpnam(s)) + ".sqlite";
+		_catalog = std::make_shared<RunCatalog>(_filename);
+	}
+	~TemporaryCatalog()
+	{
+		_catalog.reset();
+		std::remove(_filename.c_str());
+	}
+
+	std::shared_ptr<RunCatalog> operator->() const { return _catalog; }
+	std::shared_ptr<RunCatalog> get() const { return _catalog; }
+
+private:
+	std::string _filename;
+	std::shared_ptr<RunCatalog> _catalog;
+};
+
+void expectMpaStats(const RunCatalog& catalog)
+{
+	RunCatalog::stats_t stats;
+	ASSERT_TRUE(catalog.get(env->mpaFilename, stats));
+	EXPECT_EQ(stats.filename, RunCatalog::getCanonicalName(env->mpaFilename));
+	EXPECT_EQ(stats.numEvents, 3);
+	EXPECT_EQ(stats.firstEvent, 0);
+	EXPECT_EQ(stats.lastEvent, 2);
+	EXPECT_TRUE(stats.trackCounts.empty());
+	std::vector<uint64_t> expected = {1, 1, 2};
+	EXPECT_EQ(stats.pixelHits, expected);
+}
+
+TEST(runcatalog, put_get)
+{
+	TemporaryCatalog catalog;
+	char s[4096];
+	const std::string filename = std::tmpnam(s);
+	std::ofstream(filename) << "data\n";
+
+	RunCatalog::stats_t stats;
+	EXPECT_FALSE(catalog->get(filename, stats)) << "Empty catalog";
+	stats.filename = filename;
+	stats.numEvents = 12;
+	stats.firstEvent = 3;
+	stats.lastEvent = 40;
+	stats.trackCounts = {5, 0, 7};
+	stats.pixelHits = {1, 0, 12};
+	catalog->put(stats);
+	// replaces the previous entry
+	stats.numEvents = 13;
+	stats.trackCounts = {6, 0, 7};
+	catalog->put(stats);
+
+	RunCatalog::stats_t read;
+	ASSERT_TRUE(catalog->get(filename, read));
+	EXPECT_EQ(read.filename, RunCatalog::getCanonicalName(filename));
+	EXPECT_EQ(read.numEvents, 13);
+	EXPECT_EQ(read.firstEvent, 3);
+	EXPECT_EQ(read.lastEvent, 40);
+	EXPECT_EQ(read.trackCounts, stats.trackCounts);
+	EXPECT_EQ(read.pixelHits, stats.pixelHits);
+
+	// entries of modified files are stale
+	std::ofstream(filename, std::ios_base::app) << "more data\n";
+	EXPECT_FALSE(catalog->get(filename, read));
+	std::remove(filename.c_str());
+	EXPECT_FALSE(catalog->get(filename, read));
+	EXPECT_THROW(catalog->put(stats), std::runtime_error);
+}
+
+TEST(runcatalog, sensor_reader)
+{
+	TemporaryCatalog catalog;
+	MPAStreamReader reader(env->mpaFilename);
+	reader.setCatalog(catalog.get());
+	RunCatalog::stats_t stats;
+
+	// abandoned and partial passes are not recorded
+	auto it = reader.begin();
+	++it;
+	EXPECT_FALSE(catalog->get(env->mpaFilename, stats));
+	reader.setEventRange(1);
+	for(auto evt: reader) {
+	}
+	EXPECT_FALSE(catalog->get(env->mpaFilename, stats));
+	reader.setEventRange(0);
+
+	size_t numEvents = 0;
+	for(auto evt: reader) {
+		++numEvents;
+	}
+	EXPECT_EQ(numEvents, 3);
+	expectMpaStats(*catalog.get());
+}
+
+TEST(runcatalog, sensor_reader_batch)
+{
+	TemporaryCatalog catalog;
+	MPAStreamReader reader(env->mpaFilename);
+	reader.setCatalog(catalog.get());
+	auto it = reader.begin();
+	BaseSensorStreamReader::batch_t batch;
+	while(it.readBatch(batch, 2)) {
+	}
+	expectMpaStats(*catalog.get());
+}
+
+TEST(runcatalog, multi_part)
+{
+	TemporaryCatalog catalog;
+	char s[4096];
+	const std::string prefix = std::string(std::tmpnam(s)) + "_counter.txt_";
+	std::ofstream(prefix + "0") << "[1, 0]\n[1, 1]\n";
+	std::ofstream(prefix + "1") << "[0, 1]\n";
+
+	MultiPartSensorStreamReader reader([]() { return make_unique<MPAStreamReader>(); }, prefix + "0");
+	reader.setCatalog(catalog.get());
+	for(auto evt: reader) {
+	}
+	// the parts are recorded separately with their own event numbers
+	RunCatalog::stats_t stats;
+	ASSERT_TRUE(catalog->get(prefix + "0", stats));
+	EXPECT_EQ(stats.numEvents, 2);
+	std::vector<uint64_t> expected = {2, 1};
+	EXPECT_EQ(stats.pixelHits, expected);
+	ASSERT_TRUE(catalog->get(prefix + "1", stats));
+	EXPECT_EQ(stats.numEvents, 1);
+	EXPECT_EQ(stats.lastEvent, 0);
+	expected = {0, 1};
+	EXPECT_EQ(stats.pixelHits, expected);
+	std::remove((prefix + "0").c_str());
+	std::remove((prefix + "1").c_str());
+}
+
+TEST(runcatalog, track_reader)
+{
+	for(size_t numThreads: {0, 2}) {
+		TemporaryCatalog catalog;
+		TrackStreamReader reader(env->trackFilename);
+		reader.setNumThreads(numThreads);
+		reader.setCatalog(catalog.get());
+		RunCatalog::stats_t stats;
+
+		EventFilter filter;
+		filter.maxTracks = 1;
+		reader.setEventFilter(filter);
+		for(auto evt: reader) {
+		}
+		EXPECT_FALSE(catalog->get(env->trackFilename, stats)) << "Filtered pass";
+		reader.setEventFilter(EventFilter());
+
+		for(auto evt: reader) {
+		}
+		ASSERT_TRUE(catalog->get(env->trackFilename, stats)) << numThreads << " threads";
+		EXPECT_EQ(stats.numEvents, 3);
+		EXPECT_EQ(stats.firstEvent, 7);
+		EXPECT_EQ(stats.lastEvent, 20);
+		std::vector<uint64_t> expected = {0, 2, 1};
+		EXPECT_EQ(stats.trackCounts, expected);
+		EXPECT_TRUE(stats.pixelHits.empty());
+	}
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	::testing::AddGlobalTestEnvironment(env = new DataFileEnv);
+	return RUN_ALL_TESTS();
+}
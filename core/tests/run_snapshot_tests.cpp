@@ -0,0 +1,180 @@
+#include "runsnapshot.h"
+#include "mergedanalysis.h"
+#include "gtest/gtest.h"
+#include <TFile.h>
+#include <TTree.h>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+using namespace core;
+
+const size_t numEvents = 4;
+
+/// Hit i of plane p in event evt, the planes p1 and ref have evt+1 hits, all others none
+static float getHitX(size_t evt, size_t plane, size_t i) { return evt*100 + plane*10 + i; }
+static size_t getNumHits(size_t evt, size_t plane) { return plane == 0 || plane == 6 ? evt + 1 : 0; }
+
+class DataFileEnv : public ::testing::Environment
+{
+public:
+	virtual void SetUp()
+	{
+		char s[4096];
+		rootFilename = std::string(std::tmpnam(s)) + ".root";
+		flatFilename = std::string(std::tmpnam(s)) + ".flat";
+		brokenFilename = std::string(std::tmpnam(s)) + ".flat";
+		TFile file(rootFilename.c_str(), "recreate");
+		TTree* tree = new TTree("data", "");
+		TelescopeData* clusters = new TelescopeData;
+		TelescopeHits* hits = new TelescopeHits;
+		MpaData* mpa = new MpaData;
+		tree->Branch("telescope", &clusters);
+		tree->Branch("telhits", &hits);
+		tree->Branch("mpa_2", &mpa);
+		PlaneHits* planes[] = {&hits->p1, &hits->p2, &hits->p3, &hits->p4, &hits->p5, &hits->p6, &hits->ref};
+		for(size_t evt = 0; evt < numEvents; ++evt) {
+			for(size_t p = 0; p < RunSnapshot::numPlanes; ++p) {
+				const size_t n = getNumHits(evt, p);
+				planes[p]->x.ResizeTo(n);
+				planes[p]->y.ResizeTo(n);
+				planes[p]->z.ResizeTo(n);
+				for(size_t i = 0; i < n; ++i) {
+					planes[p]->x[i] = getHitX(evt, p, i);
+					planes[p]->y[i] = -getHitX(evt, p, i);
+					planes[p]->z[i] = p;
+				}
+			}
+			for(size_t i = 0; i < RunSnapshot::numPixels; ++i) {
+				mpa->counter.pixels[i] = evt + i;
+			}
+			tree->Fill();
+		}
+		file.Write();
+		file.Close();
+		delete clusters;
+		delete hits;
+		delete mpa;
+	}
+
+	virtual void TearDown()
+	{
+		std::remove(rootFilename.c_str());
+		std::remove(flatFilename.c_str());
+		std::remove(brokenFilename.c_str());
+	}
+
+	/// Copy of the flat file with size bytes at offset replaced by data, cut after length bytes
+	void writeBroken(size_t offset, const char* data, size_t size, size_t length = std::string::npos)
+	{
+		std::ifstream fin(flatFilename, std::ios_base::binary);
+		std::string content((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+		content.replace(offset, size, data, size);
+		content.resize(std::min(length, content.size()));
+		std::ofstream(brokenFilename, std::ios_base::binary | std::ios_base::trunc) << content;
+	}
+
+	std::string rootFilename;
+	std::string flatFilename;
+	std::string brokenFilename;
+};
+
+DataFileEnv* env;
+
+/// Compare the snapshot with the data written by DataFileEnv
+static void expectSnapshot(const RunSnapshot& snapshot)
+{
+	ASSERT_EQ(snapshot.size(), numEvents);
+	ASSERT_EQ(snapshot.getNumMpa(), 1u);
+	EXPECT_EQ(snapshot.getMpaIndex(0), 2);
+	for(size_t evt = 0; evt < numEvents; ++evt) {
+		for(size_t p = 0; p < RunSnapshot::numPlanes; ++p) {
+			ASSERT_EQ(snapshot.getNumHits(evt, p), getNumHits(evt, p)) << "Event " << evt << ", plane " << p;
+			for(size_t i = 0; i < getNumHits(evt, p); ++i) {
+				EXPECT_EQ(snapshot.getX(evt, p)[i], getHitX(evt, p, i));
+				EXPECT_EQ(snapshot.getY(evt, p)[i], -getHitX(evt, p, i));
+				EXPECT_EQ(snapshot.getZ(evt, p)[i], p);
+			}
+		}
+		EXPECT_EQ(snapshot.getCounter(evt, 0)[0], evt);
+		EXPECT_EQ(snapshot.getCounter(evt, 0)[47], evt + 47);
+	}
+}
+
+TEST(runsnapshot, tree)
+{
+	run_data_t run = MergedAnalysis::openDataTree(1, env->rootFilename);
+	ASSERT_EQ(run.mpaData.size(), 1u);
+	EXPECT_EQ(getEntries(run), numEvents);
+	RunSnapshot snapshot(run);
+	expectSnapshot(snapshot);
+
+	// events are loaded from the snapshot into the objects of the run
+	run_data_t cached = run;
+	cached.snapshot = &snapshot;
+	const TelescopeHits* hits = *run.telescopeHits;
+	for(size_t evt: {2, 0, 3}) {
+		getEntry(cached, evt);
+		ASSERT_EQ(hits->p1.x.GetNoElements(), static_cast<int>(evt + 1));
+		EXPECT_EQ(hits->p1.x[evt], getHitX(evt, 0, evt));
+		EXPECT_EQ(hits->ref.y[0], -getHitX(evt, 6, 0));
+		EXPECT_EQ(hits->p3.x.GetNoElements(), 0);
+		EXPECT_EQ((*run.mpaData[0].data)->counter.pixels[5], evt + 5);
+	}
+	MergedAnalysis::closeRun(run);
+}
+
+TEST(runsnapshot, flat_file)
+{
+	run_data_t run = MergedAnalysis::openDataTree(1, env->rootFilename);
+	RunSnapshot(run).write(env->flatFilename);
+	MergedAnalysis::closeRun(run);
+
+	EXPECT_TRUE(RunSnapshot::isFlatFile(env->flatFilename));
+	EXPECT_FALSE(RunSnapshot::isFlatFile(env->rootFilename));
+	RunSnapshot mapped(env->flatFilename);
+	expectSnapshot(mapped);
+
+	// snapshots of snapshots are equal
+	run = MergedAnalysis::openDataTree(1, env->rootFilename);
+	run.snapshot = &mapped;
+	RunSnapshot copy(run);
+	run.snapshot = nullptr;
+	MergedAnalysis::closeRun(run);
+	expectSnapshot(copy);
+}
+
+TEST(runsnapshot, flat_file_validation)
+{
+	run_data_t run = MergedAnalysis::openDataTree(1, env->rootFilename);
+	RunSnapshot(run).write(env->flatFilename);
+	MergedAnalysis::closeRun(run);
+
+	EXPECT_THROW(RunSnapshot("/nonexistent/file.flat"), std::ios_base::failure);
+	const char magic[] = "NOTFLAT";
+	env->writeBroken(0, magic, sizeof(magic));
+	EXPECT_THROW(RunSnapshot(env->brokenFilename), std::ios_base::failure) << "Bad magic";
+	const uint32_t version = 2;
+	env->writeBroken(offsetof(RunSnapshot::file_header_t, version), reinterpret_cast<const char*>(&version),
+	                 sizeof(version));
+	EXPECT_THROW(RunSnapshot(env->brokenFilename), std::ios_base::failure) << "Unsupported version";
+	env->writeBroken(0, "", 0, 900);
+	EXPECT_THROW(RunSnapshot(env->brokenFilename), std::ios_base::failure) << "Truncated file";
+	env->writeBroken(0, "", 0, 40);
+	EXPECT_THROW(RunSnapshot(env->brokenFilename), std::ios_base::failure) << "Truncated header";
+	// offsets of p1 are 0 1 3 6 10, the total number of hits stays consistent
+	const uint64_t offset = 4;
+	const size_t offsetPos = sizeof(RunSnapshot::file_header_t) + sizeof(uint64_t);
+	env->writeBroken(offsetPos, reinterpret_cast<const char*>(&offset), sizeof(offset));
+	EXPECT_THROW(RunSnapshot(env->brokenFilename), std::ios_base::failure) << "Decreasing offsets";
+	env->writeBroken(0, "", 0);
+	EXPECT_NO_THROW(RunSnapshot(env->brokenFilename)) << "Unmodified copy";
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	::testing::AddGlobalTestEnvironment(env = new DataFileEnv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,216 @@
+#include "trackanalysis.h"
+#include "mpastreamreader.h"
+#include "mpabinarystreamreader.h"
+#include "core.h"
+#include "eventindex.h"
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <utility>
+#include <vector>
+
+using namespace core;
+
+/// MPA run IDs and number of events of the runs
+const std::vector<std::pair<int, size_t>> runs = {{1, 300}, {2, 100}};
+
+class DataFileEnv : public ::testing::Environment
+{
+public:
+	virtual void SetUp()
+	{
+		char s[4096];
+		prefix = std::tmpnam(s);
+		configFilename = prefix + ".cfg";
+		runlistFilename = prefix + ".csv";
+		std::ofstream fout(configFilename);
+		fout << "mpa_id_padding = 4\n"
+		     << "run_id_padding = 6\n"
+		     << "mapsa_data = " << prefix << "_mpa@MpaRun@.txt\n"
+		     << "track_data = " << prefix << "_tracks@TelRun@.csv\n";
+		fout.close();
+		fout.open(runlistFilename);
+		fout << "MPA\tTelescope\tAngle\tBias voltage\tBias current\tThreshold\n";
+		for(const auto& run: runs) {
+			fout << run.first << "\t" << run.first + 100 << "\t0\t0\t0\t0\n";
+		}
+		fout.close();
+		// one hit and one track in every event, the event numbers of both files match
+		for(const auto& run: runs) {
+			std::ostringstream mpaFilename;
+			mpaFilename << prefix << "_mpa" << std::setfill('0') << std::setw(4) << run.first << ".txt";
+			fout.open(mpaFilename.str());
+			for(size_t evt = 0; evt < run.second; ++evt) {
+				fout << "[" << evt + 1;
+				for(size_t pixel = 1; pixel < 48; ++pixel) {
+					fout << ", 0";
+				}
+				fout << "]\n";
+			}
+			fout.close();
+			dataFilenames.push_back(mpaFilename.str());
+			MpaBinaryStreamReader::write(MPAStreamReader(mpaFilename.str()), mpaFilename.str() + ".bin");
+			dataFilenames.push_back(mpaFilename.str() + ".bin");
+
+			std::ostringstream trackFilename;
+			trackFilename << prefix << "_tracks" << std::setfill('0') << std::setw(6) << run.first + 100 << ".csv";
+			fout.open(trackFilename.str());
+			fout << "# X     Y       Z       SensorID        Evt     Run\n";
+			for(size_t evt = 0; evt < run.second; ++evt) {
+				for(int sensor = 0; sensor < 4; ++sensor) {
+					fout << "1.0000\t2.0000\t" << sensor << "\t" << sensor << "\t" << evt << "\t"
+					     << run.first + 100 << "\n";
+				}
+				fout << "\n\n";
+			}
+			fout.close();
+			dataFilenames.push_back(trackFilename.str());
+		}
+	}
+
+	virtual void TearDown()
+	{
+		std::remove(configFilename.c_str());
+		std::remove(runlistFilename.c_str());
+		for(const auto& filename: dataFilenames) {
+			std::remove(filename.c_str());
+			std::remove(EventIndex::getIndexFilename(filename).c_str());
+		}
+	}
+
+	/// Common prefix of the files
+	std::string prefix;
+	std::string configFilename;
+	std::string runlistFilename;
+	std::vector<std::string> dataFilenames;
+};
+
+DataFileEnv* env;
+
+/// Records the run ID and MPA event number of the events passed to its process
+class SamplingAnalysis : public TrackAnalysis
+{
+public:
+	/// \param numPasses The process is rerun until it has seen all runs numPasses times
+	SamplingAnalysis(const std::string& mode, size_t numEvents, uint64_t seed, size_t numPasses=1)
+	 : passes(numPasses)
+	{
+		setSampling(parseSamplingMode(mode), numEvents, seed);
+		addProcess("Sample", CS_ALWAYS, nullptr, nullptr,
+			[this](const TrackStreamReader::event_t& track, const BaseSensorStreamReader::event_t& pixel) {
+				EXPECT_EQ(track.eventNumber, (int)pixel.eventNumber);
+				EXPECT_EQ(pixel.data[0], (int)pixel.eventNumber + 1);
+				passes[getRerunNumber()].push_back({getCurrentRunId(), pixel.eventNumber});
+				return true;
+			}, nullptr, [this]() {
+				if(getRerunNumber() + 1 < passes.size()) {
+					rerun();
+				}
+			});
+	}
+
+	/// Run the analysis on all runs, define is passed to -D if not empty
+	void runAll(const std::string& define="")
+	{
+		std::vector<std::string> args = {"analysis", "-c", env->configFilename, "-l", env->runlistFilename};
+		if(!define.empty()) {
+			args.push_back("-D");
+			args.push_back(define);
+		}
+		for(const auto& run: runs) {
+			args.push_back("-r");
+			args.push_back(std::to_string(run.first));
+		}
+		std::vector<const char*> argv;
+		for(const auto& arg: args) {
+			argv.push_back(arg.c_str());
+		}
+		po::variables_map vm;
+		po::store(po::parse_command_line(argv.size(), argv.data(), getOptionsDescription()), vm);
+		po::notify(vm);
+		ASSERT_TRUE(loadConfig(vm));
+		run(vm);
+	}
+
+	/// Number of samples taken from run runId
+	size_t count(int runId) const
+	{
+		size_t n = 0;
+		for(const auto& sample: samples) {
+			n += sample.first == runId;
+		}
+		return n;
+	}
+
+	/// Samples of each pass
+	std::vector<std::vector<std::pair<int, size_t>>> passes;
+	/// Samples of the first pass
+	const std::vector<std::pair<int, size_t>>& samples = passes[0];
+};
+
+static void testSampling(const std::string& mode, const std::string& define="")
+{
+	SamplingAnalysis first(mode, 40, 17);
+	first.runAll(define);
+	// proportional to the 300 and 100 events of the runs
+	EXPECT_EQ(first.samples.size(), 40u);
+	EXPECT_EQ(first.count(1), 30u);
+	EXPECT_EQ(first.count(2), 10u);
+
+	SamplingAnalysis second(mode, 40, 17);
+	second.runAll(define);
+	EXPECT_EQ(first.samples, second.samples) << "Same seed";
+
+	SamplingAnalysis other(mode, 40, 18);
+	other.runAll(define);
+	EXPECT_EQ(other.count(1), 30u);
+	EXPECT_NE(first.samples, other.samples) << "Different seed";
+}
+
+TEST(trackanalysis, sampling_stride)
+{
+	testSampling("stride");
+}
+
+TEST(trackanalysis, sampling_reservoir)
+{
+	// the run sizes are taken from the event indices
+	testSampling("reservoir", "event_index = true");
+
+	// no index is built just to size the runs
+	SamplingAnalysis even("reservoir", 40, 17);
+	even.runAll();
+	EXPECT_EQ(even.count(1), 20u);
+	EXPECT_EQ(even.count(2), 20u);
+}
+
+TEST(trackanalysis, sampling_rerun)
+{
+	for(const std::string mode: {"stride", "reservoir"}) {
+		SamplingAnalysis analysis(mode, 40, 17, 3);
+		analysis.runAll();
+		ASSERT_EQ(analysis.samples.size(), 40u) << mode;
+		EXPECT_EQ(analysis.passes[1], analysis.samples) << mode;
+		EXPECT_EQ(analysis.passes[2], analysis.samples) << mode;
+	}
+}
+
+TEST(trackanalysis, sampling_binary)
+{
+	// binary counter files seek without an index file, so stride sampling does not fall back to reservoir
+	SamplingAnalysis text("stride", 40, 17);
+	text.runAll();
+	SamplingAnalysis binary("stride", 40, 17);
+	binary.runAll("pixel_reader_type = MpaBinaryStreamReader\nmapsa_data = " + env->prefix + "_mpa@MpaRun@.txt.bin");
+	EXPECT_EQ(binary.samples, text.samples);
+}
+
+int main(int argc, char **argv) {
+	::testing::InitGoogleTest(&argc, argv);
+	// sensor reader types of the factory
+	core::initClasses();
+	::testing::AddGlobalTestEnvironment(env = new DataFileEnv);
+	return RUN_ALL_TESTS();
+}
@@ -1,11 +1,19 @@
 
 #include "trackstreamreader.h"
+#include "trackbinaryfile.h"
+#include "paralleltrackloader.h"
 #include "gtest/gtest.h"
 #include <cstdio>
+#include <cstdlib>
+#include <algorithm>
 #include <fstream>
+#include <random>
+#include <iostream>
 
 using namespace core;
 
+const int numLargeEvents = 20000;
+
 class DataFileEnv : public ::testing::Environment
 {
 public:
@@ -201,6 +209,36 @@ public:
 		     << "6.0000\t5.0000\t4.0000\t3\t15\t4\n\n\n";
 		fout.flush();
 		fout.close();
+
+		large = std::tmpnam(s);
+		fout.open(s);
+		fout << "# X     Y       Z       SensorID        Evt     Run\n";
+		std::mt19937 gen(42);
+		std::uniform_real_distribution<double> coord(-10.0, 10.0);
+		std::uniform_int_distribution<int> tracks(1, 3);
+		fout.precision(12);
+		for(int evt = 0; evt < numLargeEvents; ++evt) {
+			int numTracks = tracks(gen);
+			for(int tr = 0; tr < numTracks; ++tr) {
+				for(int plane = 0; plane < 6; ++plane) {
+					fout << coord(gen) << "\t" << coord(gen)*1e-5 << "\t" << plane*151 << "\t"
+					     << plane << "\t" << evt << "\t" << 28 << "\n";
+				}
+				fout << "\n\n";
+			}
+		}
+		fout.flush();
+		fout.close();
+
+		binary = std::string(std::tmpnam(s)) + ".trk";
+
+		parse_error = std::tmpnam(s);
+		fout.open(s);
+		fout << "# X     Y       Z       SensorID        Evt     Run\n"
+		     << "1.0000\t0.0000\t0\t0\t11\t4\n"
+		     << "0.0000\t1.0000\t0\t1\t11.5\t4\n\n\n";
+		fout.flush();
+		fout.close();
 	}
 
 	virtual void TearDown()
@@ -211,6 +249,10 @@ public:
 		std::remove(bad_evt_order.c_str());
 		std::remove(float_wo_decimal.c_str());
 		std::remove(negatives.c_str());
+		std::remove(scientific_numbers.c_str());
+		std::remove(large.c_str());
+		std::remove(parse_error.c_str());
+		std::remove(binary.c_str());
 	}
 
 	std::string negatives;
@@ -221,6 +263,8 @@ public:
 	std::string valid2;
 	std::string valid3;
 	std::string scientific_numbers;
+	std::string large;
+	std::string binary;
 };
 
 DataFileEnv* env;
@@ -251,6 +295,31 @@ TEST(trackstreamreader, read)
 	EXPECT_EQ(totalEvts, 5);
 }
 
+TEST(trackstreamreader, probe)
+{
+	EXPECT_NO_THROW(TrackStreamReader(env->valid1).probe());
+	EXPECT_THROW(TrackStreamReader(env->valid1 + "abc").probe(), std::ios_base::failure);
+	EXPECT_THROW(TrackStreamReader(env->valid1 + ".trk").probe(), std::ios_base::failure);
+}
+
+TEST(trackstreamreader, move_iterator)
+{
+	TrackStreamReader reader(env->valid1);
+	auto it = reader.begin();
+	auto moved = std::move(it);
+	EXPECT_EQ(moved->eventNumber, 11);
+	auto old = moved++;
+	EXPECT_EQ(old->eventNumber, 11);
+	EXPECT_EQ(old->tracks.size(), 1);
+	EXPECT_EQ(moved->eventNumber, 15);
+	EXPECT_EQ(moved->tracks.size(), 2);
+	++old;
+	EXPECT_TRUE(old == reader.end());
+	it = std::move(moved);
+	++it;
+	EXPECT_EQ(it->eventNumber, 54);
+}
+
 TEST(trackstreamreader, read2)
 {
 	TrackStreamReader reader(env->valid2);
@@ -356,6 +425,558 @@ TEST(trackstreamreader, bad_evt_order)
 	}, TrackStreamReader::consistency_error);
 }
 
+void expectEqualEvents(const std::string& filename, const std::string& reference_filename="")
+{
+	TrackStreamReader tokenizer(filename, TrackStreamReader::PARSE_TOKENIZER);
+	TrackStreamReader regex(reference_filename.empty() ? filename : reference_filename,
+		TrackStreamReader::PARSE_REGEX);
+	auto regex_it = regex.begin();
+	size_t numEvents = 0;
+	for(const auto& evt: tokenizer) {
+		ASSERT_NE(regex_it, regex.end()) << filename;
+		EXPECT_EQ(evt.eventNumber, regex_it->eventNumber);
+		EXPECT_EQ(evt.runID, regex_it->runID);
+		ASSERT_EQ(evt.tracks.size(), regex_it->tracks.size());
+		for(size_t i = 0; i < evt.tracks.size(); ++i) {
+			EXPECT_EQ(evt.tracks[i].sensorIDs, regex_it->tracks[i].sensorIDs);
+			ASSERT_EQ(evt.tracks[i].points.size(), regex_it->tracks[i].points.size());
+			for(size_t j = 0; j < evt.tracks[i].points.size(); ++j) {
+				// values must be bit-identical
+				EXPECT_EQ(evt.tracks[i].points[j], regex_it->tracks[i].points[j]);
+			}
+		}
+		++regex_it;
+		++numEvents;
+	}
+	EXPECT_EQ(regex_it, regex.end());
+	EXPECT_GT(numEvents, 0);
+}
+
+TEST(trackstreamreader, parse_mode_equivalence)
+{
+	expectEqualEvents(env->valid1);
+	expectEqualEvents(env->valid2);
+	expectEqualEvents(env->valid3);
+	expectEqualEvents(env->negatives);
+	expectEqualEvents(env->scientific_numbers);
+	expectEqualEvents(env->float_wo_decimal);
+	expectEqualEvents(env->large);
+}
+
+TEST(trackstreamreader, parse_mode_event_count)
+{
+	for(auto mode: {TrackStreamReader::PARSE_REGEX, TrackStreamReader::PARSE_TOKENIZER}) {
+		TrackStreamReader reader(env->large, mode);
+		int totalEvts = 0;
+		for(const auto& evt: reader) {
+			totalEvts += 1;
+		}
+		EXPECT_EQ(totalEvts, numLargeEvents);
+	}
+}
+
+TEST(trackstreamreader, parse_error)
+{
+	for(auto mode: {TrackStreamReader::PARSE_REGEX, TrackStreamReader::PARSE_TOKENIZER}) {
+		EXPECT_THROW({
+			TrackStreamReader reader(env->parse_error, mode);
+			for(const auto& evt: reader) {
+			}
+		}, TrackStreamReader::parse_error);
+	}
+}
+
+TEST(trackstreamreader, binary)
+{
+	ASSERT_EQ(TrackBinaryFile::write(TrackStreamReader(env->large), env->binary), numLargeEvents);
+	expectEqualEvents(env->binary, env->large);
+
+	for(const auto& filename: {env->large, env->binary}) {
+		TrackStreamReader reader(filename);
+		int totalEvts = 0;
+		for(const auto& evt: reader) {
+			totalEvts += 1;
+		}
+		EXPECT_EQ(totalEvts, numLargeEvents);
+	}
+}
+
+TEST(trackstreamreader, binary_copy_iterator)
+{
+	TrackBinaryFile::write(TrackStreamReader(env->valid1), env->binary);
+	TrackStreamReader reader(env->binary);
+	auto it = reader.begin();
+	++it;
+	auto copy = it;
+	++copy;
+	EXPECT_EQ(it->eventNumber, 15);
+	EXPECT_EQ(copy->eventNumber, 54);
+	EXPECT_EQ(it->tracks.size(), 2);
+	++it;
+	EXPECT_EQ(it, copy);
+	EXPECT_EQ(it->tracks.size(), copy->tracks.size());
+}
+
+TEST(trackstreamreader, binary_invalid)
+{
+	std::ifstream fin(env->valid1);
+	std::ofstream fout(env->binary);
+	fout << fin.rdbuf();
+	fout.close();
+	EXPECT_THROW({
+		TrackStreamReader reader(env->binary);
+		reader.begin();
+	}, std::ios_base::failure);
+}
+
+TEST(trackstreamreader, event_index)
+{
+	std::remove(EventIndex::getIndexFilename(env->large).c_str());
+	TrackStreamReader reader(env->large);
+	std::vector<TrackStreamReader::event_t> events;
+	for(const auto& evt: reader) {
+		events.push_back(evt);
+	}
+	auto index = reader.getIndex();
+	ASSERT_TRUE(index != nullptr);
+	ASSERT_EQ(index->size(), events.size());
+	for(size_t i = 0; i < events.size(); ++i) {
+		ASSERT_EQ(index->getEventNumber(i), events[i].eventNumber);
+	}
+	// sidecar has been written
+	EventIndex loaded;
+	EXPECT_TRUE(loaded.load(env->large));
+	EXPECT_EQ(loaded.size(), index->size());
+
+	for(bool useIndex: {false, true}) {
+		TrackStreamReader range(env->large);
+		range.setUseIndex(useIndex);
+		range.setEventRange(1234, 100);
+		size_t i = 1234;
+		for(const auto& evt: range) {
+			ASSERT_LT(i, 1334);
+			EXPECT_EQ(evt.eventNumber, events[i].eventNumber);
+			ASSERT_EQ(evt.tracks.size(), events[i].tracks.size());
+			EXPECT_EQ(evt.tracks[0].points, events[i].tracks[0].points);
+			++i;
+		}
+		EXPECT_EQ(i, 1334);
+		range.setEventRange(events.size() - 3);
+		i = 0;
+		for(const auto& evt: range) {
+			EXPECT_EQ(evt.eventNumber, events[events.size() - 3 + i].eventNumber);
+			++i;
+		}
+		EXPECT_EQ(i, 3);
+		range.setEventRange(events.size() + 1);
+		EXPECT_EQ(range.begin(), range.end());
+	}
+
+	// copies continue at the next event
+	reader.setUseIndex(true);
+	auto it = reader.begin();
+	for(int i = 0; i < 10; ++i) {
+		++it;
+	}
+	auto copy = it;
+	EXPECT_EQ(copy->eventNumber, events[10].eventNumber);
+	++it;
+	++copy;
+	EXPECT_EQ(it, copy);
+	EXPECT_EQ(copy->tracks.size(), events[11].tracks.size());
+	std::remove(EventIndex::getIndexFilename(env->large).c_str());
+}
+
+TEST(trackstreamreader, seek_event)
+{
+	TrackBinaryFile::write(TrackStreamReader(env->large), env->binary);
+	std::vector<TrackStreamReader::event_t> events;
+	for(const auto& evt: TrackStreamReader(env->large)) {
+		events.push_back(evt);
+	}
+	for(const auto& filename: {env->large, env->binary}) {
+		TrackStreamReader reader(filename);
+		reader.setUseIndex(true);
+		auto it = reader.begin();
+		// backwards and forwards, the iterator continues after the sought event
+		for(size_t i: {1500, 3, 999, 1000}) {
+			ASSERT_TRUE(it.seekEvent(events[i].eventNumber));
+			EXPECT_EQ(it->eventNumber, events[i].eventNumber);
+			ASSERT_EQ(it->tracks.size(), events[i].tracks.size());
+			EXPECT_EQ(it->tracks[0].points, events[i].tracks[0].points);
+			++it;
+			EXPECT_EQ(it->eventNumber, events[i + 1].eventNumber);
+		}
+		EXPECT_FALSE(it.seekEvent(events.back().eventNumber + 1));
+		EXPECT_EQ(it, reader.end());
+	}
+	TrackStreamReader reader(env->large);
+	auto it = reader.begin();
+	EXPECT_THROW(it.seekEvent(events[5].eventNumber), std::logic_error) << "Seeking without index";
+	std::remove(EventIndex::getIndexFilename(env->large).c_str());
+}
+
+TEST(trackstreamreader, event_index_stale)
+{
+	char s[4096];
+	std::string filename = std::tmpnam(s);
+	std::ofstream fout(filename);
+	std::ifstream fin(env->valid1);
+	fout << fin.rdbuf();
+	fout.close();
+	EXPECT_EQ(TrackStreamReader(filename).getIndex()->size(), 5);
+	EventIndex index;
+	EXPECT_TRUE(index.load(filename));
+
+	fout.open(filename, std::ios_base::app);
+	fout << "\n\n\n1.0\t2.0\t3.0\t0\t100\t4\n";
+	fout.close();
+	EXPECT_FALSE(index.load(filename));
+	EXPECT_EQ(TrackStreamReader(filename).getIndex()->size(), 6);
+	std::remove(filename.c_str());
+	std::remove(EventIndex::getIndexFilename(filename).c_str());
+}
+
+TEST(trackstreamreader, prefetch)
+{
+	TrackStreamReader reference(env->large);
+	TrackStreamReader reader(env->large);
+	reader.setPrefetch(8);
+	auto ref_it = reference.begin();
+	int totalEvts = 0;
+	for(const auto& evt: reader) {
+		ASSERT_NE(ref_it, reference.end());
+		ASSERT_EQ(evt.eventNumber, ref_it->eventNumber);
+		ASSERT_EQ(evt.tracks.size(), ref_it->tracks.size());
+		EXPECT_EQ(evt.tracks[0].points, ref_it->tracks[0].points);
+		++ref_it;
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, numLargeEvents);
+
+	reader.setEventRange(100, 10);
+	auto it = reader.begin();
+	++it;
+	auto copy = it;
+	totalEvts = 2;
+	while(++copy != reader.end()) {
+		++it;
+		EXPECT_EQ(it->eventNumber, copy->eventNumber);
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, 10);
+	EXPECT_EQ(++it, reader.end());
+
+	// parse errors are passed to the reading thread
+	TrackStreamReader broken(env->bad_evt_order);
+	broken.setPrefetch(4);
+	EXPECT_THROW({
+		for(const auto& evt: broken) {
+		}
+	}, TrackStreamReader::consistency_error);
+}
+
+TEST(trackstreamreader, compressed)
+{
+	for(std::string tool: {"gzip", "xz"}) {
+		const std::string filename = env->large + "." + tool;
+		if(std::system((tool + " -1 -c " + env->large + " > " + filename).c_str()) != 0) {
+			std::cout << tool << " not available, skipping" << std::endl;
+			std::remove(filename.c_str());
+			continue;
+		}
+		expectEqualEvents(filename, env->large);
+
+		TrackStreamReader reference(env->large);
+		TrackStreamReader reader(filename);
+		auto ref_it = reference.begin();
+		auto it = reader.begin();
+		for(int i = 0; i < 1000; ++i) {
+			++ref_it;
+			++it;
+		}
+		auto copy = it;
+		++copy;
+		++ref_it;
+		EXPECT_EQ(copy->eventNumber, ref_it->eventNumber);
+		EXPECT_EQ(copy->tracks[0].points, ref_it->tracks[0].points);
+
+		reader.setUseIndex(true);
+		reader.setEventRange(numLargeEvents - 3);
+		reference.setUseIndex(true);
+		reference.setEventRange(numLargeEvents - 3);
+		ref_it = reference.begin();
+		int totalEvts = 0;
+		for(const auto& evt: reader) {
+			ASSERT_NE(ref_it, reference.end());
+			EXPECT_EQ(evt.eventNumber, ref_it->eventNumber);
+			++ref_it;
+			++totalEvts;
+		}
+		EXPECT_EQ(totalEvts, 3);
+		std::remove(EventIndex::getIndexFilename(filename).c_str());
+
+		// truncated files are an error, not a shorter run
+		std::ifstream fin(filename, std::ios_base::binary);
+		std::string compressed((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+		fin.close();
+		std::ofstream fout(filename, std::ios_base::binary | std::ios_base::trunc);
+		fout.write(compressed.data(), compressed.size()/2);
+		fout.close();
+		totalEvts = 0;
+		EXPECT_THROW({
+			for(const auto& evt: TrackStreamReader(filename)) {
+				(void)evt;
+				++totalEvts;
+			}
+		}, std::ios_base::failure);
+		EXPECT_GT(totalEvts, 0);
+		EXPECT_LT(totalEvts, numLargeEvents);
+		std::remove(filename.c_str());
+	}
+	std::remove(EventIndex::getIndexFilename(env->large).c_str());
+}
+
+TEST(trackstreamreader, required_sensors)
+{
+	TrackBinaryFile::write(TrackStreamReader(env->large), env->binary);
+	const std::vector<int> sensors {0, 5};
+	for(const auto& filename: {env->large, env->binary}) {
+		for(auto mode: {TrackStreamReader::PARSE_REGEX, TrackStreamReader::PARSE_TOKENIZER}) {
+			if(filename == env->binary && mode == TrackStreamReader::PARSE_REGEX) {
+				continue;
+			}
+			TrackStreamReader full(env->large);
+			TrackStreamReader reader(filename, mode);
+			reader.setRequiredSensors(sensors);
+			auto full_it = full.begin();
+			int totalEvts = 0;
+			for(const auto& evt: reader) {
+				ASSERT_NE(full_it, full.end());
+				ASSERT_EQ(evt.eventNumber, full_it->eventNumber);
+				ASSERT_EQ(evt.tracks.size(), full_it->tracks.size());
+				for(size_t i = 0; i < evt.tracks.size(); ++i) {
+					const auto& track = evt.tracks[i];
+					const auto& fullTrack = full_it->tracks[i];
+					// all points keep their position, only the required ones have coordinates
+					EXPECT_EQ(track.sensorIDs, fullTrack.sensorIDs);
+					ASSERT_EQ(track.points.size(), fullTrack.points.size());
+					for(size_t pt = 0; pt < track.points.size(); ++pt) {
+						if(std::find(sensors.begin(), sensors.end(), track.sensorIDs[pt]) != sensors.end()) {
+							EXPECT_EQ(track.points[pt], fullTrack.points[pt]);
+						} else {
+							EXPECT_TRUE(track.points[pt].array().isNaN().all());
+						}
+					}
+				}
+				++full_it;
+				++totalEvts;
+			}
+			EXPECT_EQ(totalEvts, numLargeEvents);
+		}
+	}
+
+	// tracks without any of the required sensors are kept
+	TrackStreamReader reader(env->valid1);
+	reader.setRequiredSensors({42});
+	TrackStreamReader full(env->valid1);
+	auto full_it = full.begin();
+	for(const auto& evt: reader) {
+		ASSERT_NE(full_it, full.end());
+		ASSERT_EQ(evt.tracks.size(), full_it->tracks.size());
+		for(size_t i = 0; i < evt.tracks.size(); ++i) {
+			EXPECT_EQ(evt.tracks[i].points.size(), full_it->tracks[i].points.size());
+			for(const auto& point: evt.tracks[i].points) {
+				EXPECT_TRUE(point.array().isNaN().all());
+			}
+		}
+		++full_it;
+	}
+	EXPECT_EQ(full_it, full.end());
+}
+
+TEST(trackstreamreader, event_filter)
+{
+	EventFilter filter;
+	filter.firstEvent = 100;
+	filter.lastEvent = 5000;
+	filter.minTracks = filter.maxTracks = 1;
+	std::vector<int> expected;
+	for(const auto& evt: TrackStreamReader(env->large)) {
+		if(filter.acceptsEventNumber(evt.eventNumber) && filter.acceptsTracks(evt.tracks.size())) {
+			expected.push_back(evt.eventNumber);
+		}
+	}
+	ASSERT_GT(expected.size(), 0);
+
+	TrackBinaryFile::write(TrackStreamReader(env->large), env->binary);
+	for(const auto& filename: {env->large, env->binary}) {
+		for(size_t prefetch: {0, 8}) {
+			TrackStreamReader reader(filename);
+			reader.setEventFilter(filter);
+			reader.setPrefetch(prefetch);
+			std::vector<int> events;
+			for(const auto& evt: reader) {
+				ASSERT_EQ(evt.tracks.size(), 1);
+				ASSERT_EQ(evt.tracks[0].points.size(), 6);
+				events.push_back(evt.eventNumber);
+			}
+			EXPECT_EQ(events, expected) << filename << " prefetch " << prefetch;
+
+			auto it = reader.begin();
+			++it;
+			auto copy = it;
+			++copy;
+			EXPECT_EQ(it->eventNumber, expected[1]);
+			EXPECT_EQ(copy->eventNumber, expected[2]);
+		}
+	}
+}
+
+void expectParallelEvents(const std::string& filename, size_t chunkSize, const std::vector<int>& sensors={},
+	std::shared_ptr<const EventFilter> filter=nullptr, size_t firstEvent=0)
+{
+	TrackStreamReader reference(filename);
+	reference.setRequiredSensors(sensors);
+	if(filter) {
+		reference.setEventFilter(*filter);
+	}
+	reference.setEventRange(firstEvent);
+	ParallelTrackLoader loader(filename, 3, chunkSize, sensors, filter, firstEvent);
+	TrackStreamReader::event_t evt;
+	size_t numEvents = 0;
+	for(const auto& ref: reference) {
+		ASSERT_TRUE(loader.next(evt)) << filename << " chunk size " << chunkSize;
+		ASSERT_EQ(evt.eventNumber, ref.eventNumber);
+		EXPECT_EQ(evt.runID, ref.runID);
+		ASSERT_EQ(evt.tracks.size(), ref.tracks.size()) << "event " << ref.eventNumber;
+		for(size_t i = 0; i < evt.tracks.size(); ++i) {
+			EXPECT_EQ(evt.tracks[i].sensorIDs, ref.tracks[i].sensorIDs);
+			ASSERT_EQ(evt.tracks[i].points.size(), ref.tracks[i].points.size());
+			// the skipped points are NaN in both
+			for(size_t pt = 0; pt < evt.tracks[i].points.size(); ++pt) {
+				EXPECT_TRUE(evt.tracks[i].points[pt].cwiseEqual(ref.tracks[i].points[pt]).all() ||
+				            (evt.tracks[i].points[pt].array().isNaN().all() &&
+				             ref.tracks[i].points[pt].array().isNaN().all()));
+			}
+		}
+		++numEvents;
+	}
+	EXPECT_FALSE(loader.next(evt)) << filename;
+	EXPECT_GT(numEvents, 0);
+}
+
+/// Both readers throw the same error at the same line
+template<typename E>
+void expectParallelError(const std::string& filename, size_t chunkSize)
+{
+	std::string expected;
+	try {
+		for(const auto& evt: TrackStreamReader(filename)) {
+		}
+	} catch(E& e) {
+		expected = e.what();
+	}
+	ASSERT_FALSE(expected.empty()) << filename;
+	try {
+		ParallelTrackLoader loader(filename, 3, chunkSize);
+		TrackStreamReader::event_t evt;
+		while(loader.next(evt)) {
+		}
+		ADD_FAILURE() << filename << ": no error";
+	} catch(E& e) {
+		EXPECT_EQ(e.what(), expected) << "chunk size " << chunkSize;
+	}
+}
+
+TEST(trackstreamreader, parallel_split_blocks)
+{
+	const std::string data = "1\n\n\n2\n\n#c\n\n3\n\r\n\n\n4";
+	auto chunks = ParallelTrackLoader::splitBlocks(data.data(), data.size(), 1);
+	std::vector<std::pair<size_t, size_t>> expected = {{0, 4}, {4, 12}, {16, 2}};
+	ASSERT_EQ(chunks, expected);
+	expected = {{0, data.size()}};
+	EXPECT_EQ(ParallelTrackLoader::splitBlocks(data.data(), data.size(), 1 << 20), expected);
+	EXPECT_TRUE(ParallelTrackLoader::splitBlocks(data.data(), 0, 1).empty());
+}
+
+TEST(trackstreamreader, parallel)
+{
+	// small chunks split events with several tracks
+	for(size_t chunkSize: {1, 100, 4096, 1 << 22}) {
+		expectParallelEvents(env->large, chunkSize);
+	}
+	for(const auto& filename: {env->valid1, env->valid2, env->valid3, env->negatives, env->scientific_numbers,
+	                           env->float_wo_decimal}) {
+		expectParallelEvents(filename, 1);
+	}
+	expectParallelEvents(env->large, 1000, {0, 5});
+	expectParallelEvents(env->large, 1000, {}, nullptr, 777);
+	EventFilter filter;
+	filter.firstEvent = 100;
+	filter.lastEvent = 5000;
+	filter.minTracks = filter.maxTracks = 2;
+	expectParallelEvents(env->large, 1000, {2}, std::make_shared<EventFilter>(filter), 50);
+
+	// iterators of the reader
+	TrackStreamReader reference(env->large);
+	TrackStreamReader reader(env->large);
+	reader.setNumThreads(4);
+	auto ref_it = reference.begin();
+	size_t totalEvts = 0;
+	for(const auto& evt: reader) {
+		ASSERT_NE(ref_it, reference.end());
+		ASSERT_EQ(evt.eventNumber, ref_it->eventNumber);
+		ASSERT_EQ(evt.tracks.size(), ref_it->tracks.size());
+		EXPECT_EQ(evt.tracks[0].points, ref_it->tracks[0].points);
+		++ref_it;
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, numLargeEvents);
+
+	reader.setEventRange(100, 10);
+	auto it = reader.begin();
+	EXPECT_EQ(it->eventNumber, 100);
+	++it;
+	auto copy = it;
+	totalEvts = 2;
+	while(++copy != reader.end()) {
+		++it;
+		EXPECT_EQ(it->eventNumber, copy->eventNumber);
+		++totalEvts;
+	}
+	EXPECT_EQ(totalEvts, 10);
+	EXPECT_EQ(++it, reader.end());
+	EXPECT_THROW(it.seekEvent(0), std::logic_error);
+}
+
+TEST(trackstreamreader, parallel_errors)
+{
+	char s[4096];
+	const std::string run_change = std::tmpnam(s);
+	std::ofstream fout(run_change);
+	fout << "# X     Y       Z       SensorID        Evt     Run\n"
+	     << "1.0000\t0.0000\t0\t0\t11\t4\n"
+	     << "0.0000\t1.0000\t0\t1\t11\t4\n\n\n"
+	     << "# next run\n\n\n"
+	     << "1.0000\t0.0000\t0\t0\t11\t5\n"
+	     << "0.0000\t1.0000\t0\t1\t11\t5\n\n\n";
+	fout.close();
+	for(size_t chunkSize: {1, 4096}) {
+		expectParallelError<TrackStreamReader::consistency_error>(env->bad_evt_order, chunkSize);
+		expectParallelError<TrackStreamReader::consistency_error>(run_change, chunkSize);
+		expectParallelError<TrackStreamReader::parse_error>(env->parse_error, chunkSize);
+	}
+	std::remove(run_change.c_str());
+
+	TrackStreamReader broken(env->bad_evt_order);
+	broken.setNumThreads(2);
+	EXPECT_THROW({
+		for(const auto& evt: broken) {
+		}
+	}, TrackStreamReader::consistency_error);
+}
+
 int main(int argc, char **argv) {
 	::testing::InitGoogleTest(&argc, argv);
 	::testing::AddGlobalTestEnvironment(env = new DataFileEnv);
@@ -0,0 +1,36 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include "trackstreamreader.h"
+#include "trackbinaryfile.h"
+
+int main(int argc, char* argv[])
+{
+	if(argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <input> <output.trk>\n\n"
+		          << "Convert a text track data file into the columnar binary track format."
+		          << std::endl;
+		return 1;
+	}
+	if(!core::TrackBinaryFile::isBinaryFile(argv[2])) {
+		std::cerr << argv[0] << ": Output file must have the extension .trk, otherwise it "
+		          << "will be read as text file." << std::endl;
+		return 1;
+	}
+	try {
+		core::TrackStreamReader reader(argv[1]);
+		size_t numEvents = core::TrackBinaryFile::write(reader, argv[2]);
+		std::cout << "Converted " << numEvents << " events from '" << argv[1] << "' to '"
+		          << argv[2] << "'." << std::endl;
+	} catch(std::ios_base::failure& e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	} catch(core::TrackStreamReader::parse_error& e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	} catch(core::TrackStreamReader::consistency_error& e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include "core.h"
+#include "mpabinarystreamreader.h"
+
+int main(int argc, char* argv[])
+{
+	if(argc != 3 && argc != 4) {
+		std::cerr << "Usage: " << argv[0] << " <input> <output> [reader type]\n\n"
+		          << "Convert MPA counter data into the binary format read by MpaBinaryStreamReader.\n"
+		          << "The input is read with the given pixel reader type, default MPAStreamReader."
+		          << std::endl;
+		return 1;
+	}
+	core::initClasses();
+	std::string readerType(argc == 4 ? argv[3] : "MPAStreamReader");
+	try {
+		auto reader = core::BaseSensorStreamReader::Factory::Instance()->createShared(readerType);
+		reader->setFilename(argv[1]);
+		size_t numEvents = core::MpaBinaryStreamReader::write(*reader, argv[2]);
+		std::cout << "Converted " << numEvents << " events from '" << argv[1] << "' to '"
+		          << argv[2] << "'." << std::endl;
+	} catch(std::ios_base::failure& e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	} catch(std::out_of_range& e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
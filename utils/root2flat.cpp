@@ -0,0 +1,38 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include "mergedanalysis.h"
+#include "runsnapshot.h"
+
+int main(int argc, char* argv[])
+{
+	if(argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <input.root> <output.flat>\n\n"
+		          << "Convert the data tree of a merged testbeam ROOT file into a flat run file, which\n"
+		          << "MergedAnalysis maps into memory if it is given as testbeam_data."
+		          << std::endl;
+		return 1;
+	}
+	if(!core::RunSnapshot::isFlatFile(argv[2])) {
+		std::cerr << argv[0] << ": Output file must have the extension .flat, otherwise it "
+		          << "will be read as ROOT file." << std::endl;
+		return 1;
+	}
+	try {
+		core::run_data_t run = core::MergedAnalysis::openDataTree(0, argv[1]);
+		try {
+			core::RunSnapshot snapshot(run);
+			snapshot.write(argv[2]);
+			std::cout << "Converted " << snapshot.size() << " events from '" << argv[1] << "' to '"
+			          << argv[2] << "'." << std::endl;
+		} catch(...) {
+			core::MergedAnalysis::closeRun(run);
+			throw;
+		}
+		core::MergedAnalysis::closeRun(run);
+	} catch(std::runtime_error& e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}